@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Benchmark runner for the interpreter.
+
+Runs the workloads in bench/ (or, with --data, the data/*.in test inputs
+as throughput benchmarks) several times each and reports, per benchmark,
+the best and median wall time, the peak RSS and the number of pool
+allocations (both from --alloc-stats; the allocation count is
+deterministic for a given build). Results are compared against a stored baseline JSON; a benchmark
+whose best time, allocation count or peak RSS grew by more than the
+threshold is reported as a regression and makes the exit status 1; time
+differences of a few milliseconds and RSS differences under a megabyte
+are treated as noise. The streams workload is there for its RSS: it fails
+if stream-filter keeps the cells it skips alive.
+
+    ./bench.py                          # run the suite, compare with bench/baseline.json
+    ./bench.py --save                   # run and store the results as the new baseline
+    ./bench.py --data --runs 3          # time score/data/*.in instead
+    ./bench.py fib tak --engine --tree  # only some benchmarks, on the tree-walker
+
+bench.sh keeps the older micro-benchmarks (variable lookup cost and
+friends); this runner is for whole-program numbers.
+"""
+
+import argparse
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# 标准负载，顺序就是报告里的顺序
+SUITE = ["fib", "tak", "ackermann", "nqueens", "listops", "harmonic", "strings", "nary", "streams"]
+
+ALLOC_LINE = re.compile(r"^; allocations: (\d+)", re.M)
+# 解释器自己在退出前读 VmHWM：在父进程里用 wait4 的 ru_maxrss 会算上 exec 之前 Python 的峰值
+RSS_LINE = re.compile(r"^; peak rss: (\d+) kB", re.M)
+
+
+def run_once(cmd):
+    """Run cmd with output discarded; return (seconds, stderr, exit code)."""
+    with tempfile.TemporaryFile() as err:
+        start = time.perf_counter()
+        status = subprocess.call(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.DEVNULL, stderr=err)
+        elapsed = time.perf_counter() - start
+        err.seek(0)
+        return elapsed, err.read().decode(errors="replace"), status
+
+
+def measure(code, engine_args, path, runs):
+    times = []
+    for _ in range(runs):
+        elapsed, err, status = run_once([code, "--batch", path] + engine_args)
+        if status != 0:
+            raise RuntimeError("%s exited with %d: %s" % (path, status, err.strip()[-200:]))
+        times.append(elapsed)
+    # 分配次数和峰值内存单独跑一遍：--alloc-stats 每个顶层表达式都往 stderr 写一行，不算进计时
+    _, err, _ = run_once([code, "--batch", path, "--alloc-stats"] + engine_args)
+    allocs = sum(int(n) for n in ALLOC_LINE.findall(err))
+    peak = RSS_LINE.search(err)
+    rss = int(peak.group(1)) if peak else 0
+    return {
+        "best_ms": round(min(times) * 1000, 2),
+        "median_ms": round(statistics.median(times) * 1000, 2),
+        "rss_kb": rss,
+        "allocs": allocs,
+    }
+
+
+def benchmarks(args):
+    if args.data:
+        data = os.path.join(HERE, "data")
+        names = sorted((f[:-3] for f in os.listdir(data) if f.endswith(".in")), key=lambda s: (len(s), s))
+        paths = {n: os.path.join(data, n + ".in") for n in names}
+    else:
+        names = SUITE
+        paths = {n: os.path.join(HERE, "bench", n + ".scm") for n in names}
+    if args.names:
+        unknown = [n for n in args.names if n not in paths]
+        if unknown:
+            sys.exit("unknown benchmark: " + ", ".join(unknown))
+        names = args.names
+    return [(n, paths[n]) for n in names]
+
+
+def change(new, old):
+    if not old:
+        return None
+    return (new - old) / old
+
+
+def fmt_change(c):
+    return "" if c is None else "%+6.1f%%" % (c * 100)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("names", nargs="*", help="benchmarks to run (default: all)")
+    parser.add_argument("--code", default=os.path.join(HERE, "..", "build", "code"), help="interpreter binary")
+    parser.add_argument("--runs", type=int, default=5, help="timed runs per benchmark")
+    parser.add_argument("--data", action="store_true", help="benchmark data/*.in instead of the bench/ suite")
+    parser.add_argument("--engine", nargs=argparse.REMAINDER, default=[],
+                        help="remaining arguments are passed to the interpreter, e.g. --engine --tree")
+    parser.add_argument("--baseline", help="baseline JSON (default: bench/baseline.json, or bench/baseline-data.json with --data)")
+    parser.add_argument("--save", action="store_true", help="write the results to the baseline file")
+    parser.add_argument("--threshold", type=float, default=0.10, help="relative growth counted as a regression")
+    parser.add_argument("--min-ms", type=float, default=5.0,
+                        help="time differences below this are noise, never a regression")
+    parser.add_argument("--min-kb", type=int, default=1024,
+                        help="RSS differences below this are noise, never a regression")
+    args = parser.parse_args()
+
+    if not os.access(args.code, os.X_OK):
+        sys.exit("Interpreter %s not found, build it first" % args.code)
+    baseline_path = args.baseline or os.path.join(HERE, "bench", "baseline-data.json" if args.data else "baseline.json")
+    baseline = {}
+    if os.path.exists(baseline_path) and not args.save:
+        with open(baseline_path) as f:
+            stored = json.load(f)
+        if stored.get("engine", []) != args.engine:
+            print("note: baseline was recorded with engine args %s" % stored.get("engine", []))
+        baseline = stored.get("results", {})
+
+    results = {}
+    regressions = []
+    print("%-12s %10s %10s %9s %12s %8s %8s %8s" % ("benchmark", "best ms", "median ms", "rss KiB", "allocs", "time", "allocs", "rss"))
+    for name, path in benchmarks(args):
+        r = measure(args.code, args.engine, path, args.runs)
+        results[name] = r
+        old = baseline.get(name, {})
+        dt = change(r["best_ms"], old.get("best_ms"))
+        da = change(r["allocs"], old.get("allocs"))
+        dr = change(r["rss_kb"], old.get("rss_kb"))
+        slower_time = dt is not None and dt > args.threshold and r["best_ms"] - old["best_ms"] >= args.min_ms
+        bigger = dr is not None and dr > args.threshold and r["rss_kb"] - old["rss_kb"] >= args.min_kb
+        slower = slower_time or bigger or (da is not None and da > args.threshold)
+        if slower:
+            regressions.append(name)
+        print("%-12s %10.2f %10.2f %9d %12d %8s %8s %8s%s" % (
+            name, r["best_ms"], r["median_ms"], r["rss_kb"], r["allocs"],
+            fmt_change(dt), fmt_change(da), fmt_change(dr), "  REGRESSION" if slower else ""))
+        sys.stdout.flush()
+
+    if args.save:
+        with open(baseline_path, "w") as f:
+            json.dump({"engine": args.engine, "runs": args.runs, "results": results}, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("baseline written to %s" % baseline_path)
+    elif regressions:
+        print("regressions over %d%%: %s" % (round(args.threshold * 100), ", ".join(regressions)))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,45 @@
+#!/bin/bash
+
+# 变量查找的微基准：对比 bench/lookup.scm 与去掉变量引用的 bench/lookup-base.scm，
+# 两者耗时之差除以引用次数即为单次查找的开销
+# 有理数约分的微基准：bench/harmonic.scm（调和级数等长分数运算）的总耗时
+# n 元算术的微基准：bench/nary.scm（多参数 + - * / 与比较链）的总耗时
+# 用法: ./bench.sh [解释器路径]，默认 ../build/code
+# 整程序的基准（计时、峰值内存、分配次数，和基线对比）见 bench.py
+
+cd "$(dirname "$0")"
+
+CODE=${1:-../build/code}
+RUNS=5
+LOOKUPS=3200000
+
+if [ ! -x "$CODE" ]; then
+    echo "Interpreter $CODE not found, build it first"
+    exit 1
+fi
+
+# 取 RUNS 次中最快的一次（纳秒）
+best_time() {
+    local best=0
+    for ((r = 0; r < RUNS; r = r + 1)); do
+        local start=$(date +%s%N)
+        "$CODE" < "$1" > /dev/null
+        local end=$(date +%s%N)
+        local t=$((end - start))
+        if [ $best -eq 0 ] || [ $t -lt $best ]; then
+            best=$t
+        fi
+    done
+    echo $best
+}
+
+t_lookup=$(best_time bench/lookup.scm)
+t_base=$(best_time bench/lookup-base.scm)
+t_harmonic=$(best_time bench/harmonic.scm)
+t_nary=$(best_time bench/nary.scm)
+
+echo "lookup.scm      : $((t_lookup / 1000000)) ms"
+echo "lookup-base.scm : $((t_base / 1000000)) ms"
+echo "per lookup      : $(( (t_lookup - t_base) / LOOKUPS )) ns"
+echo "harmonic.scm    : $((t_harmonic / 1000000)) ms"
+echo "nary.scm        : $((t_nary / 1000000)) ms"
@@ -0,0 +1,10 @@
+;; Doubly recursive Fibonacci: procedure calls and fixnum arithmetic on
+;; the non-tail path, with no allocation beyond environment frames.
+
+(define (fib n)
+  (if (< n 2)
+      n
+      (+ (fib (- n 1)) (fib (- n 2)))))
+
+(fib 27)
+(exit)
@@ -0,0 +1,25 @@
+;; Rational reduction micro-benchmark.
+;; harmonic sums H(n) = 1 + 1/2 + ... + 1/n grow bignum denominators, so
+;; every step pays for a gcd on long operands; the telescoping product
+;; (1/2)(2/3)...(n/(n+1)) and the small-fraction loop stress the
+;; normalization of results that cancel down to short values.
+
+(define (harmonic n acc)
+  (if (= n 0)
+      acc
+      (harmonic (- n 1) (+ acc (/ 1 n)))))
+
+(define (telescope n acc)
+  (if (= n 0)
+      acc
+      (telescope (- n 1) (* acc (/ n (+ n 1))))))
+
+(define (small-sums n acc)
+  (if (= n 0)
+      acc
+      (small-sums (- n 1) (+ (- acc (/ 1 (* n (+ n 1)))) (/ 1 (* n (+ n 1)))))))
+
+(harmonic 3000 0)
+(telescope 20000 1)
+(small-sums 100000 (/ 1 3))
+(exit)
@@ -0,0 +1,28 @@
+;; Deep list map / filter / fold over a 5000-element list, repeated:
+;; allocation-heavy, with non-tail recursion as deep as the list.
+
+(define (iota n)
+  (define (loop i acc) (if (= i 0) acc (loop (- i 1) (cons i acc))))
+  (loop n '()))
+
+(define (map f lst)
+  (if (null? lst) '() (cons (f (car lst)) (map f (cdr lst)))))
+
+(define (filter p lst)
+  (cond ((null? lst) '())
+        ((p (car lst)) (cons (car lst) (filter p (cdr lst))))
+        (else (filter p (cdr lst)))))
+
+(define (fold f acc lst)
+  (if (null? lst) acc (fold f (f acc (car lst)) (cdr lst))))
+
+(define (even? n) (= (modulo n 2) 0))
+
+(define (round k acc)
+  (if (= k 0)
+      acc
+      (round (- k 1)
+             (+ acc (fold + 0 (filter even? (map (lambda (x) (* x 3)) (iota 5000))))))))
+
+(round 60 0)
+(exit)
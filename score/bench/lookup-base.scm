@@ -0,0 +1,18 @@
+;; Control loop for lookup.scm: identical, minus the 16 extra references.
+
+(define g 7)
+
+(define (lookup-loop n a b c d)
+  (if (= n 0)
+      0
+      (let ((e 1) (f 2))
+        (begin
+               (lookup-loop (- n 1) a b c d)))))
+
+(define (run-lookup k)
+  (if (= k 0)
+      0
+      (begin (lookup-loop 1000 1 2 3 4) (run-lookup (- k 1)))))
+
+(run-lookup 200)
+(exit)
@@ -0,0 +1,22 @@
+;; Variable lookup micro-benchmark.
+;; Each iteration of lookup-loop references 16 variables (locals from two
+;; frames and one global) on top of the loop control; lookup-base.scm runs the
+;; same loop without them, so the difference is the cost of the lookups.
+;; run-lookup = 200 * 1000 iterations = 3,200,000 lookups.
+
+(define g 7)
+
+(define (lookup-loop n a b c d)
+  (if (= n 0)
+      0
+      (let ((e 1) (f 2))
+        (begin a b c d e f g a b c d e f g a b
+               (lookup-loop (- n 1) a b c d)))))
+
+(define (run-lookup k)
+  (if (= k 0)
+      0
+      (begin (lookup-loop 1000 1 2 3 4) (run-lookup (- k 1)))))
+
+(run-lookup 200)
+(exit)
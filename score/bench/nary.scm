@@ -0,0 +1,28 @@
+;; N-ary arithmetic micro-benchmark.
+;; Every iteration folds four- and five-operand +, -, *, / and comparison
+;; chains over fixnums and rationals, once through the primitive nodes and
+;; once through the same procedures called as values, so both the operand
+;; buffer and the accumulator are on the path.
+
+(define add +)
+(define less <)
+
+(define (nary n acc)
+  (if (= n 0)
+      acc
+      (nary (- n 1)
+            (if (< 0 n (+ n 1) (+ n 2))
+                (- (+ acc n n n (* n 2 1 1)) n (* 2 n) n (/ (* n 4) 2 2) 1/2 1/2 -1)
+                acc))))
+
+(define (nary-values n acc)
+  (if (= n 0)
+      acc
+      (nary-values (- n 1)
+                   (if (less 0 n (add n 1))
+                       (add acc 1 1/3 1/6 1/2 -2)
+                       acc))))
+
+(nary 300000 0)
+(nary-values 300000 0)
+(exit)
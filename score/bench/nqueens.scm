@@ -0,0 +1,22 @@
+;; N-queens by backtracking over lists: counts every placement of 8 and 9
+;; queens, mixing short-lived conses, closures and boolean logic.
+
+(define (ok? row dist placed)
+  (or (null? placed)
+      (and (not (= (car placed) (+ row dist)))
+           (not (= (car placed) (- row dist)))
+           (not (= (car placed) row))
+           (ok? row (+ dist 1) (cdr placed)))))
+
+(define (try row n placed)
+  (cond ((= (length placed) n) 1)
+        ((> row n) 0)
+        (else (+ (if (ok? row 1 placed) (try 1 n (cons row placed)) 0)
+                 (try (+ row 1) n placed)))))
+
+(define (length lst)
+  (if (null? lst) 0 (+ 1 (length (cdr lst)))))
+
+(try 1 8 '())
+(try 1 9 '())
+(exit)
@@ -0,0 +1,10 @@
+;; Sparse stream-filter over an infinite stream: half a million cells are
+;; skipped before the first match. The skipped cells must be freed as the
+;; filter passes them, so the peak RSS stays near that of the other
+;; workloads; holding the head of the source would take well over 100 MB.
+
+(define (ints n) (cons-stream n (ints (+ n 1))))
+
+(stream->list (stream-take (stream-filter (lambda (x) (> x 500000)) (ints 0)) 3))
+(stream->list (stream-take (stream-map (lambda (x) (* x x)) (stream-filter (lambda (x) (= (modulo x 1000) 0)) (ints 1))) 100))
+(exit)
@@ -0,0 +1,17 @@
+;; String-heavy display loop: prints string literals, numbers, symbols
+;; and short lists, so the printer and the output buffer dominate.
+
+(define (show-row i)
+  (display "row ")
+  (display i)
+  (display ": ")
+  (display (list i 'sym "str" (/ i 3)))
+  (display "\n"))
+
+(define (loop i n)
+  (if (= i n)
+      'done
+      (begin (show-row i) (loop (+ i 1) n))))
+
+(loop 0 100000)
+(exit)
@@ -0,0 +1,13 @@
+;; Takeuchi function: deep non-tail recursion through three-argument
+;; calls and comparisons, the classic Gabriel call-overhead benchmark.
+
+(define (tak x y z)
+  (if (not (< y x))
+      z
+      (tak (tak (- x 1) y z)
+           (tak (- y 1) z x)
+           (tak (- z 1) x y))))
+
+(tak 18 12 6)
+(tak 22 16 8)
+(exit)
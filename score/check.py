@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""Scripted checks for the modes score.sh cannot cover with one .in/.out pair.
+
+Each check drives the interpreter through several processes or files and
+compares what comes back with the expected output in check/:
+
+    image   --save-image in one process, --image in another, on both
+            engines; then damaged images (a few bits flipped, checksum
+            recomputed so the loader's own validation is what gets tested)
+            must be refused or run, never crash the process
+    profile --profile on both engines: program output unchanged, the report
+            table well formed and sorted by self time, call and memo
+            counts as expected, --profile-stacks in collapsed-stack form
+    server  --server with a --prelude on both engines: sessions, one after
+            another and at the same time, each see the prelude's state and
+            none of each other's; a session past --session-timeout is cut
+            off with its own message and the server keeps serving
+
+    ./check.py                      # every check, against ../build/code
+    ./check.py image --code ../build/code
+
+The exit status is 1 if any check failed.
+"""
+
+import argparse
+import os
+import random
+import re
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+CHECK_DIR = os.path.join(HERE, "check")
+ENGINES = [[], ["--tree"]]
+
+
+def run(cmd, timeout=30):
+    """Run cmd; return (exit code, stdout, stderr), exit code None on timeout."""
+    try:
+        p = subprocess.run(cmd, stdin=subprocess.DEVNULL, capture_output=True, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return None, "", ""
+    return p.returncode, p.stdout.decode(errors="replace"), p.stderr.decode(errors="replace")
+
+
+def expected(name):
+    with open(os.path.join(CHECK_DIR, name)) as f:
+        return f.read()
+
+
+def fnv1a64(data):
+    """Same checksum as the end of an image file (image.cpp)."""
+    h = 14695981039346656037
+    for c in data:
+        h = ((h ^ c) * 1099511628211) & 0xFFFFFFFFFFFFFFFF
+    return h
+
+
+# 镜像里翻转几个位，再把末尾的校验和改对：这样加载器逐项的检查才真的被测到
+def damaged(image, seed, flips=3):
+    rnd = random.Random(seed)
+    body = bytearray(image[:-8])
+    for _ in range(flips):
+        body[rnd.randrange(len(body))] ^= 1 << rnd.randrange(8)
+    return bytes(body) + struct.pack("<Q", fnv1a64(body))
+
+
+def check_image(code, work, damaged_runs):
+    failures = []
+    save = os.path.join(CHECK_DIR, "image-save.scm")
+    use = os.path.join(CHECK_DIR, "image-use.scm")
+    want = expected("image-use.out")
+    image = os.path.join(work, "env.img")
+    for engine in ENGINES:
+        status, _, err = run([code, "--batch", save, "--save-image", image] + engine)
+        if status != 0:
+            failures.append("save %s exited with %s: %s" % (engine, status, err.strip()[-200:]))
+            continue
+        status, out, err = run([code, "--image", image, "--batch", use] + engine)
+        if status != 0 or out != want:
+            failures.append("load %s exited with %s, output differs from check/image-use.out" % (engine, status))
+
+    with open(image, "rb") as f:
+        good = f.read()
+    bad_image = os.path.join(work, "bad.img")
+    with open(bad_image, "wb") as f:
+        f.write(good[:-1] + bytes([good[-1] ^ 1]))
+    status, _, err = run([code, "--image", bad_image, "--batch", use])
+    if status != 1 or "image: checksum mismatch" not in err:
+        failures.append("an image with a wrong checksum was not refused")
+
+    for seed in range(damaged_runs):
+        with open(bad_image, "wb") as f:
+            f.write(damaged(good, seed))
+        for engine in ENGINES:
+            status, _, err = run([code, "--image", bad_image, "--batch", use] + engine, timeout=10)
+            if status is not None and (status < 0 or "AddressSanitizer" in err):
+                failures.append("damaged image %d %s killed the interpreter (%s)" % (seed, engine, status))
+    return failures
+
+
+# --profile 报告的一行：calls, self ms, total ms, self alloc, total alloc, procedure
+PROFILE_ROW = re.compile(r"^;\s+(\d+)\s+(\d+\.\d{3})\s+(\d+\.\d{3})\s+(\d+)\s+(\d+)\s+(\S+)$")
+MEMO_ROW = re.compile(r"^;\s+\d+\s+\d+\s+\d+\.\d%\s+\d+\s+\S+$")
+FOLDED_LINE = re.compile(r"^([^ ;]+(?:;[^ ;]+)*) (\d+)$")
+
+
+def profile_report(report, failures):
+    """Report with times and allocation counts dropped, rows sorted by name.
+
+    Times vary run to run and allocations between engines; what stays is
+    each procedure's call count. The dropped columns are checked here: rows
+    in decreasing self time, self never above total."""
+    kept, rows, last_self = [], [], None
+    for line in report.splitlines() + [""]:
+        m = PROFILE_ROW.match(line)
+        if m:
+            calls, self_ms, total_ms, self_alloc, total_alloc, name = m.groups()
+            if float(self_ms) > float(total_ms) + 0.001 or int(self_alloc) > int(total_alloc):
+                failures.append("self above total for %s" % name)
+            if last_self is not None and float(self_ms) > last_self:
+                failures.append("report not sorted by self time at %s" % name)
+            last_self = float(self_ms)
+            rows.append((name, "; %s %s" % (calls, name)))
+            continue
+        kept.extend(r for _, r in sorted(rows))
+        rows = []
+        if line == "":
+            continue
+        if line.startswith(";") and (MEMO_ROW.match(line) or not re.match(r"^;\s+\d", line)):
+            kept.append(line)  # 标题、表头和 memoize 的命中统计，都是确定的
+        else:
+            failures.append("unexpected report line %r" % line)
+    return "\n".join(kept) + "\n"
+
+
+def check_profile(code, work):
+    failures = []
+    program = os.path.join(CHECK_DIR, "profile.scm")
+    want_out = expected("profile.out")
+    want_report = expected("profile-report.out")
+    stacks = os.path.join(work, "profile.folded")
+    for engine in ENGINES:
+        status, out, err = run([code, "--batch", program, "--profile", "--profile-stacks", stacks] + engine)
+        if status != 0 or out != want_out:
+            failures.append("%s: exited with %s, output differs from check/profile.out" % (engine, status))
+            continue
+        report = profile_report(err, failures)
+        if report != want_report:
+            failures.append("%s: report differs from check/profile-report.out:\n%s" % (engine, report))
+        with open(stacks) as f:
+            folded = f.read().splitlines()
+        names, fib_depths = set(), set()
+        for line in folded:
+            m = FOLDED_LINE.match(line)
+            if not m:
+                failures.append("%s: bad collapsed stack line %r" % (engine, line))
+                continue
+            frames = m.group(1).split(";")
+            names.update(frames)
+            if frames[0] == "fib":
+                fib_depths.add(len(frames))
+        if names != {"fib", "loop", "lambda@3:23", "lambda@7:2"}:
+            failures.append("%s: unexpected procedures in stacks: %s" % (engine, sorted(names)))
+        if fib_depths != set(range(1, 16)):  # (fib 15) 递归 15 层，loop 是尾调用只有一层
+            failures.append("%s: fib stacks have depths %s" % (engine, sorted(fib_depths)))
+        if "loop" not in [l.split()[0] for l in folded]:
+            failures.append("%s: tail-calling loop is not a single frame" % engine)
+    return failures
+
+
+SESSION_TIMEOUT = 2
+
+
+def session(path, program, timeout=SESSION_TIMEOUT + 10):
+    """Send one program to the server at path; return what it wrote back."""
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.settimeout(timeout)
+    try:
+        s.connect(path)
+        s.sendall(program.encode())
+        s.shutdown(socket.SHUT_WR)  # 客户端写完就关掉自己这头，服务端读到 EOF 才开始求值
+        chunks = []
+        while True:
+            chunk = s.recv(1 << 16)
+            if not chunk:
+                return b"".join(chunks).decode(errors="replace")
+            chunks.append(chunk)
+    finally:
+        s.close()
+
+
+def check_server(code, work):
+    failures = []
+    prelude = os.path.join(CHECK_DIR, "server-prelude.scm")
+    programs = {}
+    for name in ["server-a", "server-b"]:
+        with open(os.path.join(CHECK_DIR, name + ".scm")) as f:
+            programs[name] = (f.read(), expected(name + ".out"))
+    for i, engine in enumerate(ENGINES):
+        path = os.path.join(work, "scm%d.sock" % i)  # 上一个服务退出时不删 socket 文件
+        server = subprocess.Popen([code, "--server", path, "--prelude", prelude,
+                                   "--session-timeout", str(SESSION_TIMEOUT)] + engine,
+                                  stdin=subprocess.DEVNULL, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        try:
+            for _ in range(200):
+                if os.path.exists(path) or server.poll() is not None:
+                    break
+                time.sleep(0.05)
+            if not os.path.exists(path):
+                failures.append("%s: server did not start" % engine)
+                continue
+
+            def expect(name, what):
+                program, want = programs[name]
+                try:
+                    got = session(path, program)
+                except OSError as e:
+                    got = "(%s)" % e
+                if got != want:
+                    failures.append("%s: %s %s wrote %r, expected %r" % (engine, name, what, got, want))
+
+            # 一个接一个：后一个会话看不到前一个的 define / set! / 表里加的东西
+            for name in ["server-a", "server-b", "server-a"]:
+                expect(name, "alone")
+            # 同时跑：各在各的子进程里
+            threads = [threading.Thread(target=expect, args=(name, "in parallel"))
+                       for name in ["server-a", "server-b", "server-a", "server-b"]]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+
+            start = time.time()
+            try:
+                got = session(path, "(define (spin) (spin))\n1\n(spin)\n")
+            except OSError as e:
+                got = "(%s)" % e
+            elapsed = time.time() - start
+            if got != "\n; session timed out\n" or not SESSION_TIMEOUT - 0.5 <= elapsed <= SESSION_TIMEOUT + 5:
+                failures.append("%s: a looping session got %r after %.1fs" % (engine, got, elapsed))
+            expect("server-b", "after a timeout")
+        finally:
+            server.terminate()
+            out, _ = server.communicate()
+        if out.decode(errors="replace") != expected("server-prelude.out"):
+            failures.append("%s: server printed %r for the prelude" % (engine, out))
+    return failures
+
+
+CHECKS = {
+    "image": lambda args, work: check_image(args.code, work, args.damaged),
+    "profile": lambda args, work: check_profile(args.code, work),
+    "server": lambda args, work: check_server(args.code, work),
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("names", nargs="*", help="checks to run (default: all)")
+    parser.add_argument("--code", default=os.path.join(HERE, "..", "build", "code"), help="interpreter binary")
+    parser.add_argument("--damaged", type=int, default=100, help="damaged images tried per engine")
+    args = parser.parse_args()
+    args.code = os.path.abspath(args.code)
+    if not os.access(args.code, os.X_OK):
+        print("Interpreter %s not found, build it first" % args.code)
+        return 1
+    names = args.names or list(CHECKS)
+    unknown = [n for n in names if n not in CHECKS]
+    if unknown:
+        print("unknown check: %s" % ", ".join(unknown))
+        return 1
+
+    failed = 0
+    for name in names:
+        with tempfile.TemporaryDirectory() as work:
+            failures = CHECKS[name](args, work)
+        if failures:
+            failed += 1
+            print("\033[31m[FAIL] %s\033[0m" % name)
+            for f in failures:
+                print("    -> " + f)
+        else:
+            print("\033[32m[PASS] %s\033[0m" % name)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,19 @@
+(define (make-counter)
+  (let ((n 0))
+    (lambda () (set! n (+ n 1)) n)))
+(define c (make-counter))
+(c)
+(c)
+(define (adder k) (lambda (x) (+ x k)))
+(define add5 (adder 5))
+(define (fib n)
+  (letrec ((go (lambda (i a b) (if (= i n) a (go (+ i 1) b (+ a b))))))
+    (go 0 0 1)))
+(define shared (list 1 2 3))
+(define both (cons shared shared))
+(define half (/ 1 2))
+(define big (* 99999999999 99999999999))
+(define vec (vector 1 "two" 'three))
+(define h (make-hash-table))
+(hash-table-set! h 'k 42)
+(define (nest n acc) (if (= n 0) acc (let ((m (- n 1))) (nest m (cons n acc)))))
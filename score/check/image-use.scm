@@ -0,0 +1,9 @@
+(c)
+(add5 10)
+(fib 50)
+(eq? (car both) (cdr both))
+(+ half (/ 1 3))
+big
+vec
+(hash-table-ref h 'k)
+(nest 5 '())
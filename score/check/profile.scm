@@ -0,0 +1,7 @@
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(define (loop i acc) (if (= i 0) acc (loop (- i 1) (+ acc 1))))
+(define mfib (memoize (lambda (n) (if (< n 2) n (+ (mfib (- n 1)) (mfib (- n 2)))))))
+(fib 15)
+(loop 1000 0)
+(mfib 30)
+((lambda (x) (* x x)) 7)
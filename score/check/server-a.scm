@@ -0,0 +1,6 @@
+(bump)
+(bump)
+(define x 5)
+(hash-table-set! table 'a 1)
+(hash-table-count table)
+x
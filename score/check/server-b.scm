@@ -0,0 +1,6 @@
+counter
+(bump)
+x
+(hash-table-count table)
+(define (bump) 'replaced)
+(bump)
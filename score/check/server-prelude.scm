@@ -0,0 +1,4 @@
+(define counter 0)
+(define (bump) (set! counter (+ counter 1)) counter)
+(define table (make-hash-table))
+'prelude-loaded
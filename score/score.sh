@@ -18,7 +18,11 @@ else
 fi
 
 L=1
-R=20
+R=33
+
+# 额外参数原样传给解释器，例如 ./score.sh --tree 用 tree-walker 跑一遍对照；
+# 单核机器上默认没有 worker，./score.sh --threads 4 才让 future 真的在别的线程上跑
+ENGINE_ARGS="$@"
 
 for ((i = $L; i <= $R; i = i + 1))
 do
@@ -32,23 +36,12 @@ do
         continue
     fi
 
-    # 运行程序
-    ../build/code << EOF > scm.out
-$(cat data/$i.in)
-(exit)
-EOF
+    # 运行程序：--batch 不打印提示符、读到文件末尾就结束，不需要再补 (exit)
+    ../build/code --batch "data/$i.in" $ENGINE_ARGS > scm.out
 
     # === 数据清洗 ===
-    
-    # 1. 删除最后一行 (exit 提示)
-    sed '$d' scm.out > scm_cleaned.out
-    mv scm_cleaned.out scm.out
-    
-    # 2. 删除 'scm> ' 提示符
-    sed 's/scm> //' scm.out > scm_cleaned.out
-    mv scm_cleaned.out scm.out
 
-    # 3. 【新增】删除空行 (包括只含空格的行)
+    # 删除空行 (包括只含空格的行)
     # /^[[:space:]]*$/d 表示：匹配 从行首(^)到行尾($)中间全是空白字符([[:space:]]*) 的行，并删除(d)
     sed '/^[[:space:]]*$/d' scm.out > scm_cleaned.out
     mv scm_cleaned.out scm.out
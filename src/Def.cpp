@@ -20,9 +20,22 @@
  * - Arithmetic: +, -, *, /, modulo, expt
  * - Comparison: <, <=, =, >=, >
  * - List operations: cons, car, cdr, list, set-car!, set-cdr!
+ * - Vector operations: make-vector, vector, vector-ref, vector-set!, vector-length,
+ *   vector-fill!, list->vector, vector->list
+ * - Hash tables: make-hash-table, hash-table-ref, hash-table-set!, hash-table-delete!,
+ *   hash-table-contains?, hash-table-count, hash-table-keys, hash-table-values,
+ *   hash-table->alist
  * - Logic: not, and, or (and/or support short-circuit evaluation)
- * - Type predicates: eq?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?
- * - I/O: display
+ * - Type predicates: eq?, equal?, boolean?, number?, null?, pair?, procedure?, symbol?, list?, string?, vector?,
+ *   hash-table?
+ * - Parallel evaluation: future, touch, parallel-map
+ * - Memoization: memoize
+ * - Lazy evaluation: force, make-promise, promise?, stream-car, stream-cdr, stream-map,
+ *   stream-filter, stream-take, stream->list
+ * - Strings: string-length, string-append, substring, string=?, string<?, string->symbol,
+ *   symbol->string, number->string, string->number
+ * - I/O: display, write-string, open-output-string, get-output-string
+ * - Resource accounting: runtime-stats
  * - Control: void, exit
  */
 std::map<std::string, ExprType> primitives = {
@@ -49,6 +62,27 @@ std::map<std::string, ExprType> primitives = {
     {"set-car!",  E_SETCAR},
     {"set-cdr!",  E_SETCDR},
 
+    // Vector operations
+    {"make-vector",   E_MAKEVECTOR},
+    {"vector",        E_VECTOR},
+    {"vector-ref",    E_VECTORREF},
+    {"vector-set!",   E_VECTORSET},
+    {"vector-length", E_VECTORLENGTH},
+    {"vector-fill!",  E_VECTORFILL},
+    {"list->vector",  E_LIST2VECTOR},
+    {"vector->list",  E_VECTOR2LIST},
+
+    // Hash table operations
+    {"make-hash-table",      E_MAKEHASH},
+    {"hash-table-ref",       E_HASHREF},
+    {"hash-table-set!",      E_HASHSET},
+    {"hash-table-delete!",   E_HASHDELETE},
+    {"hash-table-contains?", E_HASHCONTAINS},
+    {"hash-table-count",     E_HASHCOUNT},
+    {"hash-table-keys",      E_HASHKEYS},
+    {"hash-table-values",    E_HASHVALUES},
+    {"hash-table->alist",    E_HASH2ALIST},
+
     // Logic operations
     {"not",       E_NOT},
     {"and",       E_AND},
@@ -56,6 +90,7 @@ std::map<std::string, ExprType> primitives = {
     
     // Type predicates
     {"eq?",        E_EQQ},
+    {"equal?",     E_EQUALQ},
     {"boolean?",   E_BOOLQ},
     {"number?",    E_INTQ},      
     {"null?",      E_NULLQ},
@@ -64,9 +99,47 @@ std::map<std::string, ExprType> primitives = {
     {"symbol?",    E_SYMBOLQ},
     {"list?",      E_LISTQ},
     {"string?",    E_STRINGQ},
+    {"vector?",    E_VECTORQ},
+    {"hash-table?", E_HASHTABLEQ},
     
+    // Parallel evaluation
+    {"future",       E_FUTURE},
+    {"touch",        E_TOUCH},
+    {"parallel-map", E_PARALLELMAP},
+
+    // Memoization
+    {"memoize",      E_MEMOIZE},
+
+    // Lazy evaluation
+    {"force",         E_FORCE},
+    {"make-promise",  E_MAKEPROMISE},
+    {"promise?",      E_PROMISEQ},
+    {"stream-car",    E_STREAMCAR},
+    {"stream-cdr",    E_STREAMCDR},
+    {"stream-map",    E_STREAMMAP},
+    {"stream-filter", E_STREAMFILTER},
+    {"stream-take",   E_STREAMTAKE},
+    {"stream->list",  E_STREAM2LIST},
+
+    // Strings
+    {"string-length",  E_STRINGLENGTH},
+    {"string-append",  E_STRINGAPPEND},
+    {"substring",      E_SUBSTRING},
+    {"string=?",       E_STRINGEQ},
+    {"string<?",       E_STRINGLT},
+    {"string->symbol", E_STRING2SYMBOL},
+    {"symbol->string", E_SYMBOL2STRING},
+    {"number->string", E_NUMBER2STRING},
+    {"string->number", E_STRING2NUMBER},
+
     // I/O operations
     {"display",   E_DISPLAY},
+    {"write-string",       E_WRITESTRING},
+    {"open-output-string", E_OPENOUTPUTSTRING},
+    {"get-output-string",  E_GETOUTPUTSTRING},
+
+    // Resource accounting
+    {"runtime-stats", E_RUNTIMESTATS},
     
     // Special values and control
     {"void",      E_VOID},
@@ -84,9 +157,10 @@ std::map<std::string, ExprType> primitives = {
  * - Control flow constructs: begin, quote
  * - Conditional : if, cond
  * - Function definition: lambda
- * - Variable and function definition: define
+ * - Variable and function definition: define, define-memoized
  * - Binding constructs: let, letrec
  * - Assignment: set!
+ * - Lazy evaluation: delay, cons-stream
  * 
  * Note: and/or have been moved to primitives to support function-style usage
  * while maintaining their short-circuit evaluation behavior.
@@ -105,6 +179,7 @@ std::map<std::string, ExprType> reserved_words = {
 
     // Variable and function definition
     {"define",  E_DEFINE},   
+    {"define-memoized", E_DEFINEMEMO},
 
     // Binding constructs
     {"let",     E_LET},      
@@ -112,4 +187,8 @@ std::map<std::string, ExprType> reserved_words = {
     
     // Assignment
     {"set!",    E_SET}, 
+
+    // Lazy evaluation
+    {"delay",       E_DELAY},
+    {"cons-stream", E_CONSSTREAM},
 };
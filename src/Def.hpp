@@ -33,6 +33,7 @@ enum ExprType {
     // Basic types and literals
     E_FIXNUM,          
     E_RATIONAL,        
+    E_BIGNUM,          // 超出 int 范围的数字字面量
     E_STRING,         
     E_TRUE,            
     E_FALSE,           
@@ -62,6 +63,27 @@ enum ExprType {
     E_SETCAR,          
     E_SETCDR,          
 
+    // Vector operations
+    E_MAKEVECTOR,       // (make-vector k [fill])
+    E_VECTOR,
+    E_VECTORREF,
+    E_VECTORSET,
+    E_VECTORLENGTH,
+    E_VECTORFILL,
+    E_LIST2VECTOR,
+    E_VECTOR2LIST,
+
+    // Hash table operations
+    E_MAKEHASH,         // (make-hash-table [eq? | equal?])
+    E_HASHREF,          // (hash-table-ref table key [default])
+    E_HASHSET,
+    E_HASHDELETE,
+    E_HASHCONTAINS,
+    E_HASHCOUNT,
+    E_HASHKEYS,
+    E_HASHVALUES,
+    E_HASH2ALIST,
+
     // Logic operations
     E_NOT,              
     E_AND,             
@@ -69,6 +91,7 @@ enum ExprType {
     
     // Type predicates
     E_EQQ,              
+    E_EQUALQ,
     E_BOOLQ,           
     E_INTQ,            
     E_NULLQ,            
@@ -77,6 +100,8 @@ enum ExprType {
     E_SYMBOLQ,         
     E_LISTQ,                
     E_STRINGQ,          
+    E_VECTORQ,
+    E_HASHTABLEQ,
 
     // Control flow constructs
     E_BEGIN,          
@@ -91,6 +116,7 @@ enum ExprType {
     E_APPLY,           
     E_LAMBDA,         
     E_DEFINE,          
+    E_DEFINEMEMO,       // (define-memoized (f x ...) body ...)
 
     // Binding constructs
     E_LET,            
@@ -99,8 +125,46 @@ enum ExprType {
     // Assignment
     E_SET,             
 
+    // Parallel evaluation
+    E_FUTURE,           // (future thunk)
+    E_TOUCH,
+    E_PARALLELMAP,      // (parallel-map f list)
+
+    // Memoization
+    E_MEMOIZE,          // (memoize f [capacity])
+
+    // Lazy evaluation
+    E_DELAY,            // (delay e)，特殊形式
+    E_CONSSTREAM,       // (cons-stream a b) = (cons a (delay b))，特殊形式
+    E_FORCE,
+    E_MAKEPROMISE,
+    E_PROMISEQ,
+    E_STREAMCAR,
+    E_STREAMCDR,
+    E_STREAMMAP,        // (stream-map f s)
+    E_STREAMFILTER,     // (stream-filter pred s)
+    E_STREAMTAKE,       // (stream-take s n)
+    E_STREAM2LIST,      // (stream->list s [n])
+
+    // Strings
+    E_STRINGLENGTH,
+    E_STRINGAPPEND,
+    E_SUBSTRING,        // (substring s start [end])
+    E_STRINGEQ,
+    E_STRINGLT,
+    E_STRING2SYMBOL,
+    E_SYMBOL2STRING,
+    E_NUMBER2STRING,
+    E_STRING2NUMBER,    // 不是数字时返回 #f
+
     // I/O operations
-    E_DISPLAY,         
+    E_DISPLAY,          // (display v [port])
+    E_WRITESTRING,      // (write-string s [port])
+    E_OPENOUTPUTSTRING,
+    E_GETOUTPUTSTRING,
+
+    // Resource accounting
+    E_RUNTIMESTATS,
 };
 
 /**
@@ -112,14 +176,23 @@ enum ExprType {
 enum ValueType {
     V_INT,              
     V_RATIONAL,         
+    V_BIGINT,           // 超出 int 范围的整数
     V_BOOL,             
     V_SYM,              
     V_NULL,             
     V_STRING,           
     V_PAIR,             
+    V_VECTOR,           // 连续存储的向量，#( ... )
+    V_HASHTABLE,
     V_PROC,             
     V_VOID,            
-    V_TERMINATE        
+    V_TERMINATE,
+    V_PRIM,             // 内建过程（car、+ 等）作为一等值
+    V_FUTURE,           // future 返回的值，touch 取结果
+    V_MEMO,             // memoize 返回的过程，带 LRU 缓存
+    V_PROMISE,          // delay / cons-stream 的承诺，force 之后记住结果
+    V_PORT,             // open-output-string 的输出端口
+    V_UNBOUND           // 还没有值（letrec / define 的占位），Scheme 代码看不到
 };
 
 #endif // DEF_HPP
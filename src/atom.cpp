@@ -0,0 +1,46 @@
+/**
+ * @file atom.cpp
+ * @brief Implementation of the symbol table
+ */
+
+#include "atom.hpp"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+// 函数内 static：保证比任何全局 Expr / Value 先构造、后析构
+static std::unordered_map<std::string, Atom> &atomIds() {
+    static std::unordered_map<std::string, Atom> *ids = new std::unordered_map<std::string, Atom>();
+    return *ids;
+}
+
+static std::deque<std::string> &atomNames() { // deque 扩容时已有元素不搬家，atomName 的引用一直有效
+    static std::deque<std::string> *names = new std::deque<std::string>();
+    return *names;
+}
+
+// future 里的代码也会打印符号，worker 线程和主线程可能同时查表
+static std::mutex &atomLock() {
+    static std::mutex *lock = new std::mutex();
+    return *lock;
+}
+
+Atom intern(const std::string &s) {
+    std::lock_guard<std::mutex> guard(atomLock());
+    auto it = atomIds().find(s);
+    if (it != atomIds().end()) return it->second;
+    Atom id = (Atom)atomNames().size();
+    atomNames().push_back(s);
+    atomIds().emplace(s, id);
+    return id;
+}
+
+const std::string &atomName(Atom a) {
+    std::lock_guard<std::mutex> guard(atomLock());
+    return atomNames()[a];
+}
+
+size_t atomCount() {
+    std::lock_guard<std::mutex> guard(atomLock());
+    return atomNames().size();
+}
@@ -0,0 +1,22 @@
+#ifndef ATOM_HPP
+#define ATOM_HPP
+
+/**
+ * @file atom.hpp
+ * @brief Global symbol table
+ *
+ * Every identifier and symbol is interned once and afterwards carried
+ * around as a 32-bit atom ID, so comparing names is an integer compare.
+ * The table is locked, so any thread may intern and look up names.
+ */
+
+#include <cstdint>
+#include <string>
+
+typedef uint32_t Atom;
+
+Atom intern(const std::string &);        ///< ID of the name, assigned on first use
+const std::string &atomName(Atom);       ///< Spelling of an interned name
+size_t atomCount();                      ///< Number of names interned so far; IDs are 0..atomCount()-1
+
+#endif // ATOM_HPP
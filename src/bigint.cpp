@@ -0,0 +1,467 @@
+/**
+ * @file bigint.cpp
+ * @brief Arbitrary-precision integers
+ *
+ * Magnitudes are little-endian vectors of 32-bit limbs without leading
+ * zeros. Multiplication is schoolbook below KARATSUBA_LIMBS limbs and
+ * Karatsuba above, division is Knuth's algorithm D (one-limb divisors take
+ * a short loop), and decimal conversion works in chunks of 10^9.
+ */
+
+#include "bigint.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+typedef std::vector<uint32_t> Limbs;
+
+static const size_t KARATSUBA_LIMBS = 32;    // 短于这个长度时 schoolbook 更快
+static const uint32_t DEC_CHUNK = 1000000000u; // 10^9，一个 limb 里放得下的最大 10 的幂
+static const int DEC_CHUNK_DIGITS = 9;
+
+// ============================================================================
+// Magnitudes
+// ============================================================================
+
+static void trim(Limbs &a) {
+    while (!a.empty() && a.back() == 0) a.pop_back();
+}
+
+static int cmpMag(const Limbs &a, const Limbs &b) {
+    if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+    for (size_t i = a.size(); i-- > 0;) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static Limbs addMag(const Limbs &a, const Limbs &b) {
+    const Limbs &x = a.size() >= b.size() ? a : b;
+    const Limbs &y = a.size() >= b.size() ? b : a;
+    Limbs r(x.size() + 1);
+    uint64_t carry = 0;
+    for (size_t i = 0; i < x.size(); i++) {
+        carry += (uint64_t)x[i] + (i < y.size() ? y[i] : 0);
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    r[x.size()] = (uint32_t)carry;
+    trim(r);
+    return r;
+}
+
+static Limbs subMag(const Limbs &a, const Limbs &b) { // 要求 a >= b
+    Limbs r(a.size());
+    int64_t borrow = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        int64_t t = (int64_t)a[i] - (i < b.size() ? b[i] : 0) - borrow;
+        borrow = t < 0;
+        r[i] = (uint32_t)(t + (borrow << 32));
+    }
+    trim(r);
+    return r;
+}
+
+// r[0, rn) += x[0, xn)，调用方保证不会进位到 rn 之外
+static void addAt(uint32_t *r, size_t rn, const uint32_t *x, size_t xn) {
+    uint64_t carry = 0;
+    size_t i = 0;
+    for (; i < xn; i++) {
+        carry += (uint64_t)r[i] + x[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    for (; carry && i < rn; i++) {
+        carry += r[i];
+        r[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+}
+
+// r[0, rn) -= x[0, xn)，调用方保证结果非负
+static void subAt(uint32_t *r, size_t rn, const uint32_t *x, size_t xn) {
+    int64_t borrow = 0;
+    size_t i = 0;
+    for (; i < xn; i++) {
+        int64_t t = (int64_t)r[i] - x[i] - borrow;
+        borrow = t < 0;
+        r[i] = (uint32_t)(t + (borrow << 32));
+    }
+    for (; borrow && i < rn; i++) {
+        borrow = r[i] == 0;
+        r[i]--;
+    }
+}
+
+static Limbs addSpans(const uint32_t *a, size_t n, const uint32_t *b, size_t m) {
+    Limbs r(std::max(n, m) + 1, 0);
+    std::copy(a, a + n, r.begin());
+    addAt(r.data(), r.size(), b, m);
+    return r;
+}
+
+static void mulSchool(const uint32_t *a, size_t n, const uint32_t *b, size_t m, uint32_t *r) {
+    for (size_t i = 0; i < n; i++) {
+        uint64_t ai = a[i], carry = 0;
+        if (!ai) continue;
+        for (size_t j = 0; j < m; j++) {
+            carry += ai * b[j] + r[i + j]; // (2^32-1)^2 + 2(2^32-1) 正好放得进 64 位
+            r[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        r[i + m] = (uint32_t)carry;
+    }
+}
+
+// r[0, n+m) = a * b，r 需预先清零
+static void mulInto(const uint32_t *a, size_t n, const uint32_t *b, size_t m, uint32_t *r) {
+    if (n < m) {
+        std::swap(a, b);
+        std::swap(n, m);
+    }
+    if (m < KARATSUBA_LIMBS) {
+        mulSchool(a, n, b, m, r);
+        return;
+    }
+    size_t h = (n + 1) / 2;
+    if (m <= h) { // 长短悬殊：把 a 切成 b 那么长的几段分别乘
+        Limbs t;
+        for (size_t off = 0; off < n; off += m) {
+            size_t len = std::min(m, n - off);
+            t.assign(len + m, 0);
+            mulInto(a + off, len, b, m, t.data());
+            addAt(r + off, n + m - off, t.data(), t.size());
+        }
+        return;
+    }
+    // a = a1 B^h + a0, b = b1 B^h + b0
+    // z0 = a0 b0 和 z2 = a1 b1 直接落在 r 的低半和高半，中间项 (a0+a1)(b0+b1) - z0 - z2 再加到 B^h 处
+    mulInto(a, h, b, h, r);
+    mulInto(a + h, n - h, b + h, m - h, r + 2 * h);
+    Limbs sa = addSpans(a, h, a + h, n - h);
+    Limbs sb = addSpans(b, h, b + h, m - h);
+    Limbs z1(sa.size() + sb.size(), 0);
+    mulInto(sa.data(), sa.size(), sb.data(), sb.size(), z1.data());
+    subAt(z1.data(), z1.size(), r, 2 * h);
+    subAt(z1.data(), z1.size(), r + 2 * h, n + m - 2 * h);
+    trim(z1);
+    addAt(r + h, n + m - h, z1.data(), z1.size());
+}
+
+static Limbs mulMag(const Limbs &a, const Limbs &b) {
+    if (a.empty() || b.empty()) return Limbs();
+    Limbs r(a.size() + b.size(), 0);
+    mulInto(a.data(), a.size(), b.data(), b.size(), r.data());
+    trim(r);
+    return r;
+}
+
+// a /= d，返回余数
+static uint32_t divSmall(Limbs &a, uint32_t d) {
+    uint64_t rem = 0;
+    for (size_t i = a.size(); i-- > 0;) {
+        uint64_t cur = (rem << 32) | a[i];
+        a[i] = (uint32_t)(cur / d);
+        rem = cur % d;
+    }
+    trim(a);
+    return (uint32_t)rem;
+}
+
+// a = a * m + add
+static void mulAddSmall(Limbs &a, uint32_t m, uint32_t add) {
+    uint64_t carry = add;
+    for (size_t i = 0; i < a.size(); i++) {
+        carry += (uint64_t)a[i] * m;
+        a[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry) a.push_back((uint32_t)carry);
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1, Algorithm D；v 非空
+static void divModMag(const Limbs &u, const Limbs &v, Limbs &q, Limbs &r) {
+    if (cmpMag(u, v) < 0) {
+        q.clear();
+        r = u;
+        return;
+    }
+    if (v.size() == 1) {
+        q = u;
+        uint32_t rem = divSmall(q, v[0]);
+        r.clear();
+        if (rem) r.push_back(rem);
+        return;
+    }
+    size_t n = v.size(), m = u.size() - n;
+    int s = __builtin_clz(v.back()); // 左移到除数最高位为 1，估商才准
+    Limbs vn(n), un(u.size() + 1);
+    for (size_t i = n - 1; i > 0; i--)
+        vn[i] = (v[i] << s) | (s ? v[i - 1] >> (32 - s) : 0);
+    vn[0] = v[0] << s;
+    un[u.size()] = s ? u.back() >> (32 - s) : 0;
+    for (size_t i = u.size() - 1; i > 0; i--)
+        un[i] = (u[i] << s) | (s ? u[i - 1] >> (32 - s) : 0);
+    un[0] = u[0] << s;
+
+    q.assign(m + 1, 0);
+    for (size_t j = m + 1; j-- > 0;) {
+        uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+        uint64_t qhat = num / vn[n - 1], rhat = num % vn[n - 1];
+        while (qhat >> 32 || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+            qhat--;
+            rhat += vn[n - 1];
+            if (rhat >> 32) break;
+        }
+        // un[j, j+n] -= qhat * vn
+        int64_t k = 0, t;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t p = qhat * vn[i];
+            t = (int64_t)un[i + j] - k - (int64_t)(p & 0xffffffffu);
+            un[i + j] = (uint32_t)t;
+            k = (int64_t)(p >> 32) - (t >> 32);
+        }
+        t = (int64_t)un[j + n] - k;
+        un[j + n] = (uint32_t)t;
+        q[j] = (uint32_t)qhat;
+        if (t < 0) { // qhat 估大了一，加回一个除数
+            q[j]--;
+            uint64_t c = 0;
+            for (size_t i = 0; i < n; i++) {
+                c += (uint64_t)un[i + j] + vn[i];
+                un[i + j] = (uint32_t)c;
+                c >>= 32;
+            }
+            un[j + n] += (uint32_t)c;
+        }
+    }
+    trim(q);
+    r.assign(n, 0);
+    for (size_t i = 0; i < n; i++)
+        r[i] = (un[i] >> s) | (s ? un[i + 1] << (32 - s) : 0);
+    trim(r);
+}
+
+static void appendMagnitude(std::string &out, bool neg, Limbs a) {
+    std::vector<uint32_t> chunks; // 低位在前的 10^9 进制
+    while (!a.empty()) chunks.push_back(divSmall(a, DEC_CHUNK));
+    if (chunks.empty()) {
+        out += '0';
+        return;
+    }
+    if (neg) out += '-';
+    out += std::to_string(chunks.back());
+    for (size_t i = chunks.size() - 1; i-- > 0;) {
+        char digits[DEC_CHUNK_DIGITS];
+        uint32_t c = chunks[i];
+        for (int d = DEC_CHUNK_DIGITS; d-- > 0; c /= 10) digits[d] = char('0' + c % 10);
+        out.append(digits, DEC_CHUNK_DIGITS);
+    }
+}
+
+// ============================================================================
+// Values
+// ============================================================================
+
+// 运算中间的临时 limb 不算，只有成了值的才记进 live_bytes
+BigInt::BigInt(bool neg, std::vector<uint32_t> &&mag) : ValueBase(V_BIGINT), negative(neg), limbs(std::move(mag)) {
+    heapCharge(limbs.capacity() * sizeof(uint32_t));
+}
+
+BigInt::~BigInt() {
+    heapRelease(limbs.capacity() * sizeof(uint32_t));
+}
+
+void BigInt::show(std::ostream &os) {
+    std::string s;
+    appendMagnitude(s, negative, limbs);
+    os << s;
+}
+
+/**
+ * @brief Sign and magnitude view of an integer Value
+ *
+ * Bignums are read in place; a fixnum's magnitude is kept in `small`.
+ */
+struct Mag {
+    bool neg;
+    const Limbs *limbs;
+    Limbs small;
+    explicit Mag(const Value &v) {
+        if (v.type() == V_INT) {
+            int n = v.asInt();
+            neg = n < 0;
+            uint32_t u = neg ? 0u - (uint32_t)n : (uint32_t)n;
+            if (u) small.push_back(u);
+            limbs = &small;
+        } else {
+            BigInt *b = v.as<BigInt>();
+            neg = b->negative;
+            limbs = &b->limbs;
+        }
+    }
+    Mag(const Mag &) = delete;
+    const Limbs &operator*() const { return *limbs; }
+};
+
+// 统一出口：能放进 fixnum 的都退回 fixnum
+static Value fromMag(bool neg, Limbs &&m) {
+    trim(m);
+    if (m.empty()) return IntegerV(0);
+    if (m.size() == 1) {
+        if (!neg && m[0] <= (uint32_t)INT_MAX) return IntegerV((int)m[0]);
+        if (neg && m[0] <= (uint32_t)INT_MAX + 1u) return IntegerV((int)(-(int64_t)m[0]));
+    }
+    return Value(poolNew<BigInt>(neg, std::move(m)));
+}
+
+Value integerFromLimbs(bool negative, std::vector<uint32_t> &&limbs) {
+    return fromMag(negative, std::move(limbs));
+}
+
+Value integerV(long long x) {
+    if (INT_MIN <= x && x <= INT_MAX) return IntegerV((int)x);
+    unsigned long long u = x < 0 ? 0ull - (unsigned long long)x : (unsigned long long)x;
+    return fromMag(x < 0, Limbs{(uint32_t)u, (uint32_t)(u >> 32)});
+}
+
+static Value addSigned(bool an, const Limbs &a, bool bn, const Limbs &b) {
+    if (an == bn) return fromMag(an, addMag(a, b));
+    int c = cmpMag(a, b);
+    if (c == 0) return IntegerV(0);
+    return c > 0 ? fromMag(an, subMag(a, b)) : fromMag(bn, subMag(b, a));
+}
+
+Value intAdd(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return integerV((long long)a.asInt() + b.asInt());
+    Mag x(a), y(b);
+    return addSigned(x.neg, *x, y.neg, *y);
+}
+
+Value intSub(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return integerV((long long)a.asInt() - b.asInt());
+    Mag x(a), y(b);
+    return addSigned(x.neg, *x, !y.neg, *y);
+}
+
+Value intMul(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return integerV((long long)a.asInt() * b.asInt());
+    Mag x(a), y(b);
+    return fromMag(x.neg != y.neg, mulMag(*x, *y));
+}
+
+Value intNeg(const Value &a) {
+    if (a.type() == V_INT) return integerV(-(long long)a.asInt());
+    BigInt *b = a.as<BigInt>();
+    return fromMag(!b->negative, Limbs(b->limbs));
+}
+
+Value intQuotient(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return integerV((long long)a.asInt() / b.asInt());
+    Mag x(a), y(b);
+    Limbs q, r;
+    divModMag(*x, *y, q, r);
+    return fromMag(x.neg != y.neg, std::move(q));
+}
+
+Value intRemainder(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return integerV((long long)a.asInt() % b.asInt());
+    Mag x(a), y(b);
+    Limbs q, r;
+    divModMag(*x, *y, q, r);
+    return fromMag(x.neg, std::move(r));
+}
+
+// Stein 的二进制 gcd：只有移位和减法，比 Euclid 的除法便宜
+static uint64_t binaryGcd(uint64_t a, uint64_t b) {
+    if (a == 0) return b;
+    if (b == 0) return a;
+    int shift = __builtin_ctzll(a | b);
+    a >>= __builtin_ctzll(a);
+    do {
+        b >>= __builtin_ctzll(b);
+        if (a > b) std::swap(a, b);
+        b -= a;
+    } while (b);
+    return a << shift;
+}
+
+static uint64_t toU64(const Limbs &a) { // 调用方保证最多两个 limb
+    return (a.size() > 0 ? a[0] : 0) | (a.size() > 1 ? (uint64_t)a[1] << 32 : 0);
+}
+
+Value intGcd(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) {
+        uint64_t g = binaryGcd((uint64_t)std::llabs(a.asInt()), (uint64_t)std::llabs(b.asInt()));
+        return integerV((long long)g);
+    }
+    // 大数先做 Euclid 步，把较小的一个降到 64 位以内，剩下的交给二进制 gcd
+    Mag x(a), y(b);
+    Limbs u = *x, v = *y, q, r;
+    if (cmpMag(u, v) < 0) u.swap(v);
+    while (v.size() > 2) {
+        divModMag(u, v, q, r);
+        u.swap(v);
+        v.swap(r);
+    }
+    if (v.empty()) return fromMag(false, std::move(u));
+    if (u.size() > 2) {
+        divModMag(u, v, q, r);
+        u.swap(r);
+    }
+    uint64_t g = binaryGcd(toU64(u), toU64(v));
+    return fromMag(false, Limbs{(uint32_t)g, (uint32_t)(g >> 32)});
+}
+
+Value intPow(const Value &base, unsigned e) {
+    Value result = IntegerV(1), b = base;
+    while (true) {
+        if (e & 1) result = intMul(result, b);
+        e >>= 1;
+        if (!e) return result;
+        b = intMul(b, b);
+    }
+}
+
+int intSign(const Value &a) {
+    if (a.type() == V_INT) return (a.asInt() > 0) - (a.asInt() < 0);
+    return a.as<BigInt>()->negative ? -1 : 1;
+}
+
+int intCompare(const Value &a, const Value &b) {
+    if (a.type() == V_INT && b.type() == V_INT) return (a.asInt() > b.asInt()) - (a.asInt() < b.asInt());
+    int sa = intSign(a), sb = intSign(b);
+    if (sa != sb) return sa < sb ? -1 : 1;
+    Mag x(a), y(b);
+    int c = cmpMag(*x, *y);
+    return sa < 0 ? -c : c;
+}
+
+Value integerFromDecimal(const char *p, size_t len) {
+    const char *e = p + len;
+    bool neg = false;
+    if (p < e && (*p == '+' || *p == '-')) {
+        neg = *p == '-';
+        p++;
+    }
+    Limbs mag;
+    while (p < e) { // 每次吃进最多 9 位
+        uint32_t chunk = 0, scale = 1;
+        for (int d = 0; d < DEC_CHUNK_DIGITS && p < e; d++, p++) {
+            chunk = chunk * 10 + (*p - '0');
+            scale *= 10;
+        }
+        mulAddSmall(mag, scale, chunk);
+    }
+    return fromMag(neg, std::move(mag));
+}
+
+void appendDecimal(std::string &out, const Value &v) {
+    if (v.type() == V_INT) {
+        out += std::to_string(v.asInt());
+        return;
+    }
+    BigInt *b = v.as<BigInt>();
+    appendMagnitude(out, b->negative, b->limbs);
+}
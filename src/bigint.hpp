@@ -0,0 +1,48 @@
+#ifndef BIGINT_HPP
+#define BIGINT_HPP
+
+/**
+ * @file bigint.hpp
+ * @brief Exact integer arithmetic across fixnums and bignums
+ *
+ * Integers are fixnums (immediate V_INT) as long as they fit in an int and
+ * BigInt heap objects otherwise. Every operation here accepts either kind
+ * and returns a fixnum whenever the result fits, so code that sees a
+ * V_BIGINT knows the value is really out of fixnum range. The fixnum
+ * cases are checked with the compiler's overflow builtins and only fall
+ * into the limb code when they overflow.
+ */
+
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// An exact integer: a fixnum or a bignum
+inline bool isInteger(const Value &v) {
+    return v.type() == V_INT || v.type() == V_BIGINT;
+}
+
+/// 1, the denominator of every integer
+inline bool isOne(const Value &v) {
+    return v.type() == V_INT && v.asInt() == 1;
+}
+
+Value integerV(long long);            ///< Fixnum when it fits, bignum otherwise
+Value integerFromLimbs(bool negative, std::vector<uint32_t> &&); ///< Any magnitude, normalized
+Value intAdd(const Value &, const Value &);
+Value intSub(const Value &, const Value &);
+Value intMul(const Value &, const Value &);
+Value intNeg(const Value &);
+Value intQuotient(const Value &, const Value &);   ///< Truncates toward zero; divisor must not be 0
+Value intRemainder(const Value &, const Value &);  ///< Sign of the dividend, like C's %
+Value intGcd(const Value &, const Value &);        ///< Non-negative
+Value intPow(const Value &, unsigned);
+int intCompare(const Value &, const Value &);      ///< -1, 0 or 1
+int intSign(const Value &);                        ///< -1, 0 or 1
+
+/// Decimal digits with an optional sign, as accepted by the reader
+Value integerFromDecimal(const char *, size_t);
+void appendDecimal(std::string &, const Value &);
+
+#endif // BIGINT_HPP
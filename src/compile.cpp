@@ -0,0 +1,246 @@
+/**
+ * @file compile.cpp
+ * @brief Lowering of resolved Expr trees into bytecode
+ *
+ * Every compile() call leaves exactly one value on the stack; in tail
+ * position it instead ends the code path with OP_RETURN or OP_TAIL_CALL.
+ * Literals, including quoted data and strings, become constants; nodes
+ * without a dedicated instruction sequence (such as exit) are kept as
+ * OP_EVAL and tree-walked in place.
+ */
+
+#include "vm.hpp"
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <memory>
+#include <vector>
+
+struct Compiler {
+    Code &c;
+    Compiler(Code &c) : c(c) {}
+
+    void emit(int op) { c.ops.push_back(op); }
+    void emit(int op, int a) { c.ops.push_back(op); c.ops.push_back(a); }
+    void emit(int op, int a, int b) { c.ops.push_back(op); c.ops.push_back(a); c.ops.push_back(b); }
+
+    int node(const Expr &e) {
+        c.nodes.push_back(e);
+        return (int)c.nodes.size() - 1;
+    }
+
+    int constant(const Value &v) {
+        c.consts.push_back(v);
+        return (int)c.consts.size() - 1;
+    }
+
+    int cell(Value *p) { // 同一个全局在一段代码里只占一项
+        for (int i = 0; i < (int)c.cells.size(); i++) {
+            if (c.cells[i] == p) return i;
+        }
+        c.cells.push_back(p);
+        return (int)c.cells.size() - 1;
+    }
+
+    // 先发一个目标待定的跳转，返回要回填的位置
+    int jump(int op) {
+        emit(op, -1);
+        return (int)c.ops.size() - 1;
+    }
+
+    void patch(int at) { c.ops[at] = (int)c.ops.size(); }
+
+    void ret(bool tail) {
+        if (tail) emit(OP_RETURN);
+    }
+
+    // begin 的语义：空序列是 #<void>，只有最后一个在尾位置
+    void sequence(const std::vector<Expr> &es, size_t from, bool tail) {
+        if (from >= es.size()) {
+            emit(OP_CONST, constant(VoidV()));
+            ret(tail);
+            return;
+        }
+        for (size_t i = from; i + 1 < es.size(); i++) {
+            compile(es[i], false);
+            emit(OP_POP);
+        }
+        compile(es.back(), tail);
+    }
+
+    void compile(const Expr &e, bool tail) {
+        switch (e->e_type) {
+            case E_FIXNUM:
+                emit(OP_CONST, constant(IntegerV(static_cast<Fixnum *>(e.get())->n)));
+                return ret(tail);
+            case E_RATIONAL:
+            case E_BIGNUM:
+            case E_STRING: { // 字面量只转换一次，之后每次求值都是同一个常量
+                Assoc none = empty();
+                emit(OP_CONST, constant(e->eval(none)));
+                return ret(tail);
+            }
+            case E_QUOTE: {
+                Quote *q = static_cast<Quote *>(e.get());
+                if (!q->datum) break; // 写错的 datum：留给 OP_EVAL，运行到这里时报错
+                emit(OP_CONST, constant(*q->datum));
+                return ret(tail);
+            }
+            case E_TRUE:
+                emit(OP_CONST, constant(BooleanV(true)));
+                return ret(tail);
+            case E_FALSE:
+                emit(OP_CONST, constant(BooleanV(false)));
+                return ret(tail);
+            case E_VOID:
+                emit(OP_CONST, constant(VoidV()));
+                return ret(tail);
+            case E_VAR: {
+                Var *v = static_cast<Var *>(e.get());
+                if (v->depth == 0) emit(OP_LOCAL0, v->slot);
+                else if (v->depth > 0) emit(OP_LOCAL, v->depth, v->slot);
+                else emit(OP_GLOBAL, cell(v->cell));
+                return ret(tail);
+            }
+            case E_SET: {
+                Set *s = static_cast<Set *>(e.get());
+                compile(s->e, false);
+                if (s->depth >= 0) emit(OP_SET_LOCAL, s->depth, s->slot);
+                else emit(OP_SET_GLOBAL, cell(s->cell), node(e));
+                return ret(tail);
+            }
+            case E_DEFINE: {
+                Define *d = static_cast<Define *>(e.get());
+                int k = cell(d->cell);
+                emit(OP_DEFINE_BEGIN, k);
+                compile(d->e, false);
+                emit(OP_DEFINE, k);
+                return ret(tail);
+            }
+            case E_BEGIN:
+                return sequence(static_cast<Begin *>(e.get())->es, 0, tail);
+            case E_IF: {
+                If *x = static_cast<If *>(e.get());
+                compile(x->cond, false);
+                int to_alter = jump(OP_JUMP_IF_FALSE);
+                compile(x->conseq, tail);
+                int to_end = tail ? -1 : jump(OP_JUMP);
+                patch(to_alter);
+                compile(x->alter, tail);
+                if (!tail) patch(to_end);
+                return;
+            }
+            case E_COND: {
+                Cond *x = static_cast<Cond *>(e.get());
+                std::vector<int> to_end;
+                for (auto &clause : x->clauses) {
+                    compile(clause[0], false);
+                    if (clause.size() == 1) { // 没有分支体时测试值本身就是结果
+                        to_end.push_back(jump(OP_JUMP_IF_TRUE_KEEP));
+                        continue;
+                    }
+                    int to_next = jump(OP_JUMP_IF_FALSE);
+                    sequence(clause, 1, tail);
+                    if (!tail) to_end.push_back(jump(OP_JUMP));
+                    patch(to_next);
+                }
+                emit(OP_CONST, constant(VoidV()));
+                for (int at : to_end) patch(at);
+                return ret(tail);
+            }
+            case E_AND:
+            case E_OR: {
+                const std::vector<Expr> &rands = e->e_type == E_AND
+                    ? static_cast<AndVar *>(e.get())->rands : static_cast<OrVar *>(e.get())->rands;
+                if (rands.empty()) {
+                    emit(OP_CONST, constant(BooleanV(e->e_type == E_AND)));
+                    return ret(tail);
+                }
+                std::vector<int> to_end;
+                for (size_t i = 0; i + 1 < rands.size(); i++) {
+                    compile(rands[i], false);
+                    to_end.push_back(jump(e->e_type == E_AND ? OP_JUMP_IF_FALSE_KEEP : OP_JUMP_IF_TRUE_KEEP));
+                }
+                compile(rands.back(), tail);
+                for (int at : to_end) patch(at);
+                if (!to_end.empty()) ret(tail); // 短路跳过来的值也要返回
+                return;
+            }
+            case E_LAMBDA:
+                compileLambda(static_cast<Lambda *>(e.get())); // 现在就编译：运行时 Lambda::code 只读，多个线程可以同时建闭包
+                emit(OP_CLOSURE, node(e));
+                return ret(tail);
+            case E_LET: {
+                Let *x = static_cast<Let *>(e.get());
+                for (auto &p : x->bind) compile(p.second, false); // 初值在外层 frame 里求
+                emit(OP_MAKE_FRAME, (int)x->bind.size());
+                compile(x->body, tail);
+                if (!tail) emit(OP_POP_FRAME);
+                return;
+            }
+            case E_LETREC: {
+                Letrec *x = static_cast<Letrec *>(e.get());
+                emit(OP_EMPTY_FRAME, (int)x->bind.size());
+                for (auto &p : x->bind) compile(p.second, false);
+                for (int i = (int)x->bind.size() - 1; i >= 0; i--) emit(OP_STORE_LOCAL0, i); // 全部求完值再一起绑定
+                compile(x->body, tail);
+                if (!tail) emit(OP_POP_FRAME);
+                return;
+            }
+            case E_APPLY: {
+                Apply *x = static_cast<Apply *>(e.get());
+                compile(x->rator, false);
+                emit(OP_CHECK_PROC); // 和 tree-walker 一样，先确认能调用再求实参
+                for (auto &r : x->rand) compile(r, false);
+                emit(tail ? OP_TAIL_CALL : OP_CALL, (int)x->rand.size());
+                return;
+            }
+            default:
+                break;
+        }
+        if (Unary *u = dynamic_cast<Unary *>(e.get())) {
+            compile(u->rand, false);
+            switch (e->e_type) {
+                case E_CAR: emit(OP_CAR, node(e)); break;
+                case E_CDR: emit(OP_CDR, node(e)); break;
+                case E_NOT: emit(OP_NOT); break;
+                case E_NULLQ: emit(OP_NULLQ); break;
+                case E_PAIRQ: emit(OP_PAIRQ); break;
+                default: emit(OP_UNARY, node(e));
+            }
+        } else if (Binary *b = dynamic_cast<Binary *>(e.get())) {
+            compile(b->rand1, false);
+            compile(b->rand2, false);
+            switch (e->e_type) {
+                case E_PLUS: emit(OP_ADD, node(e)); break;
+                case E_MINUS: emit(OP_SUB, node(e)); break;
+                case E_MUL: emit(OP_MUL, node(e)); break;
+                case E_LT: emit(OP_LT, node(e)); break;
+                case E_LE: emit(OP_LE, node(e)); break;
+                case E_EQ: emit(OP_NUM_EQ, node(e)); break;
+                case E_GE: emit(OP_GE, node(e)); break;
+                case E_GT: emit(OP_GT, node(e)); break;
+                case E_CONS: emit(OP_CONS); break;
+                case E_STREAMFILTER: emit(OP_STREAM_FILTER, node(e)); break;
+                default: emit(OP_BINARY, node(e));
+            }
+        } else if (Variadic *v = dynamic_cast<Variadic *>(e.get())) {
+            for (auto &r : v->rands) compile(r, false);
+            emit(OP_VARIADIC, node(e), (int)v->rands.size());
+        } else {
+            emit(OP_EVAL, node(e));
+        }
+        ret(tail);
+    }
+};
+
+std::shared_ptr<Code> compileCode(const Expr &e) {
+    std::shared_ptr<Code> code = std::make_shared<Code>();
+    Compiler(*code).compile(e, true);
+    return code;
+}
+
+std::shared_ptr<Code> compileLambda(Lambda *lambda) {
+    if (!lambda->code) lambda->code = compileCode(lambda->e);
+    return lambda->code;
+}
@@ -13,70 +13,206 @@
 #include "expr.hpp" 
 #include "RE.hpp"
 #include "syntax.hpp"
+#include "bigint.hpp"
+#include "hashtable.hpp"
+#include "limits.hpp"
+#include "memo.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "stream.hpp"
+#include "strings.hpp"
 #include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <numeric>
 #include <ostream>
-#include <set>
 #include <utility>
 #include <vector>
 #include <map>
 #include <climits>
+#include <new>
 #include <string>
+#include <type_traits>
 
-extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
-static int gcd(int a, int b) {
-    while (b != 0) {
-        int temp = b;
-        b = a % b;
-        a = temp;
-    }
-    return a;
-}
-
-static std::map<ExprType, std::pair<Expr, std::vector<std::string>>> primitive_map = {
-    {E_VOID,     {new MakeVoid(), {}}},
-    {E_EXIT,     {new Exit(), {}}},
-    {E_BOOLQ,    {new IsBoolean(new Var("parm")), {"parm"}}},
-    {E_INTQ,     {new IsFixnum(new Var("parm")), {"parm"}}},
-    {E_NULLQ,    {new IsNull(new Var("parm")), {"parm"}}},
-    {E_PAIRQ,    {new IsPair(new Var("parm")), {"parm"}}},
-    {E_PROCQ,    {new IsProcedure(new Var("parm")), {"parm"}}},
-    {E_SYMBOLQ,  {new IsSymbol(new Var("parm")), {"parm"}}},
-    {E_STRINGQ,  {new IsString(new Var("parm")), {"parm"}}},
-    {E_GE, {new GreaterEqVar({}), {"@args"}}},
-    {E_EQ, {new EqualVar({}), {"@args"}}},
-    {E_LE, {new LessEqVar({}), {"@args"}}},
-    {E_GT, {new GreaterVar({}), {"@args"}}},
-    {E_LT, {new LessVar({}), {"@args"}}},
-    {E_CONS, {new Cons(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-    {E_CAR, {new Car(new Var("parm")), {"parm"}}},
-    {E_CDR, {new Cdr(new Var("parm")), {"parm"}}},
-    {E_NOT, {new Not(new Var("parm")), {"parm"}}},
-    {E_DISPLAY,  {new Display(new Var("parm")), {"parm"}}},
-    {E_PLUS,     {new PlusVar({}),  {"@args"}}}, // 只要 plus 就都是E_plus，但是就需要考虑这是对谁的
-    {E_MINUS,    {new MinusVar({}), {"@args"}}},
-    {E_MUL,      {new MultVar({}),  {"@args"}}},
-    {E_DIV,      {new DivVar({}),   {"@args"}}},
-    
-    {E_MODULO,   {new Modulo(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-    {E_EXPT,     {new Expt(new Var("parm1"), new Var("parm2")), {"parm1","parm2"}}},
-    {E_EQQ,      {new EqualVar({}), {}}},
+// 字面量文本 "n" 或 "n/d" 转成数，只有超出 int 范围的字面量走这里
+static Value numberLiteral(const std::string &s) {
+    size_t slash = s.find('/');
+    if (slash == std::string::npos) return integerFromDecimal(s.data(), s.size());
+    return RationalV(integerFromDecimal(s.data(), slash),
+                     integerFromDecimal(s.data() + slash + 1, s.size() - slash - 1));
+}
+
+/**
+ * @brief Arguments of a primitive call, kept on the C++ stack when few
+ *
+ * The number of operands is known before any of them is evaluated, so up to
+ * INLINE values are constructed in place and only longer calls reserve a
+ * vector once. Either way data() is contiguous, which is what Variadic and
+ * PrimFn take.
+ */
+class ArgBuffer {
+public:
+    explicit ArgBuffer(size_t capacity) : n(0), heap(capacity > INLINE) {
+        if (heap) spill.reserve(capacity);
+    }
+    ~ArgBuffer() {
+        if (!heap) for (int i = 0; i < n; i++) inlineData()[i].~Value();
+    }
+    ArgBuffer(const ArgBuffer &) = delete;
+    ArgBuffer &operator=(const ArgBuffer &) = delete;
+    void push(Value &&v) {
+        if (heap) spill.push_back(std::move(v));
+        else new (inlineData() + n) Value(std::move(v));
+        n++;
+    }
+    const Value *data() { return heap ? spill.data() : inlineData(); }
+    int size() const { return n; }
+
+private:
+    static const int INLINE = 8;
+    typename std::aligned_storage<sizeof(Value), alignof(Value)>::type slots[INLINE];
+    std::vector<Value> spill;
+    int n;
+    bool heap;
+    Value *inlineData() { return reinterpret_cast<Value *>(slots); }
+};
+
+// ============================================================================
+// Primitive procedures as first-class values
+// ============================================================================
+
+// 复用各个表达式节点的 evalRator：每个模板实例里放一个不带操作数的节点
+template <typename Op>
+static Value unaryPrim(const Value *args, int) {
+    static Op op((Expr(nullptr)));
+    return op.evalRator(args[0]);
+}
+
+template <typename Op>
+static Value binaryPrim(const Value *args, int) {
+    static Op op((Expr(nullptr)), (Expr(nullptr)));
+    return op.evalRator(args[0], args[1]);
+}
+
+template <typename Op>
+static Value variadicPrim(const Value *args, int argc) {
+    static Op op((std::vector<Expr>()));
+    return op.evalRator(args, argc);
+}
+
+static Value voidPrim(const Value *, int) {
+    return VoidV();
+}
+
+static Value exitPrim(const Value *, int) {
+    return TerminateV();
+}
+
+// 启动时每个内建过程建一个 Primitive，之后所有引用共享（and / or 是特殊形式，不在这里）
+static std::map<ExprType, Value> primitive_values = {
+    {E_VOID,     PrimitiveV(voidPrim, 0)},
+    {E_EXIT,     PrimitiveV(exitPrim, 0)},
+    {E_BOOLQ,    PrimitiveV(unaryPrim<IsBoolean>, 1)},
+    {E_INTQ,     PrimitiveV(unaryPrim<IsFixnum>, 1)},
+    {E_NULLQ,    PrimitiveV(unaryPrim<IsNull>, 1)},
+    {E_PAIRQ,    PrimitiveV(unaryPrim<IsPair>, 1)},
+    {E_PROCQ,    PrimitiveV(unaryPrim<IsProcedure>, 1)},
+    {E_SYMBOLQ,  PrimitiveV(unaryPrim<IsSymbol>, 1)},
+    {E_STRINGQ,  PrimitiveV(unaryPrim<IsString>, 1)},
+    {E_LISTQ,    PrimitiveV(unaryPrim<IsList>, 1)},
+    {E_GE,       PrimitiveV(variadicPrim<GreaterEqVar>, -1)},
+    {E_EQ,       PrimitiveV(variadicPrim<EqualVar>, -1)},
+    {E_LE,       PrimitiveV(variadicPrim<LessEqVar>, -1)},
+    {E_GT,       PrimitiveV(variadicPrim<GreaterVar>, -1)},
+    {E_LT,       PrimitiveV(variadicPrim<LessVar>, -1)},
+    {E_CONS,     PrimitiveV(binaryPrim<Cons>, 2)},
+    {E_CAR,      PrimitiveV(unaryPrim<Car>, 1)},
+    {E_CDR,      PrimitiveV(unaryPrim<Cdr>, 1)},
+    {E_LIST,     PrimitiveV(variadicPrim<ListFunc>, -1)},
+    {E_SETCAR,   PrimitiveV(binaryPrim<SetCar>, 2)},
+    {E_SETCDR,   PrimitiveV(binaryPrim<SetCdr>, 2)},
+    {E_MAKEVECTOR,   PrimitiveV(variadicPrim<MakeVector>, -1)},
+    {E_VECTOR,       PrimitiveV(variadicPrim<VectorFunc>, -1)},
+    {E_VECTORREF,    PrimitiveV(binaryPrim<VectorRef>, 2)},
+    {E_VECTORSET,    PrimitiveV(variadicPrim<VectorSet>, 3)},
+    {E_VECTORLENGTH, PrimitiveV(unaryPrim<VectorLength>, 1)},
+    {E_VECTORFILL,   PrimitiveV(binaryPrim<VectorFill>, 2)},
+    {E_LIST2VECTOR,  PrimitiveV(unaryPrim<ListToVector>, 1)},
+    {E_VECTOR2LIST,  PrimitiveV(unaryPrim<VectorToList>, 1)},
+    {E_VECTORQ,      PrimitiveV(unaryPrim<IsVector>, 1)},
+    {E_MAKEHASH,     PrimitiveV(variadicPrim<MakeHashTable>, -1)},
+    {E_HASHREF,      PrimitiveV(variadicPrim<HashTableRef>, -1)},
+    {E_HASHSET,      PrimitiveV(variadicPrim<HashTableSet>, 3)},
+    {E_HASHDELETE,   PrimitiveV(binaryPrim<HashTableDelete>, 2)},
+    {E_HASHCONTAINS, PrimitiveV(binaryPrim<HashTableContains>, 2)},
+    {E_HASHCOUNT,    PrimitiveV(unaryPrim<HashTableCount>, 1)},
+    {E_HASHKEYS,     PrimitiveV(unaryPrim<HashTableKeys>, 1)},
+    {E_HASHVALUES,   PrimitiveV(unaryPrim<HashTableValues>, 1)},
+    {E_HASH2ALIST,   PrimitiveV(unaryPrim<HashTableToAlist>, 1)},
+    {E_HASHTABLEQ,   PrimitiveV(unaryPrim<IsHashTable>, 1)},
+    {E_NOT,      PrimitiveV(unaryPrim<Not>, 1)},
+    {E_FUTURE,       PrimitiveV(unaryPrim<FutureFunc>, 1)},
+    {E_TOUCH,        PrimitiveV(unaryPrim<Touch>, 1)},
+    {E_PARALLELMAP,  PrimitiveV(binaryPrim<ParallelMap>, 2)},
+    {E_MEMOIZE,      PrimitiveV(variadicPrim<Memoize>, -1)},
+    {E_FORCE,         PrimitiveV(unaryPrim<Force>, 1)},
+    {E_MAKEPROMISE,   PrimitiveV(unaryPrim<MakePromise>, 1)},
+    {E_PROMISEQ,      PrimitiveV(unaryPrim<IsPromise>, 1)},
+    {E_STREAMCAR,     PrimitiveV(unaryPrim<StreamCar>, 1)},
+    {E_STREAMCDR,     PrimitiveV(unaryPrim<StreamCdr>, 1)},
+    {E_STREAMMAP,     PrimitiveV(binaryPrim<StreamMap>, 2)},
+    {E_STREAMFILTER,  PrimitiveV(binaryPrim<StreamFilter>, 2)},
+    {E_STREAMTAKE,    PrimitiveV(binaryPrim<StreamTake>, 2)},
+    {E_STREAM2LIST,   PrimitiveV(variadicPrim<StreamToList>, -1)},
+    {E_STRINGLENGTH,  PrimitiveV(unaryPrim<StringLength>, 1)},
+    {E_STRINGAPPEND,  PrimitiveV(variadicPrim<StringAppend>, -1)},
+    {E_SUBSTRING,     PrimitiveV(variadicPrim<Substring>, -1)},
+    {E_STRINGEQ,      PrimitiveV(binaryPrim<StringEq>, 2)},
+    {E_STRINGLT,      PrimitiveV(binaryPrim<StringLess>, 2)},
+    {E_STRING2SYMBOL, PrimitiveV(unaryPrim<StringToSymbol>, 1)},
+    {E_SYMBOL2STRING, PrimitiveV(unaryPrim<SymbolToString>, 1)},
+    {E_NUMBER2STRING, PrimitiveV(unaryPrim<NumberToString>, 1)},
+    {E_STRING2NUMBER, PrimitiveV(unaryPrim<StringToNumber>, 1)},
+    {E_DISPLAY,  PrimitiveV(variadicPrim<Display>, -1)},
+    {E_WRITESTRING,       PrimitiveV(variadicPrim<WriteString>, -1)},
+    {E_OPENOUTPUTSTRING,  PrimitiveV(variadicPrim<OpenOutputString>, 0)},
+    {E_GETOUTPUTSTRING,   PrimitiveV(unaryPrim<GetOutputString>, 1)},
+    {E_RUNTIMESTATS,      PrimitiveV(variadicPrim<RuntimeStats>, 0)},
+    {E_PLUS,     PrimitiveV(variadicPrim<PlusVar>, -1)},
+    {E_MINUS,    PrimitiveV(variadicPrim<MinusVar>, -1)},
+    {E_MUL,      PrimitiveV(variadicPrim<MultVar>, -1)},
+    {E_DIV,      PrimitiveV(variadicPrim<DivVar>, -1)},
+    {E_MODULO,   PrimitiveV(binaryPrim<Modulo>, 2)},
+    {E_EXPT,     PrimitiveV(binaryPrim<Expt>, 2)},
+    {E_EQQ,      PrimitiveV(binaryPrim<IsEq>, 2)},
+    {E_EQUALQ,   PrimitiveV(binaryPrim<IsEqual>, 2)},
 };
 
+Value primitiveValue(ExprType et) {
+    auto it = primitive_values.find(et);
+    return it == primitive_values.end() ? Value(nullptr) : it->second;
+}
+
 Value Fixnum::eval(Assoc &e) { // evaluation of a fixnum
     return IntegerV(n);
 }
 
 Value RationalNum::eval(Assoc &e) { // evaluation of a rational number
-    return RationalV(numerator, denominator);
+    return ReducedRationalV(IntegerV(numerator), IntegerV(denominator)); // 构造时已约分
+}
+
+Value Bignum::eval(Assoc &e) { // evaluation of an out-of-range number literal
+    return numberLiteral(s);
+}
+
+std::shared_ptr<Value> stringLiteral(const std::string &s) {
+    return std::make_shared<Value>(StringV(s));
 }
 
 Value StringExpr::eval(Assoc &e) { // evaluation of a string
-    return StringV(s);
+    return *value;
 }
 
 Value True::eval(Assoc &e) { // evaluation of #t
@@ -104,432 +240,307 @@ Value Binary::eval(Assoc &e) { // evaluation of two-operators primitive
 }
 
 Value Variadic::eval(Assoc &e) { // evaluation of multi-operator primitive
-    std::vector<Value> eval_outcome;
-    if (!rands.empty()) {
-        for (int i = 0; i < rands.size(); i++) {
-            eval_outcome.push_back(rands[i]->eval(e));
-        }
-        return evalRator(eval_outcome);
-    }
-    Value arg_list = find("@args", e);
-    if (arg_list.get() == nullptr) {
-        return evalRator(eval_outcome); 
-    }
-    // 找到了 @args，说明是 apply 调用，开始解包
-    Value current = arg_list;
-    while (current->v_type == V_PAIR) {
-        Pair* p = dynamic_cast<Pair*>(current.get());
-        eval_outcome.push_back(p->car);
-        current = p->cdr;
+    ArgBuffer args(rands.size());
+    for (int i = 0; i < rands.size(); i++) {
+        args.push(rands[i]->eval(e));
     }
-    return evalRator(eval_outcome);
+    return evalRator(args.data(), args.size());
 }
 
-// HELPER FUNCTION OF CONVERTING TO NUMBER
-std::pair<bool, std::pair<int, int>> parse_rational(const std::string &s) {
-    int n = s.size();
-    int i = 0;
-    int sign = 1;
-
-    // optional sign
-    if (s[i] == '+') i++;
-    else if (s[i] == '-') sign = -1, i++;
-
-    if (i >= n) return {false, {0,1}};
-
-    // integer part
-    long long int_part = 0;
-    bool has_int = false;
-
-    while (i < n && isdigit(s[i])) {
-        has_int = true;
-        int_part = int_part * 10 + (s[i] - '0');
-        i++;
-    }
+Value Var::eval(Assoc &e) { // evaluation of variable 对多变量的 eval
+    // 变量名的合法性检查和数字识别都已在 SymbolSyntax::parse 中完成，这里只做查找
+    if (depth >= 0) { // 局部变量：沿 frame 链走 depth 步，直接取 slot
+        AssocList *frame = e.get();
+        for (int i = 0; i < depth; i++) frame = frame->next.get();
+        const Value &matched_value = frame->slots[slot];
+        if (!matched_value.bound()) throw RuntimeError("The variable is used before its definition"); // letrec 的占位
+        return matched_value; //已经定义过了的情况
+    }
+    if (cell == nullptr) throw RuntimeError("Unresolved variable: " + x);
+    if (cell->bound()) {
+        return *cell; // 全局变量，内建过程也在这里（见 Var::resolve）
+    }
+    throw RuntimeError("The variable is not define in the scope"); // 环境里也没有，也不是保留字
+}
+
+// 数值塔的类型对：两个 fixnum 走带溢出检查的快路径，其余分成"都是整数"和"有有理数"
+enum NumPair { NUM_II, NUM_INT, NUM_RAT, NUM_BAD };
+
+static inline int numKind(ValueType t) {
+    return t == V_INT ? 0 : t == V_BIGINT ? 1 : t == V_RATIONAL ? 2 : 3;
+}
+
+static inline NumPair numPair(const Value &v1, const Value &v2) {
+    static const NumPair table[4][4] = {
+        {NUM_II, NUM_INT, NUM_RAT, NUM_BAD},
+        {NUM_INT, NUM_INT, NUM_RAT, NUM_BAD},
+        {NUM_RAT, NUM_RAT, NUM_RAT, NUM_BAD},
+        {NUM_BAD, NUM_BAD, NUM_BAD, NUM_BAD},
+    };
+    return table[numKind(v1.type())][numKind(v2.type())];
+}
+
+// 把整数也看成分母为 1 的分数
+struct Fraction {
+    Value n, d;
+    explicit Fraction(const Value &v)
+        : n(v.type() == V_RATIONAL ? v.as<Rational>()->numerator : v),
+          d(v.type() == V_RATIONAL ? v.as<Rational>()->denominator : IntegerV(1)) {}
+    Fraction(const Value &n, const Value &d) : n(n), d(d) {}
+    Value value() const { return ReducedRationalV(n, d); } ///< 分母为 1 时就是整数
+};
 
-    // fractional part
-    long long frac_part = 0;
-    long long frac_den = 1;
-    bool has_frac = false;
+// 两个最简分数的和：Knuth 4.5.1 的交叉约分。g = gcd(b, d) 为 1 时 (ad + cb) / bd 已经最简
+// （整数加分数总是这样），否则约分只可能发生在分子和 g 之间，不必再对整个结果求 gcd
+static Fraction addFractions(const Fraction &x, const Value &c, const Value &d) {
+    const Value &a = x.n, &b = x.d;
+    if (isOne(b) && isOne(d)) return Fraction(intAdd(a, c), d);
+    Value g = isOne(b) || isOne(d) ? IntegerV(1) : intGcd(b, d);
+    if (isOne(g)) return Fraction(intAdd(intMul(a, d), intMul(c, b)), intMul(b, d));
+    Value d_g = intQuotient(d, g);
+    Value t = intAdd(intMul(a, d_g), intMul(c, intQuotient(b, g)));
+    if (intSign(t) == 0) return Fraction(IntegerV(0), IntegerV(1));
+    Value g2 = intGcd(t, g);
+    if (isOne(g2)) return Fraction(t, intMul(b, d_g));
+    return Fraction(intQuotient(t, g2), intMul(intQuotient(b, g), intQuotient(d, g2)));
+}
+
+// 两个最简分数的积：先约掉 a 与 d、c 与 b 的公因子，乘出来就是最简
+static Fraction mulFractions(const Fraction &x, const Fraction &y) {
+    if (isOne(x.d) && isOne(y.d)) return Fraction(intMul(x.n, y.n), x.d);
+    Value g1 = isOne(y.d) ? IntegerV(1) : intGcd(x.n, y.d);
+    Value g2 = isOne(x.d) ? IntegerV(1) : intGcd(y.n, x.d);
+    Value n1 = isOne(g1) ? x.n : intQuotient(x.n, g1), d2 = isOne(g1) ? y.d : intQuotient(y.d, g1);
+    Value n2 = isOne(g2) ? y.n : intQuotient(y.n, g2), d1 = isOne(g2) ? x.d : intQuotient(x.d, g2);
+    return Fraction(intMul(n1, n2), intMul(d1, d2));
+}
+
+// 倒数，符号挪到分子上
+static Fraction reciprocal(const Value &v) {
+    Fraction b(v);
+    int sign = intSign(b.n);
+    if (sign == 0) throw RuntimeError("division with 0");
+    return sign > 0 ? Fraction(b.d, b.n) : Fraction(intNeg(b.d), intNeg(b.n));
+}
 
-    if (i < n && s[i] == '.') {
-        i++;
-        while (i < n && isdigit(s[i])) {
-            has_frac = true;
-            frac_part = frac_part * 10 + (s[i] - '0');
-            frac_den *= 10;
-            i++;
+Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
+    switch (numPair(rand1, rand2)) {
+        case NUM_II: {
+            int r;
+            if (!__builtin_add_overflow(rand1.asInt(), rand2.asInt(), &r)) return IntegerV(r);
+            return intAdd(rand1, rand2); // 溢出才升成 bignum
+        }
+        case NUM_INT:
+            return intAdd(rand1, rand2);
+        case NUM_RAT: {
+            Fraction b(rand2);
+            return addFractions(Fraction(rand1), b.n, b.d).value();
         }
+        default:
+            throw(RuntimeError("Wrong typename"));
     }
+}
 
-    // scientific notation
-    long long exp_val = 0;
-    int exp_sign = 1;
-
-    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
-        i++;
-        if (i < n && (s[i] == '+' || s[i] == '-')) {
-            exp_sign = (s[i] == '-') ? -1 : 1;
-            i++;
+Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
+    switch (numPair(rand1, rand2)) {
+        case NUM_II: {
+            int r;
+            if (!__builtin_sub_overflow(rand1.asInt(), rand2.asInt(), &r)) return IntegerV(r);
+            return intSub(rand1, rand2);
         }
-        if (i >= n || !isdigit(s[i])) return {false, {0,1}};
-        while (i < n && isdigit(s[i])) {
-            exp_val = exp_val * 10 + (s[i] - '0');
-            i++;
+        case NUM_INT:
+            return intSub(rand1, rand2);
+        case NUM_RAT: {
+            Fraction b(rand2);
+            return addFractions(Fraction(rand1), intNeg(b.n), b.d).value();
         }
+        default:
+            throw(RuntimeError("Wrong typename"));
     }
+}
 
-    // no stray characters
-    if (i != n) return {false, {0,1}};
-
-    if (!has_int && !has_frac) return {false, {0,1}};
-
-    // Build rational: (int_part + frac_part/frac_den) * 10^(exp_sign * exp_val)
-    long long num = int_part * frac_den + frac_part;
-    long long den = frac_den;
-
-    // apply exponent
-    long long e = exp_val;
-
-    if (exp_sign == 1) {
-        while (e--) {
-            num *= 10;
-        }
-    } else {
-        while (e--) {
-            den *= 10;
+Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
+    switch (numPair(rand1, rand2)) {
+        case NUM_II: {
+            int r;
+            if (!__builtin_mul_overflow(rand1.asInt(), rand2.asInt(), &r)) return IntegerV(r);
+            return intMul(rand1, rand2);
         }
+        case NUM_INT:
+            return intMul(rand1, rand2);
+        case NUM_RAT:
+            return mulFractions(Fraction(rand1), Fraction(rand2)).value();
+        default:
+            throw(RuntimeError("Wrong typename"));
     }
+}
 
-    num *= sign;
-    int Gcd = gcd(num, den);
-    num /= Gcd;
-    den /= Gcd;
-    if (den < 0) {
-      num = -num;
-      den = -den;
+Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
+    switch (numPair(rand1, rand2)) {
+        case NUM_II:
+        case NUM_INT:
+            if (intSign(rand2) == 0) throw RuntimeError("division with 0");
+            return RationalV(rand1, rand2);
+        case NUM_RAT: // 乘以倒数
+            return mulFractions(Fraction(rand1), reciprocal(rand2)).value();
+        default:
+            throw(RuntimeError("Wrong typename"));
     }
-    
-    return {true, {num, den}};
 }
 
-Value Var::eval(Assoc &e) { // evaluation of variable 对多变量的 eval
-    std::set<char> invalid_first = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', '.', '@'};
-    if (invalid_first.find(x[0]) != invalid_first.end()) throw RuntimeError("the first character of var is invalid");
-    for (int i = 0; i < x.size(); i++) {
-        if (x[i] == '#' || x[i] == '\'' || x[i] == '\"' || x[i] == '`') throw RuntimeError("the var cannot contain invalid char");
-    }
-    // try to convert to number
-    auto try_convert = parse_rational(x);
-    if (try_convert.first) {
-        if (try_convert.second.second == 1) return IntegerV(try_convert.second.first);
-        return RationalV(try_convert.second.first, try_convert.second.second);
-    }
-    if (isdigit(x[0])) throw RuntimeError("Cannot convert to a number but start with number char");
-
-    Value matched_value = find(x, e);
-    if (matched_value.get() == nullptr) { // 没被定义的情况
-        auto it = global_env.find(x);
-        if (it != global_env.end()) {
-            return it->second; // 直接返回找到的值，不调用默认构造函数
-        }
-        if (primitives.count(x)) {
-            auto it = primitive_map.find(primitives[x]);
-            if (it != primitive_map.end()) {
-                auto proto = it->second;
-                Assoc empty_env = empty();
-                return ProcedureV(proto.second, proto.first, empty_env);
+Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
+    switch (numPair(rand1, rand2)) {
+        case NUM_II: {
+            int dividend = rand1.asInt();
+            int divisor = rand2.asInt();
+            if (divisor == 0) {
+                throw(RuntimeError("Division by zero"));
             }
+            if (divisor == -1) return IntegerV(0); // INT_MIN % -1 在 C++ 里是未定义行为
+            return IntegerV(dividend % divisor);
         }
-        throw RuntimeError("The variable is not define in the scope"); // 环境里也没有，也不是保留字
+        case NUM_INT:
+            if (intSign(rand2) == 0) throw(RuntimeError("Division by zero"));
+            return intRemainder(rand1, rand2);
+        default:
+            throw(RuntimeError("modulo is only defined for integers"));
     }
-    return matched_value; //已经定义过了的情况
 }
 
-Value Plus::evalRator(const Value &rand1, const Value &rand2) { // +
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return IntegerV((dynamic_cast<Integer*>(rand1.get())->n) + (dynamic_cast<Integer*>(rand2.get())->n));
-    }
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int Int = dynamic_cast<Integer*>(rand1.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        return RationalV(Int * Ra_d + Ra_n, Ra_d); // 不可能改变同余性
-    }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int Int = dynamic_cast<Integer*>(rand2.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        return RationalV(Int * Ra_d + Ra_n, Ra_d);
-   }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int Ra1_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra1_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int Ra2_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra2_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        int ret_d = Ra1_d * Ra2_d;
-        int ret_n = Ra1_n * Ra2_d + Ra2_n * Ra1_d;
-        int t = gcd(ret_d, ret_n);
-        ret_d /= t;
-        ret_n /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));
-        // 理论上来说这个时候分母肯定是正的
-    }
-    throw(RuntimeError("Wrong typename"));
-}
+// ============================================================================
+// n 元算术：边走实参边累加，不建中间 vector，也不给每一步的部分和装箱
+// ============================================================================
 
-Value Minus::evalRator(const Value &rand1, const Value &rand2) { // -
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return IntegerV((dynamic_cast<Integer*>(rand1.get())->n) - (dynamic_cast<Integer*>(rand2.get())->n));
-    }
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int Int = dynamic_cast<Integer*>(rand1.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        return RationalV(Int * Ra_d - Ra_n, Ra_d); // 不可能改变同余性
-    }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int Int = dynamic_cast<Integer*>(rand2.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        return RationalV(- Int * Ra_d + Ra_n, Ra_d);
-   }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int Ra1_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra1_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int Ra2_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra2_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        int ret_d = Ra1_d * Ra2_d;
-        int ret_n = Ra1_n * Ra2_d - Ra2_n * Ra1_d;
-        int t = gcd(ret_d, ret_n);
-        ret_d /= t;
-        ret_n /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));
-        // 理论上来说这个时候分母肯定是正的
-    }
-    //TODO: To complete the substraction logic
-    throw(RuntimeError("Wrong typename"));
+static inline void checkNumber(const Value &v) {
+    if (numKind(v.type()) == 3) throw(RuntimeError("Wrong typename"));
 }
 
-Value Mult::evalRator(const Value &rand1, const Value &rand2) { // *
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return IntegerV((dynamic_cast<Integer*>(rand1.get())->n) * (dynamic_cast<Integer*>(rand2.get())->n));
-    }
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int Int = dynamic_cast<Integer*>(rand1.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        int final_n = Int * Ra_n;
-        int t = gcd(final_n, Ra_d);
-        final_n /= t;
-        Ra_d /= t;
-        return (Ra_d == 1 ? IntegerV(final_n) : (RationalV(final_n, Ra_d)));
-    }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int Int = dynamic_cast<Integer*>(rand2.get())->n;
-        int Ra_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int final_n = Int * Ra_n;
-        int t = gcd(final_n, Ra_d);
-        final_n /= t;
-        Ra_d /= t;
-        return (Ra_d == 1 ? IntegerV(final_n) : (RationalV(final_n, Ra_d)));
-   }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL) {
-        int Ra1_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra1_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int Ra2_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra2_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        int ret_d = Ra1_d * Ra2_d;
-        int ret_n = Ra1_n * Ra2_n;
-        int t = gcd(ret_n, ret_d);
-        ret_n /= t;
-        ret_d /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));
+// init 依次加上（subtract 时减去）args。全是 fixnum 时在 long long 里累加，
+// 遇到 bignum / 有理数（或者 long long 都装不下）才换成 Fraction，结果只装箱一次
+static Value sumAll(const Value &init, const Value *args, int n, bool subtract) {
+    int i = 0;
+    long long acc = 0;
+    if (init.type() == V_INT) {
+        acc = init.asInt();
+        for (; i < n && args[i].type() == V_INT; i++) {
+            long long r;
+            if (subtract ? __builtin_sub_overflow(acc, (long long)args[i].asInt(), &r)
+                         : __builtin_add_overflow(acc, (long long)args[i].asInt(), &r)) break;
+            acc = r;
+        }
+        if (i == n) return integerV(acc);
+    } else {
+        checkNumber(init);
     }
-    throw(RuntimeError("Wrong typename"));
+    Fraction f = init.type() == V_INT ? Fraction(integerV(acc), IntegerV(1)) : Fraction(init);
+    for (; i < n; i++) {
+        checkNumber(args[i]);
+        Fraction x(args[i]);
+        f = addFractions(f, subtract ? intNeg(x.n) : x.n, x.d);
+    }
+    return f.value();
 }
 
-Value Div::evalRator(const Value &rand1, const Value &rand2) { // /
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int a = dynamic_cast<Integer*>(rand1.get())->n;
-        int b = dynamic_cast<Integer*>(rand2.get())->n;
-        if (!b) throw RuntimeError("division with 0");
-        int t = gcd(a, b);
-        a /= t; b /= t;
-        return (b == 1 ? IntegerV(a) : (RationalV(a, b)));
-    }
-    if (rand1->v_type == V_INT && rand2->v_type == V_RATIONAL) {
-        int INT = dynamic_cast<Integer*>(rand1.get())->n;
-        int Frac_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Frac_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        if (!Frac_n) throw RuntimeError("division with 0");
-        int ret_d = Frac_n;
-        int ret_n = INT * Frac_d;
-        int t = gcd(ret_d, ret_n);
-        ret_d /= t;
-        ret_n /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));
-    }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_INT) {
-        int Frac_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int Frac_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int INT = dynamic_cast<Integer*>(rand2.get())->n;
-        if (!INT) throw RuntimeError("division with 0");
-        int ret_d = Frac_d * INT;
-        int ret_n = Frac_n;
-        int t = gcd(ret_d, ret_n);
-        ret_d /= t;
-        ret_n /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));       
-    }
-    if (rand1->v_type == V_RATIONAL && rand2->v_type == V_RATIONAL){
-        int Ra1_d = dynamic_cast<Rational*>(rand1.get())->denominator;
-        int Ra1_n = dynamic_cast<Rational*>(rand1.get())->numerator;
-        int Ra2_d = dynamic_cast<Rational*>(rand2.get())->denominator;
-        int Ra2_n = dynamic_cast<Rational*>(rand2.get())->numerator;
-        if (!Ra2_n) throw RuntimeError("division with 0");
-        int ret_d = Ra1_d * Ra2_n;
-        int ret_n = Ra1_n * Ra2_d;
-        int t = gcd(ret_n, ret_d);
-        ret_n /= t;
-        ret_d /= t;
-        return (ret_d == 1 ? IntegerV(ret_n) : (RationalV(ret_n, ret_d)));
+static Value productAll(const Value &init, const Value *args, int n) {
+    int i = 0;
+    long long acc = 1;
+    if (init.type() == V_INT) {
+        acc = init.asInt();
+        for (; i < n && args[i].type() == V_INT; i++) {
+            long long r;
+            if (__builtin_mul_overflow(acc, (long long)args[i].asInt(), &r)) break;
+            acc = r;
+        }
+        if (i == n) return integerV(acc);
+    } else {
+        checkNumber(init);
     }
-    throw(RuntimeError("Wrong typename"));
+    Fraction f = init.type() == V_INT ? Fraction(integerV(acc), IntegerV(1)) : Fraction(init);
+    for (; i < n; i++) {
+        checkNumber(args[i]);
+        f = mulFractions(f, Fraction(args[i]));
+    }
+    return f.value();
 }
 
-Value Modulo::evalRator(const Value &rand1, const Value &rand2) { // modulo
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int dividend = dynamic_cast<Integer*>(rand1.get())->n;
-        int divisor = dynamic_cast<Integer*>(rand2.get())->n;
-        if (divisor == 0) {
-            throw(RuntimeError("Division by zero"));
+// init 依次除以 args：fixnum 除数先乘进一个 long long 分母，最后只约分一次
+static Value quotientAll(const Value &init, const Value *args, int n) {
+    int i = 0;
+    long long den = 1;
+    if (init.type() == V_INT) {
+        for (; i < n && args[i].type() == V_INT; i++) {
+            long long r;
+            if (args[i].asInt() == 0) throw RuntimeError("division with 0");
+            if (__builtin_mul_overflow(den, (long long)args[i].asInt(), &r)) break;
+            den = r;
         }
-        return IntegerV(dividend % divisor);
+        if (i == n) return RationalV(init, integerV(den));
+    } else {
+        checkNumber(init);
     }
-    throw(RuntimeError("modulo is only defined for integers"));
+    Fraction f(init.type() == V_INT ? RationalV(init, integerV(den)) : init);
+    for (; i < n; i++) {
+        checkNumber(args[i]);
+        f = mulFractions(f, reciprocal(args[i]));
+    }
+    return f.value();
 }
 
-Value PlusVar::evalRator(const std::vector<Value> &args) { // + with multiple args
-    //DONE: To complete the addition logic
-    if (args.empty()) return IntegerV(0);
-    if (args.size() == 1) return args[0];
-    Value a = args[0];
-    Value b = NULL;
-    struct Plus plustool(NULL, NULL);
-    for (int i = 1; i < args.size(); i++) {
-        b = args[i];
-        a = plustool.evalRator(a, b);
-    }
-    return a;
+Value PlusVar::evalRator(const Value *args, int n) { // + with multiple args
+    if (n == 0) return IntegerV(0);
+    return sumAll(args[0], args + 1, n - 1, false);
 }
 
-Value MinusVar::evalRator(const std::vector<Value> &args) { // - with multiple args
-    if (args.empty()) throw RuntimeError("invalid arg num");
-    Value a = args[0];
-    Value b = NULL;
-    struct Minus minustool(NULL, NULL);
-    if (args.size() == 1) return minustool.evalRator(IntegerV(0), a);
-    for (int i = 1; i < args.size(); i++) {
-        b = args[i];
-        a = minustool.evalRator(a, b);
-    }
-    return a;
+Value MinusVar::evalRator(const Value *args, int n) { // - with multiple args
+    if (n == 0) throw RuntimeError("invalid arg num");
+    if (n == 1) return sumAll(IntegerV(0), args, 1, true);
+    return sumAll(args[0], args + 1, n - 1, true);
 }
 
-Value MultVar::evalRator(const std::vector<Value> &args) { // * with multiple args
-    if (args.empty()) return IntegerV(1);
-    if (args.size() == 1) return args[0];
-    Value a = args[0];
-    Value b = NULL;
-    struct Mult multtool(NULL, NULL);
-    for (int i = 1; i < args.size(); i++) {
-        b = args[i];
-        a = multtool.evalRator(a, b);
-    }
-    return a;
+Value MultVar::evalRator(const Value *args, int n) { // * with multiple args
+    if (n == 0) return IntegerV(1);
+    return productAll(args[0], args + 1, n - 1);
 }
 
-Value DivVar::evalRator(const std::vector<Value> &args) { // / with multiple args
-    if (args.empty()) throw RuntimeError("Invalid arg num");
-    Value a = args[0];
-    Value b = NULL;
-    struct Div divtool(NULL, NULL);
-    if (args.size() == 1) return divtool.evalRator(IntegerV(1), a);
-    for (int i = 1; i < args.size(); i++) {
-        b = args[i];
-        a = divtool.evalRator(a, b);
-    }
-    return a;
+Value DivVar::evalRator(const Value *args, int n) { // / with multiple args
+    if (n == 0) throw RuntimeError("Invalid arg num");
+    if (n == 1) return quotientAll(IntegerV(1), args, 1);
+    return quotientAll(args[0], args + 1, n - 1);
 }
 
 Value Expt::evalRator(const Value &rand1, const Value &rand2) { // expt
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        int base = dynamic_cast<Integer*>(rand1.get())->n;
-        int exponent = dynamic_cast<Integer*>(rand2.get())->n;
-        
-        if (exponent < 0) {
+    if (isInteger(rand1) && isInteger(rand2)) {
+        if (intSign(rand2) < 0) {
             throw(RuntimeError("Negative exponent not supported for integers"));
         }
-        if (base == 0 && exponent == 0) {
+        if (intSign(rand1) == 0 && intSign(rand2) == 0) {
             throw(RuntimeError("0^0 is undefined"));
         }
-        
-        long long result = 1;
-        long long b = base;
-        int exp = exponent;
-        
-        while (exp > 0) {
-            if (exp % 2 == 1) {
-                result *= b;
-                if (result > INT_MAX || result < INT_MIN) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
-            }
-            b *= b;
-            if (b > INT_MAX || b < INT_MIN) {
-                if (exp > 1) {
-                    throw(RuntimeError("Integer overflow in expt"));
-                }
-            }
-            exp /= 2;
+        if (rand2.type() == V_BIGINT) { // 只有 0、1、-1 的这种幂还写得下
+            if (intCompare(intMul(rand1, rand1), IntegerV(1)) > 0) throw(RuntimeError("Exponent too large in expt"));
+            return intPow(rand1, rand2.as<BigInt>()->limbs[0] & 1);
         }
-        
-        return IntegerV((int)result);
+        return intPow(rand1, (unsigned)rand2.asInt());
     }
     throw(RuntimeError("Wrong typename"));
 }
 
 //A FUNCTION TO SIMPLIFY THE COMPARISON WITH INTEGER AND RATIONAL NUMBER
 int compareNumericValues(const Value &v1, const Value &v2) {
-    if (v1->v_type == V_INT && v2->v_type == V_INT) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
-        return (n1 < n2) ? -1 : (n1 > n2) ? 1 : 0;
-    }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_INT) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        int n2 = dynamic_cast<Integer*>(v2.get())->n;
-        int left = r1->numerator;
-        int right = n2 * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    else if (v1->v_type == V_INT && v2->v_type == V_RATIONAL) {
-        int n1 = dynamic_cast<Integer*>(v1.get())->n;
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = n1 * r2->denominator;
-        int right = r2->numerator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    else if (v1->v_type == V_RATIONAL && v2->v_type == V_RATIONAL) {
-        Rational* r1 = dynamic_cast<Rational*>(v1.get());
-        Rational* r2 = dynamic_cast<Rational*>(v2.get());
-        int left = r1->numerator * r2->denominator;
-        int right = r2->numerator * r1->denominator;
-        return (left < right) ? -1 : (left > right) ? 1 : 0;
-    }
-    throw RuntimeError("Wrong typename in numeric comparison");
+    switch (numPair(v1, v2)) {
+        case NUM_II: {
+            int left = v1.asInt(), right = v2.asInt();
+            return (left < right) ? -1 : (left > right) ? 1 : 0;
+        }
+        case NUM_INT:
+            return intCompare(v1, v2);
+        case NUM_RAT: { // 分母都是正的，交叉相乘不改变大小关系
+            Fraction a(v1), b(v2);
+            return intCompare(intMul(a.n, b.d), intMul(b.n, a.d));
+        }
+        default:
+            throw RuntimeError("Wrong typename in numeric comparison");
+    }
 }
 
 Value Less::evalRator(const Value &rand1, const Value &rand2) { // < // 需要使用上面的compare函数简单化问题
@@ -557,55 +568,49 @@ Value Greater::evalRator(const Value &rand1, const Value &rand2) { // >
     return (BooleanV(ans == 1));
 }
 
-Value LessVar::evalRator(const std::vector<Value> &args) { // < with multiple args
-    bool ans = true;
-    for (int i = 1; i < args.size(); i++) {
-        ans = ans && (compareNumericValues(args[i - 1], args[i]) == -1);
+// 比较链：相邻两项的 compareNumericValues 结果 c 落在 accept 里（第 c + 1 位）才继续，
+// 一旦不成立就返回 #f，后面的实参不再看
+enum { CMP_LT = 1, CMP_EQ = 2, CMP_GT = 4 };
+
+static Value compareChain(const Value *args, int n, unsigned accept) {
+    for (int i = 1; i < n; i++) {
+        const Value &a = args[i - 1], &b = args[i];
+        int c = a.type() == V_INT && b.type() == V_INT ? (a.asInt() > b.asInt()) - (a.asInt() < b.asInt())
+                                                       : compareNumericValues(a, b);
+        if (!(accept >> (c + 1) & 1)) return BooleanV(false);
     }
-    return BooleanV(ans);
+    return BooleanV(true);
 }
 
-Value LessEqVar::evalRator(const std::vector<Value> &args) { // <= with multiple args
-    bool ans = true;
-    for (int i = 1; i < args.size(); i++) {
-        ans = ans && (compareNumericValues(args[i - 1], args[i]) != 1);
-    }
-    return BooleanV(ans);
+Value LessVar::evalRator(const Value *args, int n) { // < with multiple args
+    return compareChain(args, n, CMP_LT);
 }
 
-Value EqualVar::evalRator(const std::vector<Value> &args) { // = with multiple args
-    bool ans = true;
-    for (int i = 1; i < args.size(); i++) {
-        ans = ans && (compareNumericValues(args[i - 1], args[i]) == 0);
-    }
-    return BooleanV(ans);
+Value LessEqVar::evalRator(const Value *args, int n) { // <= with multiple args
+    return compareChain(args, n, CMP_LT | CMP_EQ);
 }
 
-Value GreaterEqVar::evalRator(const std::vector<Value> &args) { // >= with multiple args
-    bool ans = true;
-    for (int i = 1; i < args.size(); i++) {
-        ans = ans && (compareNumericValues(args[i - 1], args[i]) != -1);
-    }
-    return BooleanV(ans);
+Value EqualVar::evalRator(const Value *args, int n) { // = with multiple args
+    return compareChain(args, n, CMP_EQ);
 }
 
-Value GreaterVar::evalRator(const std::vector<Value> &args) { // > with multiple args
-    bool ans = true;
-    for (int i = 1; i < args.size(); i++) {
-        ans = ans && (compareNumericValues(args[i - 1], args[i]) == 1);
-    }
-    return BooleanV(ans);
+Value GreaterEqVar::evalRator(const Value *args, int n) { // >= with multiple args
+    return compareChain(args, n, CMP_EQ | CMP_GT);
+}
+
+Value GreaterVar::evalRator(const Value *args, int n) { // > with multiple args
+    return compareChain(args, n, CMP_GT);
 }
 
 Value Cons::evalRator(const Value &rand1, const Value &rand2) { // cons
     return (PairV(rand1, rand2));
 }
 
-Value ListFunc::evalRator(const std::vector<Value> &args) { // list function
+Value ListFunc::evalRator(const Value *args, int n) { // list function
     //Done: To complete the list logic
-    if (args.size() == 0) return NullV(); // NullV 表示空表
+    if (n == 0) return NullV(); // NullV 表示空表
     Value my_pair = NullV();
-    for (int i = args.size() - 1; i >= 0; i--) {
+    for (int i = n - 1; i >= 0; i--) {
         my_pair = PairV(args[i], my_pair);
     }
     return my_pair;
@@ -613,35 +618,35 @@ Value ListFunc::evalRator(const std::vector<Value> &args) { // list function
 
 Value IsList::evalRator(const Value &rand) { // list?
     //Done: To complete the list? logic
-    if (rand->v_type == V_NULL) return BooleanV(true);
-    else if (rand->v_type == V_PAIR) {
+    if (rand.type() == V_NULL) return BooleanV(true);
+    else if (rand.type() == V_PAIR) {
         Value tail = rand;
-        while (dynamic_cast<Pair*>(tail.get()) != nullptr) {
-            tail = dynamic_cast<Pair*>(tail.get())->cdr;
+        while (tail.type() == V_PAIR) {
+            tail = tail.as<Pair>()->cdr;
         }
-        return BooleanV(tail->v_type == V_NULL);
+        return BooleanV(tail.type() == V_NULL);
     }
     return BooleanV(false);
 }
 
 Value Car::evalRator(const Value &rand) { // car
-    if (rand->v_type == V_PAIR) {
-        return (dynamic_cast<Pair*>(rand.get())->car);
+    if (rand.type() == V_PAIR) {
+        return rand.as<Pair>()->car;
     }
     throw RuntimeError("Wrong typename");
 }
 
 Value Cdr::evalRator(const Value &rand) { // cdr
-    if (rand->v_type == V_PAIR) {
-        return (dynamic_cast<Pair*>(rand.get())->cdr);
+    if (rand.type() == V_PAIR) {
+        return rand.as<Pair>()->cdr;
     }
     throw RuntimeError("Wrong typename");
 }
 
 Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
     //TODO: To complete the set-car! logic
-    if (Pair* target = dynamic_cast<Pair*>(rand1.get())) {
-        target->car = rand2;
+    if (rand1.type() == V_PAIR) {
+        rand1.as<Pair>()->car = rand2;
         return VoidV();
     }
     throw RuntimeError("invalid format for Setcar");
@@ -649,81 +654,246 @@ Value SetCar::evalRator(const Value &rand1, const Value &rand2) { // set-car!
 
 Value SetCdr::evalRator(const Value &rand1, const Value &rand2) { // set-cdr!
    //TODO: To complete the set-cdr! logic
-    if (Pair* target = dynamic_cast<Pair*>(rand1.get())) {
-        target->cdr = rand2;
+    if (rand1.type() == V_PAIR) {
+        rand1.as<Pair>()->cdr = rand2;
         return VoidV();
     }
     throw RuntimeError("invalid format for Setcdr");
 }
 
-Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
-    // 检查类型是否为 Integer
-    if (rand1->v_type == V_INT && rand2->v_type == V_INT) {
-        return BooleanV((dynamic_cast<Integer*>(rand1.get())->n) == (dynamic_cast<Integer*>(rand2.get())->n));
-    }
-    // 检查类型是否为 Boolean
-    else if (rand1->v_type == V_BOOL && rand2->v_type == V_BOOL) {
-        return BooleanV((dynamic_cast<Boolean*>(rand1.get())->b) == (dynamic_cast<Boolean*>(rand2.get())->b));
+static Vector *vectorArg(const Value &v) {
+    if (v.type() != V_VECTOR) throw RuntimeError("Wrong typename");
+    return v.as<Vector>();
+}
+
+// 下标必须是 [0, 长度) 里的 fixnum
+static size_t vectorIndex(const Vector *vec, const Value &k) {
+    if (k.type() != V_INT) throw RuntimeError("Wrong typename");
+    if (k.asInt() < 0 || (size_t)k.asInt() >= vec->items.size()) throw RuntimeError("Vector index out of range");
+    return (size_t)k.asInt();
+}
+
+Value MakeVector::evalRator(const Value *args, int n) { // make-vector
+    if (n != 1 && n != 2) throw RuntimeError("Wrong number of arguments");
+    if (args[0].type() != V_INT) throw RuntimeError("Wrong typename");
+    if (args[0].asInt() < 0) throw RuntimeError("Negative vector length");
+    return VectorV(HeapVector<Value>(args[0].asInt(), n == 2 ? args[1] : IntegerV(0)));
+}
+
+Value VectorFunc::evalRator(const Value *args, int n) { // vector
+    return VectorV(HeapVector<Value>(args, args + n));
+}
+
+Value VectorRef::evalRator(const Value &rand1, const Value &rand2) { // vector-ref
+    Vector *vec = vectorArg(rand1);
+    return vec->items[vectorIndex(vec, rand2)];
+}
+
+Value VectorSet::evalRator(const Value *args, int n) { // vector-set!
+    Vector *vec = vectorArg(args[0]);
+    vec->items[vectorIndex(vec, args[1])] = args[2];
+    return VoidV();
+}
+
+Value VectorLength::evalRator(const Value &rand) { // vector-length
+    return IntegerV((int)vectorArg(rand)->items.size());
+}
+
+Value VectorFill::evalRator(const Value &rand1, const Value &rand2) { // vector-fill!
+    Vector *vec = vectorArg(rand1);
+    std::fill(vec->items.begin(), vec->items.end(), rand2);
+    return VoidV();
+}
+
+Value ListToVector::evalRator(const Value &rand) { // list->vector
+    HeapVector<Value> items;
+    const Pair *slow = rand.type() == V_PAIR ? rand.as<Pair>() : nullptr;
+    const Value *rest = &rand;
+    while (rest->type() == V_PAIR) {
+        const Pair *p = rest->as<Pair>();
+        items.push_back(p->car);
+        rest = &p->cdr;
+        if (items.size() % 2 == 0) { // Floyd 判圈：慢指针每两步走一步
+            slow = slow->cdr.as<Pair>();
+            if (rest->type() == V_PAIR && rest->as<Pair>() == slow) throw RuntimeError("Circular list");
+        }
     }
-    // 检查类型是否为 Symbol
-    else if (rand1->v_type == V_SYM && rand2->v_type == V_SYM) {
-        return BooleanV((dynamic_cast<Symbol*>(rand1.get())->s) == (dynamic_cast<Symbol*>(rand2.get())->s));
+    if (rest->type() != V_NULL) throw RuntimeError("Wrong typename");
+    return VectorV(std::move(items));
+}
+
+static HashTable *hashTableArg(const Value &v) {
+    if (v.type() != V_HASHTABLE) throw RuntimeError("Wrong typename");
+    return v.as<HashTable>();
+}
+
+Value MakeHashTable::evalRator(const Value *args, int n) { // make-hash-table
+    if (n > 1) throw RuntimeError("Wrong number of arguments");
+    if (n == 0 || args[0].same(primitiveValue(E_EQUALQ))) return HashTableV(true);
+    if (args[0].same(primitiveValue(E_EQQ))) return HashTableV(false);
+    throw RuntimeError("make-hash-table: expected eq? or equal?");
+}
+
+Value HashTableRef::evalRator(const Value *args, int n) { // hash-table-ref
+    if (n != 2 && n != 3) throw RuntimeError("Wrong number of arguments");
+    Value *found = hashTableArg(args[0])->find(args[1]);
+    if (found != nullptr) return *found;
+    if (n == 3) return args[2];
+    throw RuntimeError("hash-table-ref: key not found");
+}
+
+Value HashTableSet::evalRator(const Value *args, int n) { // hash-table-set!
+    hashTableArg(args[0])->set(args[1], args[2]);
+    return VoidV();
+}
+
+Value HashTableDelete::evalRator(const Value &rand1, const Value &rand2) { // hash-table-delete!
+    hashTableArg(rand1)->erase(rand2);
+    return VoidV();
+}
+
+Value HashTableContains::evalRator(const Value &rand1, const Value &rand2) { // hash-table-contains?
+    return BooleanV(hashTableArg(rand1)->find(rand2) != nullptr);
+}
+
+Value HashTableCount::evalRator(const Value &rand) { // hash-table-count
+    return integerV((long long)hashTableArg(rand)->count);
+}
+
+// 按槽的顺序把每个活元素变成一项，串成表
+template <typename F>
+static Value hashTableList(const Value &table, F item) {
+    Value list = NullV();
+    for (const HashTable::Slot &s : hashTableArg(table)->slots) {
+        if (s.state == HashTable::FULL) list = PairV(item(s), list);
     }
-    // 检查类型是否为 Null 或 Void
-    else if ((rand1->v_type == V_NULL && rand2->v_type == V_NULL) ||
-             (rand1->v_type == V_VOID && rand2->v_type == V_VOID)) {
-        return BooleanV(true);
-    } else {
-        return BooleanV(rand1.get() == rand2.get());
+    return list;
+}
+
+Value HashTableKeys::evalRator(const Value &rand) { // hash-table-keys
+    return hashTableList(rand, [](const HashTable::Slot &s) { return s.key; });
+}
+
+Value HashTableValues::evalRator(const Value &rand) { // hash-table-values
+    return hashTableList(rand, [](const HashTable::Slot &s) { return s.value; });
+}
+
+Value HashTableToAlist::evalRator(const Value &rand) { // hash-table->alist
+    return hashTableList(rand, [](const HashTable::Slot &s) { return PairV(s.key, s.value); });
+}
+
+Value VectorToList::evalRator(const Value &rand) { // vector->list
+    const HeapVector<Value> &items = vectorArg(rand)->items;
+    Value list = NullV();
+    for (size_t i = items.size(); i > 0; i--) {
+        list = PairV(items[i - 1], list);
     }
+    return list;
+}
+
+Value IsEq::evalRator(const Value &rand1, const Value &rand2) { // eq?
+    // #t #f '() #<void> 和整数都是立即数，相同的常量总是相同的 (tag, 值)；
+    // 符号每个 atom 只有一个对象；其余比较指针
+    return BooleanV(rand1.same(rand2));
+}
+
+Value IsEqual::evalRator(const Value &rand1, const Value &rand2) { // equal?
+    return BooleanV(valuesEqual(rand1, rand2));
 }
 
 Value IsBoolean::evalRator(const Value &rand) { // boolean?
-    return BooleanV(rand->v_type == V_BOOL);
+    return BooleanV(rand.type() == V_BOOL);
 }
 
 Value IsFixnum::evalRator(const Value &rand) { // number?
-    return BooleanV(rand->v_type == V_INT);
+    return BooleanV(isInteger(rand));
 }
 
 Value IsNull::evalRator(const Value &rand) { // null?
-    return BooleanV(rand->v_type == V_NULL);
+    return BooleanV(rand.type() == V_NULL);
 }
 
 Value IsPair::evalRator(const Value &rand) { // pair?
-    return BooleanV(rand->v_type == V_PAIR);
+    return BooleanV(rand.type() == V_PAIR);
 }
 
 Value IsProcedure::evalRator(const Value &rand) { // procedure?
-    return BooleanV(rand->v_type == V_PROC);
+    return BooleanV(rand.type() == V_PROC || rand.type() == V_PRIM || rand.type() == V_MEMO);
 }
 
 Value IsSymbol::evalRator(const Value &rand) { // symbol?
-    return BooleanV(rand->v_type == V_SYM);
+    return BooleanV(rand.type() == V_SYM);
 }
 
 Value IsString::evalRator(const Value &rand) { // string?
-    return BooleanV(rand->v_type == V_STRING);
+    return BooleanV(rand.type() == V_STRING);
+}
+
+Value IsVector::evalRator(const Value &rand) { // vector?
+    return BooleanV(rand.type() == V_VECTOR);
+}
+
+Value IsHashTable::evalRator(const Value &rand) { // hash-table?
+    return BooleanV(rand.type() == V_HASHTABLE);
+}
+
+// TAIL CALLS
+// 尾位置上的表达式不直接递归求值，而是把 (expr, env) 交给 TailCall，
+// 由 trampoline 在循环里接着跑，这样尾递归写的循环不会吃掉 C++ 栈
+TailCall::TailCall() : expr(nullptr), env(nullptr), name(0) {}
+
+Value ExprBase::evalTail(Assoc &e, TailCall &tc) { // 默认：没有尾位置可言，直接求值
+    return eval(e);
+}
+
+// 只有 Apply 会填 tc，所以每转一圈就是一次过程调用；第二圈起是尾调用接替了上一个
+Value trampoline(Value v, TailCall &tc) {
+    if (tc.expr.get() == nullptr) return v;
+    CallScope scope; // 每进一层过程体算一层深度，出错时也会退回去
+    enterCall();
+    bool entered = false;
+    while (tc.expr.get() != nullptr) {
+        Expr next = std::move(tc.expr); // 持有一份，防止执行途中过程体被释放
+        Assoc env = std::move(tc.env);
+        tc.expr = Expr(nullptr);
+        if (profiling) {
+            if (entered) profileTail(tc.name);
+            else profileEnter(tc.name);
+            entered = true;
+        }
+        v = next->evalTail(env, tc);
+    }
+    if (entered) profileExit();
+    return v;
 }
 
 Value Begin::eval(Assoc &e) {
+    TailCall tc;
+    return trampoline(evalTail(e, tc), tc);
+}
+
+Value Begin::evalTail(Assoc &e, TailCall &tc) {
     if (!es.size()) return VoidV();
     for (int j = 0; j < es.size() - 1; j++) {
         es[j]->eval(e);
     }
-    return es[es.size() - 1]->eval(e);
+    return es[es.size() - 1]->evalTail(e, tc);
 }
 
 Value Helper(Syntax s){
+    static const Atom dot_atom = intern(".");
     if (dynamic_cast<Number*>(s.get()) != nullptr) {
         return IntegerV(dynamic_cast<Number*>(s.get())->n);
     }
     if (dynamic_cast<RationalSyntax*>(s.get()) != nullptr) {
         RationalSyntax* rat = dynamic_cast<RationalSyntax*>(s.get());
-        return RationalV(rat->numerator, rat->denominator);
+        return RationalV(IntegerV(rat->numerator), IntegerV(rat->denominator));
+    }
+    if (BigNumberSyntax *big = dynamic_cast<BigNumberSyntax*>(s.get())) {
+        return numberLiteral(big->s);
     }
     if (dynamic_cast<SymbolSyntax*>(s.get()) != nullptr) {
-        return SymbolV(dynamic_cast<SymbolSyntax*>(s.get())->s);
+        return SymbolV(dynamic_cast<SymbolSyntax*>(s.get())->atom); // 直接复用已 intern 的符号
     }
     if (dynamic_cast<StringSyntax*>(s.get()) != nullptr) {
         return StringV(dynamic_cast<StringSyntax*>(s.get())->s);
@@ -734,6 +904,15 @@ Value Helper(Syntax s){
     if (dynamic_cast<FalseSyntax*>(s.get()) != nullptr) {
         return BooleanV(false);
     }
+    if (VectorSyntax *vec = dynamic_cast<VectorSyntax*>(s.get())) {
+        HeapVector<Value> items;
+        items.reserve(vec->stxs.size());
+        for (auto &item : vec->stxs) {
+            items.push_back(Helper(item));
+            if (items.back().type() == V_SYM && items.back().as<Symbol>()->atom == dot_atom) throw RuntimeError("Invalid dot expression");
+        }
+        return VectorV(std::move(items));
+    }
     if (dynamic_cast<List*>(s.get()) != nullptr) {
         List* this_list = dynamic_cast<List*>(s.get());
         int i = this_list->stxs.size();
@@ -747,7 +926,7 @@ Value Helper(Syntax s){
         }
         int is_pair = 0;
         for (int j = 0; j < i; j++) { 
-            if (first_list[j]->v_type == V_SYM && dynamic_cast<Symbol*>(first_list[j].get())->s == ".") {
+            if (first_list[j].type() == V_SYM && first_list[j].as<Symbol>()->atom == dot_atom) {
                 if (is_pair == 1 || j == (i - 1) || j == 0) throw RuntimeError("Invalid dot expression"); // 难说能不能为0，会不会 . 作为一个函数？？
                 is_pair = 1;
             }
@@ -773,71 +952,100 @@ Value Helper(Syntax s){
     throw RuntimeError("What is your type??");
 }
 
+std::shared_ptr<Value> quoteDatum(const Syntax &s) {
+    try {
+        return std::make_shared<Value>(Helper(s));
+    }
+    catch (const RuntimeError &) {
+        return nullptr; // 留到求值时再报错
+    }
+}
+
 Value Quote::eval(Assoc& e) {
     //DONE: To complete the quote logic
+    if (datum) return *datum; // 只在构造时建一次，之后每次都返回同一份
     return Helper(s);
 }
 
 Value AndVar::eval(Assoc &e) { // and with short-circuit evaluation
+    TailCall tc;
+    return trampoline(evalTail(e, tc), tc);
+}
+
+Value AndVar::evalTail(Assoc &e, TailCall &tc) {
     if (!rands.size()) return BooleanV(true);
     Value this_val = NULL;
-    for (int i = 0; i < rands.size(); i++) {
+    for (int i = 0; i < rands.size() - 1; i++) {
         this_val = rands[i]->eval(e);
-        if (this_val->v_type == V_BOOL && dynamic_cast<Boolean*>(this_val.get())->b == false) {
+        if (this_val.isFalse()) {
             return BooleanV(false);
         }
     }
-    return this_val;
+    return rands[rands.size() - 1]->evalTail(e, tc); // 最后一个的值原样返回，处在尾位置
 }
 
 Value OrVar::eval(Assoc &e) { // or with short-circuit evaluation
+    TailCall tc;
+    return trampoline(evalTail(e, tc), tc);
+}
+
+Value OrVar::evalTail(Assoc &e, TailCall &tc) {
     if (!rands.size()) return BooleanV(false);
     Value this_val = NULL;
-    for (int i = 0; i < rands.size(); i++) {
+    for (int i = 0; i < rands.size() - 1; i++) {
         this_val = rands[i]->eval(e);
-        if (this_val->v_type == V_BOOL && dynamic_cast<Boolean*>(this_val.get())->b == false) {
+        if (this_val.isFalse()) {
             continue;
         }
         return this_val;
     }
-    return BooleanV(false);
+    return rands[rands.size() - 1]->evalTail(e, tc);
 }
 
 Value Not::evalRator(const Value &rand) { // not
-    if (rand->v_type == V_BOOL && dynamic_cast<Boolean*>(rand.get())->b == false) {
+    if (rand.isFalse()) {
         return BooleanV(true);
     }
     else return BooleanV(false);
 }
 
 Value If::eval(Assoc &e) {
+    TailCall tc;
+    return trampoline(evalTail(e, tc), tc);
+}
+
+Value If::evalTail(Assoc &e, TailCall &tc) {
     Value pred = cond->eval(e);
-    if (!pred.get()) {
+    if (!pred.bound()) {
         throw RuntimeError("Evaluation of condition resulted in an invalid value");
     }
-    if (pred->v_type == V_BOOL && dynamic_cast<Boolean*>(pred.get())->b == false) {
-        return (alter->eval(e));
+    if (pred.isFalse()) {
+        return (alter->evalTail(e, tc));
     }
     else {
-        return (conseq->eval(e));
+        return (conseq->evalTail(e, tc));
     }
 }
 
 Value Cond::eval(Assoc &env) {
+    TailCall tc;
+    return trampoline(evalTail(env, tc), tc);
+}
+
+Value Cond::evalTail(Assoc &env, TailCall &tc) {
     for (int i = 0; i < clauses.size(); i++) {
-        std::vector<Expr> this_clause = clauses[i];
+        const std::vector<Expr> &this_clause = clauses[i];
         Value pred = this_clause[0]->eval(env);
-        if (pred->v_type == V_BOOL && static_cast<Boolean*>(pred.get())->b == false) {
+        if (pred.isFalse()) {
             continue;
         }
         else {
             if (this_clause.size() == 1) return pred;
             else {
-                Value this_val = NULL;
-                for (int j = 1; j < this_clause.size(); j++) {
-                    this_val = this_clause[j]->eval(env);
+                for (int j = 1; j < this_clause.size() - 1; j++) {
+                    this_clause[j]->eval(env);
                 }
-                return this_val;
+                return this_clause[this_clause.size() - 1]->evalTail(env, tc);
             }
         }
     }
@@ -846,107 +1054,301 @@ Value Cond::eval(Assoc &env) {
 
 Value Lambda::eval(Assoc &env) { 
     //TODO: To complete the lambda logic
-    return ProcedureV(x, e, env);
+    return ProcedureV(x, e, env, code, name);
 }
 
 Value Apply::eval(Assoc &e) {
+    TailCall tc;
+    return trampoline(evalTail(e, tc), tc);
+}
+
+Value Apply::evalTail(Assoc &e, TailCall &tc) {
+    gcSafepoint(); // 此时所有活对象都被 Value / Assoc 持有
     Value proc_val = rator->eval(e); // 这是好习惯，没这么搞导致了 core dumped
-    if (proc_val->v_type != V_PROC) {throw RuntimeError("Attempt to apply a non-procedure");}
-    //TODO: TO COMPLETE THE CLOSURE LOGIC
-    Procedure* clos_ptr = dynamic_cast<Procedure*>(proc_val.get()); 
+    if (proc_val.type() != V_PROC && proc_val.type() != V_PRIM && proc_val.type() != V_MEMO) {throw RuntimeError("Attempt to apply a non-procedure");}
     
-    //TODO: TO COMPLETE THE ARGUMENT PARSER LOGIC
+    if (proc_val.type() == V_PRIM) { // 内建过程：直接调用，不建 frame，实参也不上堆
+        Primitive *prim = proc_val.as<Primitive>();
+        ArgBuffer args(rand.size());
+        for (int i = 0; i < rand.size(); i++) {
+            args.push(rand[i]->eval(e));
+        }
+        countStep(); // 实参算完才算这一步，和 VM 的 do_call 一样
+        if (prim->arity >= 0 && args.size() != prim->arity) throw RuntimeError("Wrong number of arguments");
+        return prim->fn(args.data(), args.size());
+    }
+    if (proc_val.type() == V_MEMO) { // 先查缓存，没有才真的调用
+        ArgBuffer args(rand.size());
+        for (int i = 0; i < rand.size(); i++) {
+            args.push(rand[i]->eval(e));
+        }
+        countStep();
+        return memoCall(proc_val, args.data(), args.size());
+    }
     std::vector<Value> args;
     for (int i = 0; i < rand.size(); i++) {
         args.push_back(rand[i]->eval(e));
     }
-    if (auto varNode = dynamic_cast<Variadic*>(clos_ptr->e.get())) {
-        //TODO 这时候就是procedure接受一个任意量数据，该怎么操作？这里主要的问题是variadic需要一个vector of value，但是我不能用它extend出assoc
-        Value a = NULL;
-        Value b = NullV();
-        for (int i = args.size() - 1; i >= 0; i--) {
-            a = args[i];
-            b = PairV(a, b);
-        }
-        args.clear();
-        args.push_back(b);
-    }
+    countStep();
+    Procedure* clos_ptr = proc_val.as<Procedure>();
     if (args.size() != clos_ptr->parameters.size()) throw RuntimeError("Wrong number of arguments");
-    //: TO COMPLETE THE PARAMETERS' ENVIRONMENT LOGIC
-    Assoc param_env = clos_ptr->env; // 用的是proc的env
-    for (int i = 0; i < args.size(); i++) {
-        param_env = extend(clos_ptr->parameters[i], args[i], param_env);
-    } 
-    return clos_ptr->e->eval(param_env);
+    // 用的是proc的env，所有参数放进同一个 frame；过程体交给 trampoline，不在这里递归
+    tc.env = extendFrame(std::move(args), clos_ptr->env);
+    tc.expr = clos_ptr->e;
+    tc.name = clos_ptr->name;
+    return Value(nullptr);
 }
 
 Value Define::eval(Assoc &env) {
     //TODO: To complete the define logic
-    auto it = global_env.find(var);
-    if (it != global_env.end()) {
-        it->second = Value(nullptr); 
-    } else {
-        global_env.insert({var, Value(nullptr)}); 
-    }
+    checkGlobalWrite();
+    *cell = Value(nullptr); // 先放一个占位
     Value v = e->eval(env);
-    it = global_env.find(var);
-    if (it != global_env.end()) {
-        it->second = v;
-    } else {
-        global_env.insert({var, v});
-    }
+    *cell = v;
     return Value(VoidV());
 }
 
 Value Letrec::eval(Assoc &env) {
+    TailCall tc;
+    return trampoline(evalTail(env, tc), tc);
+}
+
+Value Letrec::evalTail(Assoc &env, TailCall &tc) {
     //TODO: To complete the letrec logic
-    Assoc new_env = env;  
-    for (auto &p : bind) {
-        new_env = extend(p.first, Value(nullptr), new_env); 
-    }
+    Assoc new_env = extendFrame(std::vector<Value>(bind.size(), Value(nullptr)), env); // 先全部占位
     std::vector<Value> values;
     for (auto &p : bind) {
         values.push_back(p.second->eval(new_env));
     }
-    Assoc curr = new_env;
-    for (int i = values.size() - 1; i >= 0; i--) {
-        curr->v = values[i]; 
-        curr = curr->next;
+    for (int i = 0; i < values.size(); i++) {
+        new_env->slots[i] = values[i]; 
     }
-    return body->eval(new_env);
+    return body->evalTail(new_env, tc);
 }
 
 Value Let::eval(Assoc &env) {
+    TailCall tc;
+    return trampoline(evalTail(env, tc), tc);
+}
+
+Value Let::evalTail(Assoc &env, TailCall &tc) {
     //TODO: To complete the let logic
-    Assoc new_env = env;  
+    std::vector<Value> values;
     for (auto &p : bind) {
-        Value val = p.second->eval(env); 
-        new_env = extend(p.first, val, new_env); 
+        values.push_back(p.second->eval(env)); 
     }
-    return body->eval(new_env);
+    Assoc new_env = extendFrame(std::move(values), env);
+    return body->evalTail(new_env, tc);
 }
 
 Value Set::eval(Assoc &env) {
     Value val = e->eval(env);
-    if (find(var, env).get() != nullptr) {
-        modify(var, val, env);
+    if (depth >= 0) {
+        AssocList *frame = env.get();
+        for (int i = 0; i < depth; i++) frame = frame->next.get();
+        frame->slots[slot] = val;
         return Value(VoidV()); 
     } 
-    auto it = global_env.find(var);
-    if (it != global_env.end()) {
-        it->second = val;
+    if (cell != nullptr && cell->bound()) {
+        checkGlobalWrite();
+        *cell = val;
         return Value(VoidV());
     }
     throw RuntimeError("DEBUG: try to set a undefined var: " + var);
 }
 
-Value Display::evalRator(const Value &rand) { // display function
-    if (rand->v_type == V_STRING) {
-        String* str_ptr = dynamic_cast<String*>(rand.get());
-        std::cout << str_ptr->s;
+// PARALLEL EVALUATION
+// 真正的调度在 parallel.cpp；这里只检查实参
+
+Value FutureFunc::evalRator(const Value &rand) { // future
+    if (rand.type() != V_PROC && rand.type() != V_PRIM && rand.type() != V_MEMO) throw RuntimeError("future: not a procedure");
+    return makeFuture(rand);
+}
+
+Value Touch::evalRator(const Value &rand) { // touch
+    return touchFuture(rand);
+}
+
+Value ParallelMap::evalRator(const Value &rand1, const Value &rand2) { // parallel-map
+    if (rand1.type() != V_PROC && rand1.type() != V_PRIM && rand1.type() != V_MEMO) throw RuntimeError("parallel-map: not a procedure");
+    return parallelMap(rand1, rand2);
+}
+
+// MEMOIZATION
+// 缓存本身在 memo.cpp
+
+Value Memoize::evalRator(const Value *args, int n) { // memoize
+    if (n != 1 && n != 2) throw RuntimeError("Wrong number of arguments");
+    ValueType t = args[0].type();
+    if (t != V_PROC && t != V_PRIM && t != V_MEMO) throw RuntimeError("memoize: not a procedure");
+    if (n == 1) return MemoizedV(args[0], MEMO_DEFAULT_CAPACITY);
+    if (args[1].type() != V_INT || args[1].asInt() <= 0) throw RuntimeError("memoize: capacity must be a positive integer");
+    return MemoizedV(args[0], args[1].asInt());
+}
+
+// LAZY EVALUATION
+// 承诺和流的格子在 stream.cpp
+
+Value Delay::evalRator(const Value &thunk) { // delay, cons-stream
+    return PromiseV(Promise::THUNK, thunk, Value(nullptr));
+}
+
+Value Force::evalRator(const Value &rand) { // force
+    return forcePromise(rand);
+}
+
+Value MakePromise::evalRator(const Value &rand) { // make-promise
+    return ForcedPromiseV(rand);
+}
+
+Value IsPromise::evalRator(const Value &rand) { // promise?
+    return BooleanV(rand.type() == V_PROMISE);
+}
+
+Value StreamCar::evalRator(const Value &rand) { // stream-car
+    if (rand.type() != V_PAIR) throw RuntimeError("stream-car: not a stream");
+    return rand.as<Pair>()->car;
+}
+
+Value StreamCdr::evalRator(const Value &rand) { // stream-cdr
+    return streamCdr(rand);
+}
+
+Value StreamMap::evalRator(const Value &rand1, const Value &rand2) { // stream-map
+    if (rand1.type() != V_PROC && rand1.type() != V_PRIM && rand1.type() != V_MEMO) throw RuntimeError("stream-map: not a procedure");
+    return streamMap(rand1, rand2);
+}
+
+Value StreamFilter::evalRator(const Value &rand1, const Value &rand2) { // stream-filter 作为值被调用
+    return filter(rand1, Value(rand2));
+}
+
+Value StreamFilter::eval(Assoc &e) { // 源流不经过临时变量，交给 filter 以后这里不再留着它
+    Value pred = rand1->eval(e);
+    return filter(pred, rand2->eval(e));
+}
+
+Value StreamFilter::filter(const Value &rand1, Value &&rand2) {
+    if (rand1.type() != V_PROC && rand1.type() != V_PRIM && rand1.type() != V_MEMO) throw RuntimeError("stream-filter: not a procedure");
+    return streamFilter(rand1, std::move(rand2));
+}
+
+Value StreamTake::evalRator(const Value &rand1, const Value &rand2) { // stream-take
+    if (rand2.type() != V_INT || rand2.asInt() < 0) throw RuntimeError("stream-take: count must be a non-negative integer");
+    return streamTake(rand1, rand2.asInt());
+}
+
+Value StreamToList::evalRator(const Value *args, int n) { // stream->list
+    if (n != 1 && n != 2) throw RuntimeError("Wrong number of arguments");
+    if (n == 1) return streamToList(args[0], -1);
+    if (args[1].type() != V_INT || args[1].asInt() < 0) throw RuntimeError("stream->list: count must be a non-negative integer");
+    return streamToList(args[0], args[1].asInt());
+}
+
+Value StringLength::evalRator(const Value &rand) { // string-length
+    if (rand.type() != V_STRING) throw RuntimeError("string-length: not a string");
+    return IntegerV((int)rand.as<String>()->length);
+}
+
+Value StringAppend::evalRator(const Value *args, int n) { // string-append
+    return stringAppend(args, n);
+}
+
+Value Substring::evalRator(const Value *args, int n) { // substring
+    if (n != 2 && n != 3) throw RuntimeError("Wrong number of arguments");
+    if (args[0].type() != V_STRING) throw RuntimeError("substring: not a string");
+    if (args[1].type() != V_INT || (n == 3 && args[2].type() != V_INT)) throw RuntimeError("substring: index must be an integer");
+    int end = n == 3 ? args[2].asInt() : (int)args[0].as<String>()->length;
+    return substring(args[0], args[1].asInt(), end);
+}
+
+Value StringEq::evalRator(const Value &rand1, const Value &rand2) { // string=?
+    return BooleanV(stringCompare(rand1, rand2) == 0);
+}
+
+Value StringLess::evalRator(const Value &rand1, const Value &rand2) { // string<?
+    return BooleanV(stringCompare(rand1, rand2) < 0);
+}
+
+Value StringToSymbol::evalRator(const Value &rand) { // string->symbol
+    if (rand.type() != V_STRING) throw RuntimeError("string->symbol: not a string");
+    return SymbolV(rand.as<String>()->str());
+}
+
+Value SymbolToString::evalRator(const Value &rand) { // symbol->string
+    if (rand.type() != V_SYM) throw RuntimeError("symbol->string: not a symbol");
+    return StringV(atomName(rand.as<Symbol>()->atom));
+}
+
+Value NumberToString::evalRator(const Value &rand) { // number->string
+    if (rand.type() != V_INT && rand.type() != V_BIGINT && rand.type() != V_RATIONAL) throw RuntimeError("number->string: not a number");
+    std::ostringstream os;
+    rand.show(os);
+    return StringV(os.str());
+}
+
+// 只认 reader 认的写法：可选的正负号、十进制数字，可选的 /分母
+static bool isNumberText(const char *p, size_t n) {
+    size_t i = (n > 0 && (p[0] == '+' || p[0] == '-')) ? 1 : 0;
+    size_t digits = 0;
+    while (i < n && p[i] >= '0' && p[i] <= '9') i++, digits++;
+    if (digits == 0) return false;
+    if (i == n) return true;
+    if (p[i++] != '/') return false;
+    bool nonzero = false;
+    for (digits = 0; i < n && p[i] >= '0' && p[i] <= '9'; i++, digits++) nonzero = nonzero || p[i] != '0';
+    return digits > 0 && i == n && nonzero;
+}
+
+Value StringToNumber::evalRator(const Value &rand) { // string->number
+    if (rand.type() != V_STRING) throw RuntimeError("string->number: not a string");
+    const String *s = rand.as<String>();
+    if (!isNumberText(s->data(), s->length)) return BooleanV(false);
+    return numberLiteral(s->str());
+}
+
+// display / write-string 的去处：给了端口就写进端口，否则是标准输出（future 里先攒在任务里）
+static std::ostream &outputTo(const Value *args, int n, int port, const char *who) {
+    if (n > port) {
+        if (args[port].type() != V_PORT) throw RuntimeError(std::string(who) + ": not an output port");
+        return args[port].as<StringPort>()->out;
+    }
+    return task_output != nullptr ? *task_output : std::cout;
+}
+
+Value Display::evalRator(const Value *args, int n) { // display function
+    if (n != 1 && n != 2) throw RuntimeError("Wrong number of arguments");
+    std::ostream &out = outputTo(args, n, 1, "display");
+    if (args[0].type() == V_STRING) {
+        const String *str_ptr = args[0].as<String>();
+        out.write(str_ptr->data(), str_ptr->length);
     } else {
-        rand->show(std::cout);
+        args[0].show(out);
     }
     
     return VoidV();
 }
+
+Value WriteString::evalRator(const Value *args, int n) { // write-string
+    if (n != 1 && n != 2) throw RuntimeError("Wrong number of arguments");
+    if (args[0].type() != V_STRING) throw RuntimeError("write-string: not a string");
+    std::ostream &out = outputTo(args, n, 1, "write-string");
+    const String *s = args[0].as<String>();
+    out.write(s->data(), s->length);
+    return VoidV();
+}
+
+Value OpenOutputString::evalRator(const Value *, int n) { // open-output-string
+    if (n != 0) throw RuntimeError("Wrong number of arguments");
+    return OutputStringV();
+}
+
+Value GetOutputString::evalRator(const Value &rand) { // get-output-string
+    if (rand.type() != V_PORT) throw RuntimeError("get-output-string: not an output port");
+    return StringV(rand.as<StringPort>()->out.str());
+}
+
+Value RuntimeStats::evalRator(const Value *, int n) { // runtime-stats
+    if (n != 0) throw RuntimeError("Wrong number of arguments");
+    return runtimeStats();
+}
@@ -1,7 +1,9 @@
 #include "Def.hpp"
 #include "expr.hpp"
+#include <climits>
 #include <cstring>
 #include <cstdlib>
+#include <string>
 #include <vector>
 using std::vector;
 using std::string;
@@ -41,7 +43,29 @@ RationalNum::RationalNum(int num, int den) : ExprBase(E_RATIONAL), numerator(num
     }
 }
 
-StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str) {}
+// 在 long long 里约分：INT_MIN / -1 和 abs(INT_MIN) 在 int 里都会溢出。
+// 约完以后分子是 INT_MIN（或者绝对值超出 int）的交给 Bignum，RationalNum 里再约一次也不会出事
+Expr rationalLiteral(int num, int den) {
+    long long n = num, d = den;
+    if (d < 0) {
+        n = -n;
+        d = -d;
+    }
+    long long a = n < 0 ? -n : n, b = d;
+    while (b != 0) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    n /= a;
+    d /= a;
+    if (n > INT_MIN && n <= INT_MAX && d <= INT_MAX) return Expr(new RationalNum((int)n, (int)d));
+    return Expr(new Bignum(std::to_string(n) + "/" + std::to_string(d)));
+}
+
+Bignum::Bignum(const std::string &str) : ExprBase(E_BIGNUM), s(str) {}
+
+StringExpr::StringExpr(const std::string &str) : ExprBase(E_STRING), s(str), value(stringLiteral(str)) {}
 
 True::True() : ExprBase(E_TRUE) {}
 
@@ -117,6 +141,44 @@ SetCar::SetCar(const Expr &r1, const Expr &r2) : Binary(E_SETCAR, r1, r2) {}
 
 SetCdr::SetCdr(const Expr &r1, const Expr &r2) : Binary(E_SETCDR, r1, r2) {}
 
+//VECTOR OPERATIONS
+
+MakeVector::MakeVector(const std::vector<Expr> &rands) : Variadic(E_MAKEVECTOR, rands) {}
+
+VectorFunc::VectorFunc(const std::vector<Expr> &rands) : Variadic(E_VECTOR, rands) {}
+
+VectorRef::VectorRef(const Expr &r1, const Expr &r2) : Binary(E_VECTORREF, r1, r2) {}
+
+VectorSet::VectorSet(const std::vector<Expr> &rands) : Variadic(E_VECTORSET, rands) {}
+
+VectorLength::VectorLength(const Expr &r1) : Unary(E_VECTORLENGTH, r1) {}
+
+VectorFill::VectorFill(const Expr &r1, const Expr &r2) : Binary(E_VECTORFILL, r1, r2) {}
+
+ListToVector::ListToVector(const Expr &r1) : Unary(E_LIST2VECTOR, r1) {}
+
+VectorToList::VectorToList(const Expr &r1) : Unary(E_VECTOR2LIST, r1) {}
+
+//HASH TABLE OPERATIONS
+
+MakeHashTable::MakeHashTable(const std::vector<Expr> &rands) : Variadic(E_MAKEHASH, rands) {}
+
+HashTableRef::HashTableRef(const std::vector<Expr> &rands) : Variadic(E_HASHREF, rands) {}
+
+HashTableSet::HashTableSet(const std::vector<Expr> &rands) : Variadic(E_HASHSET, rands) {}
+
+HashTableDelete::HashTableDelete(const Expr &r1, const Expr &r2) : Binary(E_HASHDELETE, r1, r2) {}
+
+HashTableContains::HashTableContains(const Expr &r1, const Expr &r2) : Binary(E_HASHCONTAINS, r1, r2) {}
+
+HashTableCount::HashTableCount(const Expr &r1) : Unary(E_HASHCOUNT, r1) {}
+
+HashTableKeys::HashTableKeys(const Expr &r1) : Unary(E_HASHKEYS, r1) {}
+
+HashTableValues::HashTableValues(const Expr &r1) : Unary(E_HASHVALUES, r1) {}
+
+HashTableToAlist::HashTableToAlist(const Expr &r1) : Unary(E_HASH2ALIST, r1) {}
+
 //LOGIC OPERATIONS
 
 Not::Not(const Expr &r1) : Unary(E_NOT, r1) {}
@@ -129,6 +191,8 @@ OrVar::OrVar(const std::vector<Expr> &rands) : ExprBase(E_OR), rands(rands) {}
 
 IsEq::IsEq(const Expr &r1, const Expr &r2) : Binary(E_EQQ, r1, r2) {}
 
+IsEqual::IsEqual(const Expr &r1, const Expr &r2) : Binary(E_EQUALQ, r1, r2) {}
+
 IsBoolean::IsBoolean(const Expr &r1) : Unary(E_BOOLQ, r1) {}
 
 IsFixnum::IsFixnum(const Expr &r1) : Unary(E_INTQ, r1) {}
@@ -145,11 +209,15 @@ IsList::IsList(const Expr &r1) : Unary(E_LISTQ, r1) {}
 
 IsString::IsString(const Expr &r1) : Unary(E_STRINGQ, r1) {}
 
+IsVector::IsVector(const Expr &r1) : Unary(E_VECTORQ, r1) {}
+
+IsHashTable::IsHashTable(const Expr &r1) : Unary(E_HASHTABLEQ, r1) {}
+
 //CONTROL FLOW CONSTRUCTS
 
 Begin::Begin(const vector<Expr> &vec) : ExprBase(E_BEGIN), es(vec) {}
 
-Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t) {}
+Quote::Quote(const Syntax &t) : ExprBase(E_QUOTE), s(t), datum(quoteDatum(t)) {}
 
 //CONDITIONAL
 
@@ -159,24 +227,88 @@ Cond::Cond(const std::vector<std::vector<Expr>> &cls) : ExprBase(E_COND), clause
 
 //VARIABLE AND FUNCITON DEFINITION
 
-Var::Var(const string &s) : ExprBase(E_VAR), x(s) {}
+Var::Var(const string &s) : ExprBase(E_VAR), x(s), atom(intern(s)), depth(-1), slot(0), cell(nullptr) {}
 
 Apply::Apply(const Expr &expr, const vector<Expr> &vec) : ExprBase(E_APPLY), rator(expr), rand(vec) {}
 
-Lambda::Lambda(const vector<string> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr) {}
+Lambda::Lambda(const vector<Atom> &vec, const Expr &expr) : ExprBase(E_LAMBDA), x(vec), e(expr), name(intern("lambda")) {}
 
-Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr) {}
+Define::Define(const string &variable, const Expr &expr) : ExprBase(E_DEFINE), var(variable), e(expr), cell(nullptr) {}
 
 //BINDING CONSTRUCTS
 
-Let::Let(const vector<pair<string, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
+Let::Let(const vector<pair<Atom, Expr>> &vec, const Expr &e) : ExprBase(E_LET), bind(vec), body(e) {}
 
-Letrec::Letrec(const vector<pair<string, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
+Letrec::Letrec(const vector<pair<Atom, Expr>> &vec, const Expr &expr) : ExprBase(E_LETREC), bind(vec), body(expr) {}
 
 //ASSIGNMENT
 
-Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), e(e) {}
+Set::Set(const std::string &var, const Expr &e) : ExprBase(E_SET), var(var), atom(intern(var)), e(e), depth(-1), slot(0), cell(nullptr) {}
+
+//PARALLEL EVALUATION
+
+FutureFunc::FutureFunc(const Expr &r1) : Unary(E_FUTURE, r1) {}
+
+Touch::Touch(const Expr &r1) : Unary(E_TOUCH, r1) {}
+
+ParallelMap::ParallelMap(const Expr &r1, const Expr &r2) : Binary(E_PARALLELMAP, r1, r2) {}
+
+//MEMOIZATION
+
+Memoize::Memoize(const std::vector<Expr> &rands) : Variadic(E_MEMOIZE, rands) {}
+
+//LAZY EVALUATION
+
+Delay::Delay(const Expr &thunk) : Unary(E_DELAY, thunk) {}
+
+Force::Force(const Expr &r) : Unary(E_FORCE, r) {}
+
+MakePromise::MakePromise(const Expr &r) : Unary(E_MAKEPROMISE, r) {}
+
+IsPromise::IsPromise(const Expr &r) : Unary(E_PROMISEQ, r) {}
+
+StreamCar::StreamCar(const Expr &r) : Unary(E_STREAMCAR, r) {}
+
+StreamCdr::StreamCdr(const Expr &r) : Unary(E_STREAMCDR, r) {}
+
+StreamMap::StreamMap(const Expr &r1, const Expr &r2) : Binary(E_STREAMMAP, r1, r2) {}
+
+StreamFilter::StreamFilter(const Expr &r1, const Expr &r2) : Binary(E_STREAMFILTER, r1, r2) {}
+
+StreamTake::StreamTake(const Expr &r1, const Expr &r2) : Binary(E_STREAMTAKE, r1, r2) {}
+
+StreamToList::StreamToList(const std::vector<Expr> &rands) : Variadic(E_STREAM2LIST, rands) {}
+
+//STRINGS
+
+StringLength::StringLength(const Expr &r) : Unary(E_STRINGLENGTH, r) {}
+
+StringAppend::StringAppend(const std::vector<Expr> &rands) : Variadic(E_STRINGAPPEND, rands) {}
+
+Substring::Substring(const std::vector<Expr> &rands) : Variadic(E_SUBSTRING, rands) {}
+
+StringEq::StringEq(const Expr &r1, const Expr &r2) : Binary(E_STRINGEQ, r1, r2) {}
+
+StringLess::StringLess(const Expr &r1, const Expr &r2) : Binary(E_STRINGLT, r1, r2) {}
+
+StringToSymbol::StringToSymbol(const Expr &r) : Unary(E_STRING2SYMBOL, r) {}
+
+SymbolToString::SymbolToString(const Expr &r) : Unary(E_SYMBOL2STRING, r) {}
+
+NumberToString::NumberToString(const Expr &r) : Unary(E_NUMBER2STRING, r) {}
+
+StringToNumber::StringToNumber(const Expr &r) : Unary(E_STRING2NUMBER, r) {}
 
 //I/O OPERATIONS
 
-Display::Display(const Expr &r) : Unary(E_DISPLAY, r) {}
\ No newline at end of file
+Display::Display(const std::vector<Expr> &rands) : Variadic(E_DISPLAY, rands) {}
+
+WriteString::WriteString(const std::vector<Expr> &rands) : Variadic(E_WRITESTRING, rands) {}
+
+OpenOutputString::OpenOutputString(const std::vector<Expr> &rands) : Variadic(E_OPENOUTPUTSTRING, rands) {}
+
+GetOutputString::GetOutputString(const Expr &r) : Unary(E_GETOUTPUTSTRING, r) {}
+
+//RESOURCE ACCOUNTING
+
+RuntimeStats::RuntimeStats(const std::vector<Expr> &rands) : Variadic(E_RUNTIMESTATS, rands) {}
\ No newline at end of file
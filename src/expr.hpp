@@ -25,10 +25,27 @@ public:
 
 // int gcd(int a, int b);
 
+/**
+ * @brief Compile-time frame used by the resolution pass
+ *
+ * Mirrors the runtime frame that Apply/Let/Letrec build for the same scope,
+ * so a name's position here is its slot index at runtime.
+ */
+struct Scope {
+    std::vector<Atom> names;         ///< Names bound by this scope, in slot order
+    Scope *next;                     ///< Enclosing scope, nullptr at top level
+    Scope(const std::vector<Atom> &, Scope *);
+    bool lookup(Atom, int &, int &) const; // 找到时给出 (depth, slot)
+};
+
+struct TailCall;
+
 struct ExprBase{
     ExprType e_type;
     ExprBase(ExprType);
     virtual Value eval(Assoc &) = 0;
+    virtual Value evalTail(Assoc &, TailCall &); // 尾位置求值：可以把最后一步交回给 trampoline
+    virtual void resolve(Scope *); // 解析变量的词法地址，在 parse 之后、eval 之前调用
     virtual ~ExprBase() = default;
 };
 
@@ -65,6 +82,18 @@ struct RationalNum : ExprBase {
   RationalNum(int num, int den);
   virtual Value eval(Assoc &) override;
 };
+Expr rationalLiteral(int num, int den); ///< A RationalNum, or a Bignum when the reduced parts do not fit it; den != 0
+
+/**
+ * @brief Number literal outside the int range
+ * Keeps the literal's text, integer or numerator/denominator; the VM
+ * turns it into a constant when compiling
+ */
+struct Bignum : ExprBase {
+  std::string s;
+  Bignum(const std::string &);
+  virtual Value eval(Assoc &) override;
+};
 
 /**
  * @brief String literal expression
@@ -72,6 +101,7 @@ struct RationalNum : ExprBase {
  */
 struct StringExpr : ExprBase {
   std::string s;
+  std::shared_ptr<Value> value;  ///< Built once; strings are immutable, so every evaluation shares it
   StringExpr(const std::string &);
   virtual Value eval(Assoc &) override;
 };
@@ -111,6 +141,7 @@ struct Unary : ExprBase {
     Unary(ExprType, const Expr &);
     virtual Value evalRator(const Value &) = 0;
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Binary : ExprBase {
@@ -119,13 +150,15 @@ struct Binary : ExprBase {
     Binary(ExprType, const Expr &, const Expr &);
     virtual Value evalRator(const Value &, const Value &) = 0;
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Variadic : ExprBase {
     std::vector<Expr> rands;
     Variadic(ExprType, const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) = 0;
+    virtual Value evalRator(const Value *, int) = 0; ///< n operands in a row: VM stack slots or an ArgBuffer
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -164,22 +197,22 @@ struct Expt : Binary {
 
 struct PlusVar : Variadic {
     PlusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct MinusVar : Variadic {
     MinusVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct MultVar : Variadic {
     MultVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct DivVar : Variadic {
     DivVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 // ================================================================================
@@ -213,27 +246,27 @@ struct Greater : Binary {
 
 struct LessVar : Variadic {
     LessVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct LessEqVar : Variadic {
     LessEqVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct EqualVar : Variadic {
     EqualVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct GreaterEqVar : Variadic {
     GreaterEqVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct GreaterVar : Variadic {
     GreaterVar(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 // ================================================================================
@@ -257,7 +290,7 @@ struct Cdr : Unary {
 
 struct ListFunc : Variadic {
     ListFunc(const std::vector<Expr> &);
-    virtual Value evalRator(const std::vector<Value> &) override;
+    virtual Value evalRator(const Value *, int) override;
 };
 
 struct SetCar : Binary {
@@ -270,6 +303,99 @@ struct SetCdr : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+// ================================================================================
+//                             VECTOR OPERATIONS
+// ================================================================================
+
+struct MakeVector : Variadic { // (make-vector k) 或 (make-vector k fill)
+    MakeVector(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct VectorFunc : Variadic {
+    VectorFunc(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct VectorRef : Binary {
+    VectorRef(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct VectorSet : Variadic { // 三个操作数，没有 Ternary 节点
+    VectorSet(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct VectorLength : Unary {
+    VectorLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct VectorFill : Binary {
+    VectorFill(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct ListToVector : Unary {
+    ListToVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct VectorToList : Unary {
+    VectorToList(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+// ================================================================================
+//                             HASH TABLE OPERATIONS
+// ================================================================================
+
+struct MakeHashTable : Variadic { // (make-hash-table) 或 (make-hash-table eq?)，默认按 equal?
+    MakeHashTable(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct HashTableRef : Variadic { // 第三个操作数是找不到时的默认值，没有就报错
+    HashTableRef(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct HashTableSet : Variadic {
+    HashTableSet(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct HashTableDelete : Binary {
+    HashTableDelete(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct HashTableContains : Binary {
+    HashTableContains(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct HashTableCount : Unary {
+    HashTableCount(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct HashTableKeys : Unary {
+    HashTableKeys(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct HashTableValues : Unary {
+    HashTableValues(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct HashTableToAlist : Unary {
+    HashTableToAlist(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                             LOGIC OPERATIONS
 // ================================================================================
@@ -283,12 +409,16 @@ struct AndVar : ExprBase {
     std::vector<Expr> rands;
     AndVar(const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;  
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct OrVar : ExprBase {
     std::vector<Expr> rands;
     OrVar(const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -300,6 +430,11 @@ struct IsEq : Binary {
     virtual Value evalRator(const Value &, const Value &) override;
 };
 
+struct IsEqual : Binary {
+    IsEqual(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
 struct IsBoolean : Unary {
     IsBoolean(const Expr &);
     virtual Value evalRator(const Value &) override;
@@ -340,6 +475,16 @@ struct IsString : Unary {
     virtual Value evalRator(const Value &) override;
 };
 
+struct IsVector : Unary {
+    IsVector(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsHashTable : Unary {
+    IsHashTable(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
 // ================================================================================
 //                             CONTROL FLOW CONSTRUCTS
 // ================================================================================
@@ -348,14 +493,26 @@ struct Begin : ExprBase {
     std::vector<Expr> es;
     Begin(const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
+/**
+ * @brief Quoted datum
+ * The value is built once, when the node is made, and every evaluation
+ * returns that same object. A datum that cannot be built (a misplaced dot)
+ * is left null, so the error still surfaces when the quote is evaluated.
+ */
 struct Quote : ExprBase {
   Syntax s;
+  std::shared_ptr<Value> datum;  ///< s as a value, nullptr if it is malformed
   Quote(const Syntax &);
   virtual Value eval(Assoc &) override;
 };
 
+std::shared_ptr<Value> quoteDatum(const Syntax &); // evaluation.cpp
+std::shared_ptr<Value> stringLiteral(const std::string &); // evaluation.cpp
+
 // ================================================================================
 //                             CONDITIONALS
 // ================================================================================
@@ -366,12 +523,16 @@ struct If : ExprBase {
   Expr alter;
   If(const Expr &, const Expr &, const Expr &);
   virtual Value eval(Assoc &) override;
+  virtual Value evalTail(Assoc &, TailCall &) override;
+  virtual void resolve(Scope *) override;
 };
 
 struct Cond : ExprBase {
     std::vector<std::vector<Expr>> clauses;
     Cond(const std::vector<std::vector<Expr>> &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -380,8 +541,13 @@ struct Cond : ExprBase {
 
 struct Var : ExprBase {
     std::string x;
+    Atom atom;    ///< Interned x
+    int depth;    ///< Frame depth of a local binding, -1 for a global one
+    int slot;     ///< Slot index inside that frame
+    Value *cell;  ///< Global binding cell, used when depth == -1
     Var(const std::string &);
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Apply : ExprBase {
@@ -389,20 +555,29 @@ struct Apply : ExprBase {
     std::vector<Expr> rand;
     Apply(const Expr &, const std::vector<Expr> &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
+struct Code;
+
 struct Lambda : ExprBase {
-    std::vector<std::string> x;
+    std::vector<Atom> x;
     Expr e;
-    Lambda(const std::vector<std::string> &, const Expr &);
+    std::shared_ptr<Code> code;  ///< Compiled body, filled in by the VM on first use
+    Atom name;                   ///< define'd name, or lambda@line:column; reported by --profile
+    Lambda(const std::vector<Atom> &, const Expr &);
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Define : ExprBase {
     std::string var;
     Expr e;
+    Value *cell;  ///< Global binding cell of var
     Define(const std::string &, const Expr &);
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -410,17 +585,21 @@ struct Define : ExprBase {
 // ================================================================================
 
 struct Let : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Atom, Expr>> bind;
     Expr body;
-    Let(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
+    Let(const std::vector<std::pair<Atom, Expr>> &, const Expr &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 struct Letrec : ExprBase {
-    std::vector<std::pair<std::string, Expr>> bind;
+    std::vector<std::pair<Atom, Expr>> bind;
     Expr body;
-    Letrec(const std::vector<std::pair<std::string, Expr>> &, const Expr &);
+    Letrec(const std::vector<std::pair<Atom, Expr>> &, const Expr &);
     virtual Value eval(Assoc &) override;
+    virtual Value evalTail(Assoc &, TailCall &) override;
+    virtual void resolve(Scope *) override;
 };
 
 // ================================================================================
@@ -429,18 +608,196 @@ struct Letrec : ExprBase {
 
 struct Set : ExprBase {
     std::string var;
+    Atom atom;    ///< Interned var
     Expr e;
+    int depth;    ///< Same addressing as Var
+    int slot;
+    Value *cell;
     Set(const std::string &, const Expr &);
     virtual Value eval(Assoc &) override;
+    virtual void resolve(Scope *) override;
+};
+
+// ================================================================================
+//                           PARALLEL EVALUATION
+// ================================================================================
+
+struct FutureFunc : Unary {
+    FutureFunc(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Touch : Unary {
+    Touch(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct ParallelMap : Binary {
+    ParallelMap(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+// ================================================================================
+//                               MEMOIZATION
+// ================================================================================
+
+struct Memoize : Variadic {
+    Memoize(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+// ================================================================================
+//                             LAZY EVALUATION
+// ================================================================================
+
+/**
+ * @brief (delay e): rand is the thunk (lambda () e), wrapped into a promise
+ * cons-stream parses into a Cons whose second operand is one of these
+ */
+struct Delay : Unary {
+    Delay(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct Force : Unary {
+    Force(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct MakePromise : Unary {
+    MakePromise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct IsPromise : Unary {
+    IsPromise(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StreamCar : Unary {
+    StreamCar(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StreamCdr : Unary {
+    StreamCdr(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StreamMap : Binary {
+    StreamMap(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct StreamFilter : Binary {
+    StreamFilter(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+    virtual Value eval(Assoc &) override;
+    Value filter(const Value &, Value &&); ///< Takes the stream over, so the cells it skips are freed (OP_STREAM_FILTER)
+};
+
+struct StreamTake : Binary {
+    StreamTake(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct StreamToList : Variadic { // (stream->list s) 或 (stream->list s n)
+    StreamToList(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+// ================================================================================
+//                                 STRINGS
+// ================================================================================
+
+struct StringLength : Unary {
+    StringLength(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StringAppend : Variadic {
+    StringAppend(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct Substring : Variadic { // (substring s start) 或 (substring s start end)
+    Substring(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct StringEq : Binary {
+    StringEq(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct StringLess : Binary {
+    StringLess(const Expr &, const Expr &);
+    virtual Value evalRator(const Value &, const Value &) override;
+};
+
+struct StringToSymbol : Unary {
+    StringToSymbol(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct SymbolToString : Unary {
+    SymbolToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct NumberToString : Unary {
+    NumberToString(const Expr &);
+    virtual Value evalRator(const Value &) override;
+};
+
+struct StringToNumber : Unary {
+    StringToNumber(const Expr &);
+    virtual Value evalRator(const Value &) override;
 };
 
 // ================================================================================
 //                              I/O OPERATIONS
 // ================================================================================
 
-struct Display : Unary {
-    Display(const Expr &);
+struct Display : Variadic { // (display v) 或 (display v port)
+    Display(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct WriteString : Variadic { // (write-string s) 或 (write-string s port)
+    WriteString(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct OpenOutputString : Variadic {
+    OpenOutputString(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+struct GetOutputString : Unary {
+    GetOutputString(const Expr &);
     virtual Value evalRator(const Value &) override;
 };
 
+// ================================================================================
+//                           RESOURCE ACCOUNTING
+// ================================================================================
+
+struct RuntimeStats : Variadic { // (runtime-stats)，见 limits.hpp
+    RuntimeStats(const std::vector<Expr> &);
+    virtual Value evalRator(const Value *, int) override;
+};
+
+/**
+ * @brief Simplify a parsed tree before it is resolved (optimize.cpp)
+ *
+ * Folds primitive applications whose operands are all literals into a
+ * literal (when the result is a number or a boolean), picks the branch of
+ * an if with a literal test, flattens nested begins and unwraps
+ * single-expression ones, and drops let bindings that are never referenced
+ * and whose initializers cannot have effects. Runs before resolve, so the
+ * lexical addresses it computes match the simplified tree.
+ */
+Expr optimize(const Expr &);
+
 #endif
@@ -0,0 +1,196 @@
+/**
+ * @file gc.cpp
+ * @brief Cycle collector over the tracked container objects
+ */
+
+#include "gc.hpp"
+#include "parallel.hpp"
+#include "value.hpp"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// 两代：新对象进 0 代，0 代收集后幸存的晋升到 1 代
+static const size_t YOUNG_THRESHOLD = 5000; // 0 代攒够这么多对象就安排一次收集
+static const size_t FULL_EVERY = 10;        // 每 10 次 0 代收集考虑一次全量收集
+
+// 收集过程中 gc_refs 的特殊取值
+static const long REFS_UNKNOWN = -1;   // 还没有从内部引用看到过它
+static const long REFS_REACHABLE = -2; // 已确认可达
+static const long REFS_HELD = -3;      // 垃圾，已经被 hold 住
+
+// 都是 POD：全局对象退出时析构、往链表里摘除节点也是安全的
+static GcObject *gen_head[2];
+static size_t gen_count[2];
+static size_t old_after_full; // 上次全量收集后 1 代的大小
+static size_t young_collections;
+std::atomic<bool> gc_pending(false);
+GcStats gc_stats;
+
+// 有 worker 线程以后，主线程建的对象可能在 worker 上析构，进出链表都要加锁
+static bool shared;
+static std::mutex lists_lock;
+static thread_local bool worker;
+
+static void link(GcObject *o, int gen) {
+    o->gc_gen = gen;
+    o->gc_prev = nullptr;
+    o->gc_next = gen_head[gen];
+    if (gen_head[gen] != nullptr) gen_head[gen]->gc_prev = o;
+    gen_head[gen] = o;
+    gen_count[gen]++;
+}
+
+static void unlink(GcObject *o) {
+    if (o->gc_prev != nullptr) o->gc_prev->gc_next = o->gc_next;
+    else gen_head[o->gc_gen] = o->gc_next;
+    if (o->gc_next != nullptr) o->gc_next->gc_prev = o->gc_prev;
+    gen_count[o->gc_gen]--;
+}
+
+GcObject::GcObject() : gc_refs(0) {
+    std::unique_lock<std::mutex> lock(lists_lock, std::defer_lock);
+    if (shared) lock.lock();
+    link(this, 0);
+    if (gen_count[0] > YOUNG_THRESHOLD) gc_pending.store(true, std::memory_order_relaxed); // 构造中途不能收集，等下一个 safepoint
+}
+
+GcObject::~GcObject() {
+    std::unique_lock<std::mutex> lock(lists_lock, std::defer_lock);
+    if (shared) lock.lock();
+    unlink(this);
+}
+
+void gcShare() {
+    shared = true;
+}
+
+void gcWorkerThread() {
+    worker = true;
+}
+
+// 把一条引用（Value 或 Assoc 里的 shared_ptr）解析成正在收集的那一代里的对象
+template <typename Visit>
+struct EdgeVisitor : GcVisitor {
+    int gen;
+    Visit &f;
+    EdgeVisitor(int gen, Visit &f) : gen(gen), f(f) {}
+    virtual void visit(const Value &v) override {
+        if (!v.ptr) return;
+        GcObject *o = v.ptr->gcObject();
+        if (o != nullptr && o->gc_gen == gen) f(o, v.ptr);
+    }
+    virtual void visit(const Assoc &a) override {
+        if (a.ptr && a.ptr->gc_gen == gen) f(a.ptr.get(), a.ptr);
+    }
+};
+
+// 第一次遇到时从 use_count 取总引用数，再减去每一条内部引用
+struct SubtractRefs {
+    template <typename P>
+    void operator()(GcObject *o, const P &p) {
+        if (o->gc_refs == REFS_UNKNOWN) o->gc_refs = p.use_count();
+        o->gc_refs--;
+    }
+};
+
+struct MarkReachable {
+    std::vector<GcObject *> &work;
+    MarkReachable(std::vector<GcObject *> &work) : work(work) {}
+    template <typename P>
+    void operator()(GcObject *o, const P &) {
+        if (o->gc_refs == REFS_REACHABLE) return;
+        o->gc_refs = REFS_REACHABLE;
+        work.push_back(o);
+    }
+};
+
+// 为每个垃圾对象拿一份强引用，清理引用的过程中它们就不会提前析构
+struct HoldGarbage {
+    std::vector<std::shared_ptr<void>> &held;
+    std::vector<GcObject *> &garbage;
+    HoldGarbage(std::vector<std::shared_ptr<void>> &held, std::vector<GcObject *> &garbage)
+        : held(held), garbage(garbage) {}
+    template <typename P>
+    void operator()(GcObject *o, const P &p) {
+        if (o->gc_refs != 0) return;
+        o->gc_refs = REFS_HELD;
+        held.push_back(p);
+        garbage.push_back(o);
+    }
+};
+
+static void collect(int gen) {
+    for (GcObject *o = gen_head[gen]; o != nullptr; o = o->gc_next) o->gc_refs = REFS_UNKNOWN;
+
+    SubtractRefs subtract;
+    EdgeVisitor<SubtractRefs> subtract_edges(gen, subtract);
+    for (GcObject *o = gen_head[gen]; o != nullptr; o = o->gc_next) o->traverse(subtract_edges);
+
+    // 还剩外部引用（或者根本没有被内部引用过）的就是根
+    std::vector<GcObject *> work;
+    MarkReachable mark(work);
+    EdgeVisitor<MarkReachable> mark_edges(gen, mark);
+    for (GcObject *o = gen_head[gen]; o != nullptr; o = o->gc_next) {
+        if (o->gc_refs != 0 && o->gc_refs != REFS_REACHABLE) {
+            o->gc_refs = REFS_REACHABLE;
+            work.push_back(o);
+        }
+        while (!work.empty()) {
+            GcObject *r = work.back();
+            work.pop_back();
+            r->traverse(mark_edges);
+        }
+    }
+
+    // 剩下 gc_refs == 0 的只被同样不可达的对象引用
+    std::vector<std::shared_ptr<void>> held;
+    std::vector<GcObject *> garbage;
+    HoldGarbage hold(held, garbage);
+    EdgeVisitor<HoldGarbage> hold_edges(gen, hold);
+    for (GcObject *o = gen_head[gen]; o != nullptr; o = o->gc_next) {
+        if (o->gc_refs == REFS_HELD || o->gc_refs == 0) o->traverse(hold_edges);
+    }
+    for (GcObject *o : garbage) o->clearRefs();
+
+    // 幸存者（连同即将释放的垃圾）整体并入 1 代
+    if (gen == 0) {
+        while (gen_head[0] != nullptr) {
+            GcObject *o = gen_head[0];
+            unlink(o);
+            link(o, 1);
+        }
+    }
+    gc_stats.collections[gen]++;
+    gc_stats.collected += garbage.size();
+    held.clear(); // 引用计数归零，垃圾在这里真正析构
+}
+
+void gcCollect(int generation) {
+    if (generation >= 1) {
+        // 全量收集：先把 0 代并进 1 代，一起处理
+        while (gen_head[0] != nullptr) {
+            GcObject *o = gen_head[0];
+            unlink(o);
+            link(o, 1);
+        }
+        collect(1);
+        old_after_full = gen_count[1];
+    } else {
+        collect(0);
+    }
+}
+
+void gcRunPending() {
+    if (worker) return; // worker 线程不收集，留给主线程
+    WorkerPause pause;     // 收集期间 worker 既不在跑也不会开始跑，链表和引用计数都不会变
+    if (!pause.idle) return; // gc_pending 留着，等 worker 都停下来后的下一个 safepoint
+    gc_pending.store(false, std::memory_order_relaxed);
+    young_collections++;
+    // 和 CPython 一样，1 代增长不到四分之一时不做全量收集，避免大堆上反复整体扫描
+    if (young_collections % FULL_EVERY == 0 && gen_count[1] > old_after_full + old_after_full / 4) {
+        gcCollect(1);
+    } else {
+        gcCollect(0);
+    }
+}
@@ -0,0 +1,87 @@
+#ifndef GC_HPP
+#define GC_HPP
+
+/**
+ * @file gc.hpp
+ * @brief Generational cycle collector for container values
+ *
+ * Reference counting (the shared_ptr in Value / Assoc) still frees acyclic
+ * garbage immediately. A value that holds other values or an environment
+ * can be reached again through what it holds -- a pair or vector stored
+ * in itself, a closure stored in its own frame -- so every such type
+ * (pairs, vectors, procedures and environment frames among them)
+ * additionally derives from GcObject and lives on one of two generation
+ * lists. A collection never needs an explicit root
+ * set: for every tracked object the references coming from other tracked
+ * objects of the same generation are subtracted from its refcount, and
+ * whatever is left over is held from outside (REPL env, global_env, a C++
+ * frame on the eval stack) and is a root. Objects not reachable from a
+ * root are unreachable cycles; their references are cleared, which lets the
+ * refcounts drop to zero.
+ *
+ * Only the main thread collects. Objects made on pool worker threads
+ * (parallel.hpp) are tracked like any other, so a cycle built inside a
+ * future is collected once it is dropped; once workers exist the
+ * generation lists are locked, and a collection waits until no worker is
+ * running a task.
+ */
+
+#include <atomic>
+#include <cstddef>
+
+struct Value;
+struct Assoc;
+
+/**
+ * @brief Callback for GcObject::traverse, called once per outgoing reference
+ */
+struct GcVisitor {
+    virtual void visit(const Value &) = 0;
+    virtual void visit(const Assoc &) = 0;
+};
+
+/**
+ * @brief Intrusive header of an object tracked by the cycle collector
+ */
+struct GcObject {
+    GcObject *gc_prev;  ///< Neighbours in the generation list
+    GcObject *gc_next;
+    long gc_refs;       ///< Scratch count used during a collection
+    int gc_gen;         ///< Generation the object lives in (0 young, 1 old)
+    GcObject();         ///< Links the object into the young generation
+    GcObject(const GcObject &) = delete;
+    GcObject &operator=(const GcObject &) = delete;
+    virtual ~GcObject();
+    virtual void traverse(GcVisitor &) = 0; ///< Visit every Value / Assoc held
+    virtual void clearRefs() = 0;           ///< Drop every Value / Assoc held (breaks the cycle)
+};
+
+/**
+ * @brief Collector counters, reported by --alloc-stats
+ */
+struct GcStats {
+    size_t collections[2];  ///< Collections run, per generation
+    size_t collected;       ///< Objects freed by breaking cycles
+};
+extern GcStats gc_stats;
+
+void gcCollect(int generation); ///< Collect the given generation (1 also collects 0)
+
+extern std::atomic<bool> gc_pending;
+void gcRunPending();
+
+void gcShare();         ///< Worker threads are about to start: lock the generation lists from now on
+void gcWorkerThread();  ///< The calling thread never collects; gc_pending waits for the main thread
+
+/**
+ * @brief Run a collection if enough young objects piled up
+ *
+ * Only called where every live value is owned by a Value or Assoc (the
+ * start of a procedure application and between top-level forms), never
+ * while an object is half constructed.
+ */
+inline void gcSafepoint() {
+    if (gc_pending.load(std::memory_order_relaxed)) gcRunPending();
+}
+
+#endif // GC_HPP
@@ -0,0 +1,251 @@
+/**
+ * @file hashtable.cpp
+ * @brief equal?, hashing and the open-addressing HashTable
+ */
+
+#include "hashtable.hpp"
+#include "bigint.hpp"
+#include "strings.hpp"
+#include "pool.hpp"
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
+
+static const size_t MIN_SLOTS = 8;
+static const int HASH_BUDGET = 32; // hashEqual 最多看这么多个节点
+static const size_t EQUAL_BUDGET = 100000; // valuesEqual 比过这么多个 pair / 向量之后开始记录走过的节点对
+
+// splitmix64 的收尾：把相邻的整数、对齐的指针打散到所有位上
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static inline uint64_t combine(uint64_t h, uint64_t x) {
+    return mix(h ^ (x + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2)));
+}
+
+// ============================================================================
+// equal?
+// ============================================================================
+
+namespace {
+
+struct NodePairHash {
+    size_t operator()(const std::pair<const void *, const void *> &p) const {
+        return (size_t)combine(mix((uint64_t)(uintptr_t)p.first), (uint64_t)(uintptr_t)p.second);
+    }
+};
+
+} // namespace
+
+// 不递归：pair 的 car 和向量元素压到 todo 上，cdr 方向就地往下走，长表不会让 todo 变大。
+// 比过 EQUAL_BUDGET 个节点还没完，就可能是成环的结构：之后每对 (x, y) 只比一次，
+// 再遇到时按相等处理（哪里不同，第一次比它的时候就会发现），所以在环上也会停
+bool valuesEqual(const Value &a, const Value &b) {
+    if (a.same(b)) return true;
+    if (a.type() != b.type()) return false;  // 大多数键到这里就分出结果，不必分配 todo
+    std::vector<std::pair<const Value *, const Value *>> todo;
+    std::unordered_set<std::pair<const void *, const void *>, NodePairHash> seen;
+    size_t steps = 0;
+    // 这一对节点之前已经开始比了
+    auto again = [&](const void *p, const void *q) {
+        return ++steps > EQUAL_BUDGET && !seen.insert({p, q}).second;
+    };
+    todo.push_back({&a, &b});
+    while (!todo.empty()) {
+        const Value *x = todo.back().first, *y = todo.back().second;
+        todo.pop_back();
+        while (!x->same(*y)) {
+            if (x->type() != y->type()) return false; // 整数总是规范的，fixnum 和 bignum 不会相等
+            switch (x->type()) {
+                case V_PAIR: {
+                    const Pair *p = x->as<Pair>(), *q = y->as<Pair>();
+                    if (again(p, q)) break;
+                    todo.push_back({&p->car, &q->car});
+                    x = &p->cdr;
+                    y = &q->cdr;
+                    continue;
+                }
+                case V_VECTOR: {
+                    const HeapVector<Value> &u = x->as<Vector>()->items, &v = y->as<Vector>()->items;
+                    if (u.size() != v.size()) return false;
+                    if (again(&u, &v)) break;
+                    for (size_t i = 0; i < u.size(); i++) todo.push_back({&u[i], &v[i]});
+                    break;
+                }
+                case V_STRING:
+                    if (!stringEqual(x->as<String>(), y->as<String>())) return false;
+                    break;
+                case V_BIGINT:
+                    if (intCompare(*x, *y) != 0) return false;
+                    break;
+                case V_RATIONAL: {
+                    const Rational *r = x->as<Rational>(), *s = y->as<Rational>();
+                    if (intCompare(r->numerator, s->numerator) != 0 || intCompare(r->denominator, s->denominator) != 0) return false;
+                    break;
+                }
+                default: // 过程、哈希表，以及 tag 相同但值不同的立即数
+                    return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+// ============================================================================
+// Hashing
+// ============================================================================
+
+size_t hashEq(const Value &v) {
+    if (v.type() == V_SYM) return (size_t)mix(((uint64_t)V_SYM << 32) | v.as<Symbol>()->atom);
+    if (v.isImmediate()) return (size_t)mix(((uint64_t)v.type() << 32) | (uint32_t)v.imm);
+    return (size_t)mix((uint64_t)(uintptr_t)v.get());
+}
+
+static uint64_t hashIntegerValue(const Value &v) {
+    if (v.type() == V_INT) return mix((uint32_t)v.asInt());
+    const BigInt *b = v.as<BigInt>();
+    uint64_t h = b->negative ? 1 : 2;
+    for (uint32_t limb : b->limbs) h = combine(h, limb);
+    return h;
+}
+
+static uint64_t hashEqualIn(const Value &v, int &budget) {
+    if (--budget < 0) return 0;
+    switch (v.type()) {
+        case V_INT:
+        case V_BIGINT:
+            return hashIntegerValue(v);
+        case V_RATIONAL: {
+            const Rational *r = v.as<Rational>();
+            return combine(hashIntegerValue(r->numerator), hashIntegerValue(r->denominator));
+        }
+        case V_STRING: { // FNV-1a
+            uint64_t h = 0xcbf29ce484222325ULL;
+            const String *s = v.as<String>();
+            const unsigned char *c = (const unsigned char *)s->data();
+            for (size_t i = 0; i < s->length; i++) h = (h ^ c[i]) * 0x100000001b3ULL;
+            return mix(h);
+        }
+        case V_PAIR: {
+            uint64_t h = V_PAIR;
+            const Value *at = &v;
+            while (at->type() == V_PAIR && budget > 0) { // cdr 方向循环，car 方向递归由 budget 限住
+                h = combine(h, hashEqualIn(at->as<Pair>()->car, budget));
+                at = &at->as<Pair>()->cdr;
+            }
+            return at->type() == V_PAIR ? h : combine(h, hashEqualIn(*at, budget));
+        }
+        case V_VECTOR: {
+            const HeapVector<Value> &items = v.as<Vector>()->items;
+            uint64_t h = combine(V_VECTOR, items.size());
+            for (size_t i = 0; i < items.size() && budget > 0; i++) h = combine(h, hashEqualIn(items[i], budget));
+            return h;
+        }
+        default:
+            return hashEq(v);
+    }
+}
+
+size_t hashEqual(const Value &v) {
+    int budget = HASH_BUDGET;
+    return (size_t)hashEqualIn(v, budget);
+}
+
+// ============================================================================
+// HashTable
+// ============================================================================
+
+HashTable::Slot::Slot() : key(nullptr), value(nullptr), hash(0), state(EMPTY) {}
+
+HashTable::HashTable(bool by_equal) : ValueBase(V_HASHTABLE), by_equal(by_equal), count(0), used(0) {}
+
+HashTable::Slot *HashTable::lookup(const Value &key, size_t h) {
+    if (slots.empty()) return nullptr;
+    size_t mask = slots.size() - 1;
+    for (size_t i = h & mask;; i = (i + 1) & mask) {
+        Slot &s = slots[i];
+        if (s.state == EMPTY) return nullptr;
+        if (s.state == FULL && s.hash == h && (by_equal ? valuesEqual(s.key, key) : s.key.same(key))) return &s;
+    }
+}
+
+Value *HashTable::find(const Value &key) {
+    Slot *s = lookup(key, by_equal ? hashEqual(key) : hashEq(key));
+    return s == nullptr ? nullptr : &s->value;
+}
+
+// 重新分配到至少两倍于活元素的容量，顺便扔掉所有 DELETED
+void HashTable::grow() {
+    size_t size = MIN_SLOTS;
+    while (size < 2 * (count + 1)) size *= 2;
+    HeapVector<Slot> old(size);
+    old.swap(slots);
+    size_t mask = size - 1;
+    for (Slot &s : old) {
+        if (s.state != FULL) continue;
+        size_t i = s.hash & mask;
+        while (slots[i].state != EMPTY) i = (i + 1) & mask;
+        slots[i] = std::move(s);
+    }
+    used = count;
+}
+
+void HashTable::set(const Value &key, const Value &value) {
+    size_t h = by_equal ? hashEqual(key) : hashEq(key);
+    if (Slot *s = lookup(key, h)) {
+        s->value = value;
+        return;
+    }
+    if ((used + 1) * 4 > slots.size() * 3) grow();
+    size_t mask = slots.size() - 1;
+    size_t i = h & mask;
+    while (slots[i].state == FULL) i = (i + 1) & mask; // 第一个空位或者删掉的位都能用
+    if (slots[i].state == EMPTY) used++;
+    slots[i].key = key;
+    slots[i].value = value;
+    slots[i].hash = h;
+    slots[i].state = FULL;
+    count++;
+}
+
+bool HashTable::erase(const Value &key) {
+    Slot *s = lookup(key, by_equal ? hashEqual(key) : hashEq(key));
+    if (s == nullptr) return false;
+    s->key = Value(nullptr);
+    s->value = Value(nullptr);
+    s->state = DELETED; // 留个墓碑，后面同一条探测链上的键还找得到
+    count--;
+    return true;
+}
+
+void HashTable::show(std::ostream &os) {
+    os << "#<hash-table>";
+}
+
+GcObject *HashTable::gcObject() {
+    return this;
+}
+
+void HashTable::traverse(GcVisitor &v) {
+    for (Slot &s : slots) {
+        if (s.state != FULL) continue;
+        v.visit(s.key);
+        v.visit(s.value);
+    }
+}
+
+void HashTable::clearRefs() {
+    slots.clear();
+    count = used = 0;
+}
+
+Value HashTableV(bool by_equal) {
+    return Value(poolNew<HashTable>(by_equal));
+}
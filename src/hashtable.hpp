@@ -0,0 +1,23 @@
+#ifndef HASHTABLE_HPP
+#define HASHTABLE_HPP
+
+/**
+ * @file hashtable.hpp
+ * @brief equal? and the two hash functions behind HashTable
+ *
+ * hashEq agrees with eq? (Value::same): symbols hash their atom ID, other
+ * immediates their tag and payload, everything else its address.
+ * valuesEqual terminates on circular pairs and vectors too, as R7RS asks
+ * of equal?. hashEqual agrees with valuesEqual: numbers, strings, pairs and vectors
+ * hash their contents, looking at a bounded number of elements so long or
+ * circular structure still hashes in constant time.
+ */
+
+#include "value.hpp"
+#include <cstddef>
+
+bool valuesEqual(const Value &, const Value &); ///< equal?
+size_t hashEq(const Value &);
+size_t hashEqual(const Value &);
+
+#endif // HASHTABLE_HPP
@@ -0,0 +1,1191 @@
+/**
+ * @file image.cpp
+ * @brief Writing and loading of environment images
+ *
+ * Layout, all integers little-endian as written by the host:
+ *
+ *   magic, version
+ *   atoms    count, then each name
+ *   nodes    count, then each Expr node after its children (post-order),
+ *            children referred to by index
+ *   objects  count, then one header per object (kind and immutable
+ *            payload), then one link record per object (car/cdr, vector
+ *            items, closure env, frame slots / next) -- the two passes let shared and
+ *            circular structure be rebuilt without recursion
+ *   globals  count, then (name, value) pairs
+ *   checksum 64-bit FNV-1a of every byte before it
+ *
+ * Identifiers are stored as indices into the atom table. Besides the
+ * checksum, the loader checks every reference and every lexical address
+ * (Var / Set depth and slot) against the scopes and frames that will hold
+ * it, so a damaged or hand-made image is refused instead of being run.
+ */
+
+#include "image.hpp"
+#include "Def.hpp"
+#include "RE.hpp"
+#include "atom.hpp"
+#include "bigint.hpp"
+#include "expr.hpp"
+#include "parallel.hpp"
+#include "strings.hpp"
+#include "syntax.hpp"
+#include "value.hpp"
+#include "vm.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+extern std::map<std::string, ExprType> primitives;
+
+namespace {
+
+const char IMAGE_MAGIC[8] = {'S', 'C', 'M', 'I', 'M', 'A', 'G', 'E'};
+const uint32_t IMAGE_VERSION = 12;
+const uint32_t NO_FRAME = 0xffffffffu;
+const uint8_t K_FRAME = 0xff; // 对象表里 frame 的种类，其余种类直接用 ValueType
+
+// 节点的形状：Unary / Binary / Variadic 靠 e_type 区分不了（PlusVar 和 Plus 都是 E_PLUS）
+enum NodeShape : uint8_t { S_UNARY, S_BINARY, S_VARIADIC, S_OTHER };
+
+enum SyntaxKind : uint8_t { X_NUMBER, X_RATIONAL, X_TRUE, X_FALSE, X_SYMBOL, X_STRING, X_LIST, X_BIGNUM, X_VECTOR };
+
+uint64_t checksum(const char *p, size_t n) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < n; i++) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+struct Out {
+    std::string buf;
+    void u8(uint8_t x) { buf.push_back((char)x); }
+    void u32(uint32_t x) { buf.append((const char *)&x, sizeof(x)); }
+    void i32(int32_t x) { buf.append((const char *)&x, sizeof(x)); }
+    void u64(uint64_t x) { buf.append((const char *)&x, sizeof(x)); }
+    void str(const std::string &s) {
+        u32((uint32_t)s.size());
+        buf += s;
+    }
+};
+
+struct In {
+    const char *p;
+    const char *end;
+    void need(size_t n) {
+        if ((size_t)(end - p) < n) throw RuntimeError("image: truncated");
+    }
+    uint8_t u8() {
+        need(1);
+        return (uint8_t)*p++;
+    }
+    uint32_t u32() {
+        uint32_t x;
+        need(sizeof(x));
+        std::memcpy(&x, p, sizeof(x));
+        p += sizeof(x);
+        return x;
+    }
+    int32_t i32() { return (int32_t)u32(); }
+    uint32_t count() { // 元素个数；每个元素至少占一个字节，超过剩余长度就是坏文件
+        uint32_t n = u32();
+        need(n);
+        return n;
+    }
+    std::string str() {
+        uint32_t n = u32();
+        need(n);
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+};
+
+// ============================================================================
+// Writing
+// ============================================================================
+
+struct ImageWriter {
+    Out nodes, headers, links;
+    uint32_t node_count = 0;
+    std::unordered_map<const ExprBase *, uint32_t> node_ids;
+
+    // 对象按发现顺序编号；frame 和 heap value 共用一个编号空间
+    struct Object {
+        uint8_t kind;
+        const void *p;
+    };
+    std::vector<Object> objects;
+    std::unordered_map<const void *, uint32_t> object_ids;
+    std::unordered_map<const ValueBase *, ExprType> primitive_types;
+    std::unordered_map<const void *, FutureSnapshot> futures; // 扫描时取一次，写的时候不再看任务
+
+    ImageWriter() {
+        for (auto &entry : primitives) {
+            Value v = primitiveValue(entry.second);
+            if (v.bound()) primitive_types[v.get()] = entry.second;
+        }
+    }
+
+    void reach(const void *p, uint8_t kind) {
+        if (object_ids.count(p)) return;
+        object_ids[p] = (uint32_t)objects.size();
+        objects.push_back(Object{kind, p});
+    }
+
+    void reach(const Value &v) {
+        if (v.bound() && !v.isImmediate()) reach(v.get(), (uint8_t)v.type());
+    }
+
+    void reach(const Assoc &env) {
+        if (env.get() != nullptr) reach(env.get(), K_FRAME);
+    }
+
+    uint32_t frameRef(const Assoc &env) {
+        return env.get() == nullptr ? NO_FRAME : object_ids.at(env.get());
+    }
+
+    void value(Out &o, const Value &v) {
+        o.u8((uint8_t)v.type());
+        switch (v.type()) {
+            case V_INT:
+            case V_BOOL: o.i32(v.imm); break;
+            case V_NULL:
+            case V_VOID:
+            case V_UNBOUND: break;
+            default: o.u32(object_ids.at(v.get()));
+        }
+    }
+
+    // 有理数的分子分母直接写在头里，不占对象编号
+    void integer(Out &o, const Value &v) {
+        if (v.type() == V_INT) {
+            o.u8(0);
+            o.i32(v.asInt());
+            return;
+        }
+        bigint(o, v.as<BigInt>());
+    }
+
+    void bigint(Out &o, const BigInt *b) {
+        o.u8(b->negative ? 2 : 1);
+        o.u32((uint32_t)b->limbs.size());
+        for (uint32_t limb : b->limbs) o.u32(limb);
+    }
+
+    void syntax(const Syntax &stx) {
+        SyntaxBase *s = stx.get();
+        if (Number *x = dynamic_cast<Number *>(s)) {
+            nodes.u8(X_NUMBER);
+            nodes.i32(x->n);
+        } else if (BigNumberSyntax *x = dynamic_cast<BigNumberSyntax *>(s)) {
+            nodes.u8(X_BIGNUM);
+            nodes.str(x->s);
+        } else if (RationalSyntax *x = dynamic_cast<RationalSyntax *>(s)) {
+            nodes.u8(X_RATIONAL);
+            nodes.i32(x->numerator);
+            nodes.i32(x->denominator);
+        } else if (dynamic_cast<TrueSyntax *>(s)) {
+            nodes.u8(X_TRUE);
+        } else if (dynamic_cast<FalseSyntax *>(s)) {
+            nodes.u8(X_FALSE);
+        } else if (SymbolSyntax *x = dynamic_cast<SymbolSyntax *>(s)) {
+            nodes.u8(X_SYMBOL);
+            nodes.str(x->s);
+        } else if (StringSyntax *x = dynamic_cast<StringSyntax *>(s)) {
+            nodes.u8(X_STRING);
+            nodes.str(x->s);
+        } else if (List *x = dynamic_cast<List *>(s)) {
+            nodes.u8(X_LIST);
+            nodes.u32((uint32_t)x->stxs.size());
+            for (auto &item : x->stxs) syntax(item);
+        } else if (VectorSyntax *x = dynamic_cast<VectorSyntax *>(s)) {
+            nodes.u8(X_VECTOR);
+            nodes.u32((uint32_t)x->stxs.size());
+            for (auto &item : x->stxs) syntax(item);
+        } else {
+            throw RuntimeError("image: unknown syntax");
+        }
+    }
+
+    std::vector<uint32_t> nodeList(const std::vector<Expr> &es) {
+        std::vector<uint32_t> ids;
+        for (auto &e : es) ids.push_back(node(e));
+        return ids;
+    }
+
+    void refs(const std::vector<uint32_t> &ids) {
+        nodes.u32((uint32_t)ids.size());
+        for (uint32_t id : ids) nodes.u32(id);
+    }
+
+    void atoms(const std::vector<Atom> &xs) {
+        nodes.u32((uint32_t)xs.size());
+        for (Atom a : xs) nodes.u32(a);
+    }
+
+    // 先写子节点，再写自己；返回节点编号
+    uint32_t node(const Expr &expr) {
+        ExprBase *e = expr.get();
+        auto it = node_ids.find(e);
+        if (it != node_ids.end()) return it->second;
+
+        if (Unary *x = dynamic_cast<Unary *>(e)) {
+            uint32_t a = node(x->rand);
+            nodes.u8(S_UNARY);
+            nodes.u8((uint8_t)e->e_type);
+            nodes.u32(a);
+        } else if (Binary *x = dynamic_cast<Binary *>(e)) {
+            uint32_t a = node(x->rand1), b = node(x->rand2);
+            nodes.u8(S_BINARY);
+            nodes.u8((uint8_t)e->e_type);
+            nodes.u32(a);
+            nodes.u32(b);
+        } else if (Variadic *x = dynamic_cast<Variadic *>(e)) {
+            std::vector<uint32_t> rs = nodeList(x->rands);
+            nodes.u8(S_VARIADIC);
+            nodes.u8((uint8_t)e->e_type);
+            refs(rs);
+        } else {
+            other(e);
+        }
+        node_ids[e] = node_count;
+        return node_count++;
+    }
+
+    std::vector<std::pair<Atom, uint32_t>> binds(const std::vector<std::pair<Atom, Expr>> &bind) {
+        std::vector<std::pair<Atom, uint32_t>> out;
+        for (auto &p : bind) out.push_back({p.first, node(p.second)});
+        return out;
+    }
+
+    void writeBinds(const std::vector<std::pair<Atom, uint32_t>> &bs) {
+        nodes.u32((uint32_t)bs.size());
+        for (auto &b : bs) {
+            nodes.u32(b.first);
+            nodes.u32(b.second);
+        }
+    }
+
+    void other(ExprBase *e) {
+        switch (e->e_type) {
+            case E_FIXNUM:
+                nodes.u8(S_OTHER);
+                nodes.u8(E_FIXNUM);
+                nodes.i32(static_cast<Fixnum *>(e)->n);
+                return;
+            case E_RATIONAL: {
+                RationalNum *x = static_cast<RationalNum *>(e);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_RATIONAL);
+                nodes.i32(x->numerator);
+                nodes.i32(x->denominator);
+                return;
+            }
+            case E_BIGNUM:
+                nodes.u8(S_OTHER);
+                nodes.u8(E_BIGNUM);
+                nodes.str(static_cast<Bignum *>(e)->s);
+                return;
+            case E_STRING:
+                nodes.u8(S_OTHER);
+                nodes.u8(E_STRING);
+                nodes.str(static_cast<StringExpr *>(e)->s);
+                return;
+            case E_TRUE:
+            case E_FALSE:
+            case E_VOID:
+            case E_EXIT:
+                nodes.u8(S_OTHER);
+                nodes.u8((uint8_t)e->e_type);
+                return;
+            case E_AND:
+            case E_OR:
+            case E_BEGIN: {
+                const std::vector<Expr> &es = e->e_type == E_AND ? static_cast<AndVar *>(e)->rands
+                    : e->e_type == E_OR ? static_cast<OrVar *>(e)->rands : static_cast<Begin *>(e)->es;
+                std::vector<uint32_t> ids = nodeList(es);
+                nodes.u8(S_OTHER);
+                nodes.u8((uint8_t)e->e_type);
+                refs(ids);
+                return;
+            }
+            case E_QUOTE:
+                nodes.u8(S_OTHER);
+                nodes.u8(E_QUOTE);
+                syntax(static_cast<Quote *>(e)->s);
+                return;
+            case E_IF: {
+                If *x = static_cast<If *>(e);
+                uint32_t c = node(x->cond), t = node(x->conseq), a = node(x->alter);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_IF);
+                nodes.u32(c);
+                nodes.u32(t);
+                nodes.u32(a);
+                return;
+            }
+            case E_COND: {
+                std::vector<std::vector<uint32_t>> clauses;
+                for (auto &clause : static_cast<Cond *>(e)->clauses) clauses.push_back(nodeList(clause));
+                nodes.u8(S_OTHER);
+                nodes.u8(E_COND);
+                nodes.u32((uint32_t)clauses.size());
+                for (auto &clause : clauses) refs(clause);
+                return;
+            }
+            case E_VAR: {
+                Var *x = static_cast<Var *>(e);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_VAR);
+                nodes.u32(x->atom);
+                nodes.i32(x->depth);
+                nodes.i32(x->slot);
+                return;
+            }
+            case E_APPLY: {
+                Apply *x = static_cast<Apply *>(e);
+                uint32_t f = node(x->rator);
+                std::vector<uint32_t> rs = nodeList(x->rand);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_APPLY);
+                nodes.u32(f);
+                refs(rs);
+                return;
+            }
+            case E_LAMBDA: {
+                Lambda *x = static_cast<Lambda *>(e);
+                uint32_t body = node(x->e);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_LAMBDA);
+                atoms(x->x);
+                nodes.u32(x->name);
+                nodes.u32(body);
+                return;
+            }
+            case E_DEFINE: {
+                Define *x = static_cast<Define *>(e);
+                uint32_t v = node(x->e);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_DEFINE);
+                nodes.u32(intern(x->var));
+                nodes.u32(v);
+                return;
+            }
+            case E_LET:
+            case E_LETREC: {
+                const std::vector<std::pair<Atom, Expr>> &bind = e->e_type == E_LET
+                    ? static_cast<Let *>(e)->bind : static_cast<Letrec *>(e)->bind;
+                const Expr &body_expr = e->e_type == E_LET ? static_cast<Let *>(e)->body : static_cast<Letrec *>(e)->body;
+                std::vector<std::pair<Atom, uint32_t>> bs = binds(bind);
+                uint32_t body = node(body_expr);
+                nodes.u8(S_OTHER);
+                nodes.u8((uint8_t)e->e_type);
+                writeBinds(bs);
+                nodes.u32(body);
+                return;
+            }
+            case E_SET: {
+                Set *x = static_cast<Set *>(e);
+                uint32_t v = node(x->e);
+                nodes.u8(S_OTHER);
+                nodes.u8(E_SET);
+                nodes.u32(x->atom);
+                nodes.i32(x->depth);
+                nodes.i32(x->slot);
+                nodes.u32(v);
+                return;
+            }
+            default:
+                throw RuntimeError("image: cannot save expression");
+        }
+    }
+
+    // 找到一个全局变量能到达的所有新对象。碰到还没算完的 future 就撤掉这一轮找到的，
+    // 返回 false：它的结果随时会变，存不下来
+    bool addRoot(const Value &root) {
+        size_t mark = objects.size();
+        reach(root);
+        for (size_t i = mark; i < objects.size(); i++) {
+            Object o = objects[i];
+            if (o.kind == K_FRAME) {
+                const AssocList *f = static_cast<const AssocList *>(o.p);
+                for (auto &v : f->slots) reach(v);
+                reach(f->next);
+            } else if (o.kind == V_PAIR) {
+                const Pair *p = static_cast<const Pair *>(o.p);
+                reach(p->car);
+                reach(p->cdr);
+            } else if (o.kind == V_VECTOR) {
+                for (auto &item : static_cast<const Vector *>(o.p)->items) reach(item);
+            } else if (o.kind == V_HASHTABLE) {
+                for (auto &slot : static_cast<const HashTable *>(o.p)->slots) {
+                    if (slot.state != HashTable::FULL) continue;
+                    reach(slot.key);
+                    reach(slot.value);
+                }
+            } else if (o.kind == V_PROC) {
+                reach(static_cast<const Procedure *>(o.p)->env);
+            } else if (o.kind == V_MEMO) {
+                reach(static_cast<const Memoized *>(o.p)->fn);
+            } else if (o.kind == V_PROMISE) {
+                const Promise *p = static_cast<const Promise *>(o.p);
+                reach(p->fn);
+                reach(p->source);
+                reach(p->value);
+            } else if (o.kind == V_FUTURE) {
+                FutureSnapshot s;
+                if (!futureSnapshot(static_cast<const Future *>(o.p), s)) {
+                    for (size_t k = mark; k < objects.size(); k++) {
+                        object_ids.erase(objects[k].p);
+                        futures.erase(objects[k].p);
+                    }
+                    objects.resize(mark);
+                    return false;
+                }
+                reach(s.result);
+                futures.insert({o.p, s});
+            }
+        }
+        return true;
+    }
+
+    // 每个对象写一份头、一份链接
+    void writeObjects() {
+        for (Object o : objects) {
+            headers.u8(o.kind);
+            switch (o.kind) {
+                case K_FRAME: {
+                    const AssocList *f = static_cast<const AssocList *>(o.p);
+                    headers.u32((uint32_t)f->names.size());
+                    for (Atom a : f->names) headers.u32(a);
+                    headers.u32((uint32_t)f->slots.size());
+                    for (auto &v : f->slots) value(links, v);
+                    links.u32(frameRef(f->next));
+                    break;
+                }
+                case V_RATIONAL: {
+                    const Rational *r = static_cast<const Rational *>(o.p);
+                    integer(headers, r->numerator);
+                    integer(headers, r->denominator);
+                    break;
+                }
+                case V_BIGINT:
+                    bigint(headers, static_cast<const BigInt *>(o.p));
+                    break;
+                case V_SYM:
+                    headers.u32(static_cast<const Symbol *>(o.p)->atom);
+                    break;
+                case V_STRING:
+                    headers.str(static_cast<const String *>(o.p)->str());
+                    break;
+                case V_PORT: // 只存已经写进去的内容
+                    headers.str(static_cast<const StringPort *>(o.p)->out.str());
+                    break;
+                case V_PAIR: {
+                    const Pair *p = static_cast<const Pair *>(o.p);
+                    value(links, p->car);
+                    value(links, p->cdr);
+                    break;
+                }
+                case V_VECTOR: {
+                    const Vector *vec = static_cast<const Vector *>(o.p);
+                    headers.u32((uint32_t)vec->items.size());
+                    for (auto &item : vec->items) value(links, item);
+                    break;
+                }
+                case V_HASHTABLE: { // 只存键值对，槽的布局装载时重新算（eq? 表的哈希是地址）
+                    const HashTable *table = static_cast<const HashTable *>(o.p);
+                    headers.u8(table->by_equal);
+                    headers.u32((uint32_t)table->count);
+                    for (auto &slot : table->slots) {
+                        if (slot.state != HashTable::FULL) continue;
+                        value(links, slot.key);
+                        value(links, slot.value);
+                    }
+                    break;
+                }
+                case V_PROC: {
+                    const Procedure *proc = static_cast<const Procedure *>(o.p);
+                    std::vector<uint32_t> xs(proc->parameters.begin(), proc->parameters.end());
+                    headers.u32((uint32_t)xs.size());
+                    for (uint32_t a : xs) headers.u32(a);
+                    headers.u32(proc->name);
+                    headers.u32(node(proc->e));
+                    links.u32(frameRef(proc->env));
+                    break;
+                }
+                case V_MEMO: { // 只存过程和容量，缓存装载后从空的开始
+                    const Memoized *m = static_cast<const Memoized *>(o.p);
+                    headers.u32((uint32_t)m->capacity);
+                    value(links, m->fn);
+                    break;
+                }
+                case V_PROMISE: {
+                    const Promise *p = static_cast<const Promise *>(o.p);
+                    headers.u8(p->kind);
+                    headers.i32(p->count);
+                    value(links, p->fn);
+                    value(links, p->source);
+                    value(links, p->value);
+                    break;
+                }
+                case V_PRIM: {
+                    auto it = primitive_types.find(static_cast<const ValueBase *>(o.p));
+                    if (it == primitive_types.end()) throw RuntimeError("image: unknown primitive");
+                    headers.i32(it->second);
+                    break;
+                }
+                case V_FUTURE: { // 结果存下来，装载后 touch 直接拿到
+                    const FutureSnapshot &s = futures.at(o.p);
+                    headers.u8(s.failed);
+                    headers.str(s.error);
+                    headers.str(s.output);
+                    value(links, s.result);
+                    break;
+                }
+                case V_TERMINATE:
+                    break;
+                default:
+                    throw RuntimeError("image: cannot save value");
+            }
+        }
+    }
+};
+
+// ============================================================================
+// Loading
+// ============================================================================
+
+ExprBase *makeUnary(ExprType t, const Expr &a) {
+    switch (t) {
+        case E_CAR: return new Car(a);
+        case E_CDR: return new Cdr(a);
+        case E_NOT: return new Not(a);
+        case E_BOOLQ: return new IsBoolean(a);
+        case E_INTQ: return new IsFixnum(a);
+        case E_NULLQ: return new IsNull(a);
+        case E_PAIRQ: return new IsPair(a);
+        case E_PROCQ: return new IsProcedure(a);
+        case E_SYMBOLQ: return new IsSymbol(a);
+        case E_LISTQ: return new IsList(a);
+        case E_STRINGQ: return new IsString(a);
+        case E_VECTORLENGTH: return new VectorLength(a);
+        case E_LIST2VECTOR: return new ListToVector(a);
+        case E_VECTOR2LIST: return new VectorToList(a);
+        case E_VECTORQ: return new IsVector(a);
+        case E_HASHCOUNT: return new HashTableCount(a);
+        case E_HASHKEYS: return new HashTableKeys(a);
+        case E_STRINGLENGTH: return new StringLength(a);
+        case E_STRING2SYMBOL: return new StringToSymbol(a);
+        case E_SYMBOL2STRING: return new SymbolToString(a);
+        case E_NUMBER2STRING: return new NumberToString(a);
+        case E_STRING2NUMBER: return new StringToNumber(a);
+        case E_GETOUTPUTSTRING: return new GetOutputString(a);
+        case E_HASHVALUES: return new HashTableValues(a);
+        case E_HASH2ALIST: return new HashTableToAlist(a);
+        case E_HASHTABLEQ: return new IsHashTable(a);
+        case E_FUTURE: return new FutureFunc(a);
+        case E_TOUCH: return new Touch(a);
+        case E_DELAY: return new Delay(a);
+        case E_FORCE: return new Force(a);
+        case E_MAKEPROMISE: return new MakePromise(a);
+        case E_PROMISEQ: return new IsPromise(a);
+        case E_STREAMCAR: return new StreamCar(a);
+        case E_STREAMCDR: return new StreamCdr(a);
+        default: throw RuntimeError("image: bad unary node");
+    }
+}
+
+ExprBase *makeBinary(ExprType t, const Expr &a, const Expr &b) {
+    switch (t) {
+        case E_PLUS: return new Plus(a, b);
+        case E_MINUS: return new Minus(a, b);
+        case E_MUL: return new Mult(a, b);
+        case E_DIV: return new Div(a, b);
+        case E_MODULO: return new Modulo(a, b);
+        case E_EXPT: return new Expt(a, b);
+        case E_LT: return new Less(a, b);
+        case E_LE: return new LessEq(a, b);
+        case E_EQ: return new Equal(a, b);
+        case E_GE: return new GreaterEq(a, b);
+        case E_GT: return new Greater(a, b);
+        case E_CONS: return new Cons(a, b);
+        case E_SETCAR: return new SetCar(a, b);
+        case E_SETCDR: return new SetCdr(a, b);
+        case E_EQQ: return new IsEq(a, b);
+        case E_VECTORREF: return new VectorRef(a, b);
+        case E_VECTORFILL: return new VectorFill(a, b);
+        case E_HASHDELETE: return new HashTableDelete(a, b);
+        case E_HASHCONTAINS: return new HashTableContains(a, b);
+        case E_EQUALQ: return new IsEqual(a, b);
+        case E_PARALLELMAP: return new ParallelMap(a, b);
+        case E_STREAMMAP: return new StreamMap(a, b);
+        case E_STREAMFILTER: return new StreamFilter(a, b);
+        case E_STREAMTAKE: return new StreamTake(a, b);
+        case E_STRINGEQ: return new StringEq(a, b);
+        case E_STRINGLT: return new StringLess(a, b);
+        default: throw RuntimeError("image: bad binary node");
+    }
+}
+
+ExprBase *makeVariadic(ExprType t, const std::vector<Expr> &rs) {
+    switch (t) {
+        case E_PLUS: return new PlusVar(rs);
+        case E_MINUS: return new MinusVar(rs);
+        case E_MUL: return new MultVar(rs);
+        case E_DIV: return new DivVar(rs);
+        case E_LT: return new LessVar(rs);
+        case E_LE: return new LessEqVar(rs);
+        case E_EQ: return new EqualVar(rs);
+        case E_GE: return new GreaterEqVar(rs);
+        case E_GT: return new GreaterVar(rs);
+        case E_LIST: return new ListFunc(rs);
+        case E_MAKEVECTOR: return new MakeVector(rs);
+        case E_VECTOR: return new VectorFunc(rs);
+        case E_VECTORSET: return new VectorSet(rs);
+        case E_MAKEHASH: return new MakeHashTable(rs);
+        case E_HASHREF: return new HashTableRef(rs);
+        case E_HASHSET: return new HashTableSet(rs);
+        case E_MEMOIZE: return new Memoize(rs);
+        case E_STREAM2LIST: return new StreamToList(rs);
+        case E_STRINGAPPEND: return new StringAppend(rs);
+        case E_SUBSTRING: return new Substring(rs);
+        case E_DISPLAY: return new Display(rs);
+        case E_WRITESTRING: return new WriteString(rs);
+        case E_OPENOUTPUTSTRING: return new OpenOutputString(rs);
+        case E_RUNTIMESTATS: return new RuntimeStats(rs);
+        default: throw RuntimeError("image: bad variadic node");
+    }
+}
+
+struct ImageLoader {
+    In in;
+    std::vector<Atom> atom_map;  // 镜像里的 atom 编号 -> 本进程的
+    std::vector<Expr> nodes;
+    std::vector<Value> values;   // 对象表：value 对象放这里
+    std::vector<Assoc> frames;   // frame 对象放这里，同一编号只用其中一个
+
+    std::vector<Value *> cells;  // 按镜像里的 atom 编号缓存 globalCell，免得每个 Var 查一次 map
+    std::unordered_map<const ExprBase *, std::shared_ptr<Code>> codes; // 同一个过程体只编译一次
+
+    // 局部变量地址的检查：uses[i][d] 是节点 i 里的引用要求往外第 d 层 frame 至少有几个 slot。
+    // 节点按后序存，子节点的要求先算好，往上合并，过了 lambda / let 这样的作用域就少一层
+    std::vector<std::vector<uint32_t>> uses;
+    std::vector<uint32_t> kids;                        // 正在读的节点引用了哪些子节点，node() 记下
+    std::vector<std::pair<uint32_t, uint32_t>> procs;  // (过程对象, 过程体节点)，frame 接好以后再查
+
+    Atom atom(uint32_t a) {
+        if (a >= atom_map.size()) throw RuntimeError("image: bad atom");
+        return atom_map[a];
+    }
+
+    Atom atom() { return atom(in.u32()); }
+
+    // VM 下过程体在装载时就编译好：运行时不再回写 Procedure::code，worker 线程可以同时调用
+    std::shared_ptr<Code> compiled(const Expr &body) {
+        if (!use_vm) return nullptr;
+        std::shared_ptr<Code> &code = codes[body.get()];
+        if (!code) code = compileCode(body);
+        return code;
+    }
+
+    Value *cell(uint32_t a) {
+        Atom x = atom(a);
+        if (cells[a] == nullptr) cells[a] = globalCell(x);
+        return cells[a];
+    }
+
+    std::vector<Atom> atoms() {
+        std::vector<Atom> xs(in.count());
+        for (auto &a : xs) a = atom();
+        return xs;
+    }
+
+    const Expr &node() {
+        uint32_t i = in.u32();
+        if (i >= nodes.size()) throw RuntimeError("image: bad node reference");
+        kids.push_back(i);
+        return nodes[i];
+    }
+
+    std::vector<Expr> nodeList() {
+        uint32_t n = in.count();
+        std::vector<Expr> es;
+        es.reserve(n);
+        for (uint32_t i = 0; i < n; i++) es.push_back(node());
+        return es;
+    }
+
+    std::vector<std::pair<Atom, Expr>> binds() {
+        uint32_t n = in.count();
+        std::vector<std::pair<Atom, Expr>> bs;
+        for (uint32_t i = 0; i < n; i++) {
+            Atom a = atom();
+            bs.push_back({a, node()});
+        }
+        return bs;
+    }
+
+    Value integer() {
+        uint8_t kind = in.u8();
+        if (kind == 0) return IntegerV(in.i32());
+        if (kind > 2) throw RuntimeError("image: bad integer");
+        std::vector<uint32_t> limbs(in.count());
+        for (auto &limb : limbs) limb = in.u32();
+        return integerFromLimbs(kind == 2, std::move(limbs));
+    }
+
+    Syntax syntax() {
+        switch (in.u8()) {
+            case X_NUMBER: return Syntax(new Number(in.i32()));
+            case X_BIGNUM: return Syntax(new BigNumberSyntax(in.str()));
+            case X_RATIONAL: {
+                int n = in.i32();
+                int d = in.i32();
+                if (d == 0) throw RuntimeError("image: bad syntax");
+                return Syntax(new RationalSyntax(n, d));
+            }
+            case X_TRUE: return Syntax(new TrueSyntax());
+            case X_FALSE: return Syntax(new FalseSyntax());
+            case X_SYMBOL: return Syntax(new SymbolSyntax(in.str()));
+            case X_STRING: return Syntax(new StringSyntax(in.str()));
+            case X_LIST: {
+                List *list = new List();
+                Syntax result(list);
+                uint32_t n = in.count();
+                for (uint32_t i = 0; i < n; i++) list->stxs.push_back(syntax());
+                return result;
+            }
+            case X_VECTOR: {
+                VectorSyntax *vec = new VectorSyntax();
+                Syntax result(vec);
+                uint32_t n = in.count();
+                for (uint32_t i = 0; i < n; i++) vec->stxs.push_back(syntax());
+                return result;
+            }
+            default: throw RuntimeError("image: bad syntax");
+        }
+    }
+
+    Expr other(ExprType t) {
+        switch (t) {
+            case E_FIXNUM: return Expr(new Fixnum(in.i32()));
+            case E_RATIONAL: {
+                int n = in.i32();
+                int d = in.i32();
+                if (d == 0) throw RuntimeError("image: bad node");
+                return rationalLiteral(n, d); // 和解析时一样约分，放不进 int 的变成 Bignum
+            }
+            case E_BIGNUM: return Expr(new Bignum(in.str()));
+            case E_STRING: return Expr(new StringExpr(in.str()));
+            case E_TRUE: return Expr(new True());
+            case E_FALSE: return Expr(new False());
+            case E_VOID: return Expr(new MakeVoid());
+            case E_EXIT: return Expr(new Exit());
+            case E_AND: return Expr(new AndVar(nodeList()));
+            case E_OR: return Expr(new OrVar(nodeList()));
+            case E_BEGIN: return Expr(new Begin(nodeList()));
+            case E_QUOTE: return Expr(new Quote(syntax()));
+            case E_IF: {
+                Expr c = node();
+                Expr x = node();
+                return Expr(new If(c, x, node()));
+            }
+            case E_COND: {
+                std::vector<std::vector<Expr>> clauses(in.count());
+                for (auto &clause : clauses) clause = nodeList();
+                return Expr(new Cond(clauses));
+            }
+            case E_VAR: {
+                uint32_t a = in.u32();
+                Var *v = new Var(atomName(atom(a)));
+                Expr result(v);
+                v->depth = in.i32();
+                v->slot = in.i32();
+                if (v->depth < 0) v->cell = cell(a);
+                return result;
+            }
+            case E_APPLY: {
+                Expr f = node();
+                return Expr(new Apply(f, nodeList()));
+            }
+            case E_LAMBDA: {
+                std::vector<Atom> xs = atoms();
+                Atom name = atom();
+                Lambda *lambda = new Lambda(xs, node());
+                lambda->name = name;
+                return Expr(lambda);
+            }
+            case E_DEFINE: {
+                uint32_t a = in.u32();
+                Define *d = new Define(atomName(atom(a)), node());
+                d->cell = cell(a);
+                return Expr(d);
+            }
+            case E_LET:
+            case E_LETREC: {
+                std::vector<std::pair<Atom, Expr>> bs = binds();
+                if (t == E_LET) return Expr(new Let(bs, node()));
+                return Expr(new Letrec(bs, node()));
+            }
+            case E_SET: {
+                uint32_t a = in.u32();
+                int depth = in.i32();
+                int slot = in.i32();
+                Set *s = new Set(atomName(atom(a)), node());
+                s->depth = depth;
+                s->slot = slot;
+                if (depth < 0) s->cell = cell(a);
+                return Expr(s);
+            }
+            default: throw RuntimeError("image: bad node");
+        }
+    }
+
+    static void addUse(std::vector<uint32_t> &u, size_t depth, uint32_t slots) {
+        if (u.size() <= depth) u.resize(depth + 1, 0);
+        if (u[depth] < slots) u[depth] = slots;
+    }
+
+    // 把 inner 并进 u；inner 所在的作用域比 u 多 shift 层
+    static void mergeUses(std::vector<uint32_t> &u, const std::vector<uint32_t> &inner, size_t shift) {
+        for (size_t d = shift; d < inner.size(); d++) addUse(u, d - shift, inner[d]);
+    }
+
+    // 新作用域的 frame 有 n 个 slot
+    static void checkScope(const std::vector<uint32_t> &inner, size_t n) {
+        if (!inner.empty() && inner[0] > n) throw RuntimeError("image: bad variable address");
+    }
+
+    // 局部变量 (depth, slot)；depth < 0 的是全局，slot 不用
+    void addAddress(std::vector<uint32_t> &u, int depth, int slot, uint32_t node_count) {
+        if (depth < 0) return;
+        if (slot < 0 || (uint32_t)depth >= node_count) throw RuntimeError("image: bad variable address");
+        addUse(u, depth, (uint32_t)slot + 1);
+    }
+
+    // 刚读完的节点 e 的要求，kids 是它按读入顺序引用的子节点
+    std::vector<uint32_t> nodeUses(const Expr &e, uint32_t node_count) {
+        std::vector<uint32_t> u;
+        switch (e->e_type) {
+            case E_VAR: {
+                Var *v = static_cast<Var *>(e.get());
+                addAddress(u, v->depth, v->slot, node_count);
+                break;
+            }
+            case E_SET: {
+                Set *s = static_cast<Set *>(e.get());
+                mergeUses(u, uses[kids[0]], 0);
+                addAddress(u, s->depth, s->slot, node_count);
+                break;
+            }
+            case E_LAMBDA: {
+                const std::vector<uint32_t> &body = uses[kids[0]];
+                checkScope(body, static_cast<Lambda *>(e.get())->x.size());
+                mergeUses(u, body, 1);
+                break;
+            }
+            case E_LET: { // 初值在外层，只有 body 在新的 frame 里
+                for (size_t k = 0; k + 1 < kids.size(); k++) mergeUses(u, uses[kids[k]], 0);
+                const std::vector<uint32_t> &body = uses[kids.back()];
+                checkScope(body, static_cast<Let *>(e.get())->bind.size());
+                mergeUses(u, body, 1);
+                break;
+            }
+            case E_LETREC: {
+                std::vector<uint32_t> inner;
+                for (uint32_t k : kids) mergeUses(inner, uses[k], 0);
+                checkScope(inner, static_cast<Letrec *>(e.get())->bind.size());
+                mergeUses(u, inner, 1);
+                break;
+            }
+            default:
+                for (uint32_t k : kids) mergeUses(u, uses[k], 0);
+                break;
+        }
+        return u;
+    }
+
+    void readNodes() {
+        uint32_t n = in.count();
+        nodes.reserve(n);
+        uses.reserve(n);
+        for (uint32_t i = 0; i < n; i++) {
+            uint8_t shape = in.u8();
+            ExprType t = (ExprType)in.u8();
+            kids.clear();
+            switch (shape) {
+                case S_UNARY: nodes.push_back(Expr(makeUnary(t, node()))); break;
+                case S_BINARY: {
+                    Expr a = node();
+                    nodes.push_back(Expr(makeBinary(t, a, node())));
+                    break;
+                }
+                case S_VARIADIC: nodes.push_back(Expr(makeVariadic(t, nodeList()))); break;
+                case S_OTHER: nodes.push_back(other(t)); break;
+                default: throw RuntimeError("image: bad node shape");
+            }
+            uses.push_back(nodeUses(nodes.back(), n));
+        }
+    }
+
+    // 过程体里的局部变量：第 0 层是参数，往外是闭包环境的 frame 链
+    void checkProcedures() {
+        for (auto &p : procs) {
+            Procedure *proc = values[p.first].as<Procedure>();
+            const std::vector<uint32_t> &u = uses[p.second];
+            checkScope(u, proc->parameters.size());
+            AssocList *f = proc->env.get();
+            for (size_t d = 1; d < u.size(); d++, f = f->next.get()) {
+                if (f == nullptr || u[d] > f->slots.size()) throw RuntimeError("image: bad variable address");
+            }
+        }
+    }
+
+    Value value() {
+        ValueType t = (ValueType)in.u8();
+        switch (t) {
+            case V_INT: return IntegerV(in.i32());
+            case V_BOOL: return BooleanV(in.i32() != 0);
+            case V_NULL: return NullV();
+            case V_VOID: return VoidV();
+            case V_UNBOUND: return Value(nullptr);
+            default: {
+                uint32_t i = in.u32();
+                if (i >= values.size() || !values[i].bound() || values[i].type() != t)
+                    throw RuntimeError("image: bad value reference");
+                return values[i];
+            }
+        }
+    }
+
+    Assoc frame() {
+        uint32_t i = in.u32();
+        if (i == NO_FRAME) return Assoc(nullptr);
+        if (i >= frames.size() || frames[i].get() == nullptr) throw RuntimeError("image: bad frame reference");
+        return frames[i];
+    }
+
+    void readObjects() {
+        uint32_t n = in.count();
+        std::vector<uint8_t> kinds(n);
+        std::vector<uint32_t> table_sizes(n, 0);
+        values.assign(n, Value(nullptr));
+        frames.assign(n, Assoc(nullptr));
+        // 第一遍：建出所有对象，可变的字段先留空
+        for (uint32_t i = 0; i < n; i++) {
+            kinds[i] = in.u8();
+            switch (kinds[i]) {
+                case K_FRAME: {
+                    std::vector<Atom> names = atoms();
+                    frames[i] = extendFrame(std::vector<Value>(in.count(), Value(nullptr)), Assoc(nullptr));
+                    frames[i]->names = names;
+                    break;
+                }
+                case V_RATIONAL: {
+                    Value num = integer();
+                    Value den = integer();
+                    if (intSign(den) == 0) throw RuntimeError("image: bad object");
+                    values[i] = RationalV(num, den);
+                    break;
+                }
+                case V_BIGINT: {
+                    Value x = integer();
+                    if (x.type() != V_BIGINT) throw RuntimeError("image: bad object");
+                    values[i] = x;
+                    break;
+                }
+                case V_SYM: values[i] = SymbolV(atom()); break;
+                case V_STRING: values[i] = StringV(in.str()); break;
+                case V_PORT: values[i] = OutputStringV(in.str()); break;
+                case V_PAIR: values[i] = PairV(NullV(), NullV()); break;
+                case V_VECTOR: values[i] = VectorV(HeapVector<Value>(in.count(), NullV())); break;
+                case V_HASHTABLE: {
+                    bool by_equal = in.u8() != 0;
+                    table_sizes[i] = in.count();
+                    values[i] = HashTableV(by_equal);
+                    break;
+                }
+                case V_PROC: {
+                    std::vector<Atom> xs = atoms();
+                    Atom name = atom();
+                    kids.clear();
+                    const Expr &body = node();
+                    procs.push_back({i, kids.back()});
+                    values[i] = ProcedureV(xs, body, Assoc(nullptr), compiled(body), name);
+                    break;
+                }
+                case V_MEMO: {
+                    uint32_t capacity = in.u32();
+                    if (capacity == 0) throw RuntimeError("image: bad object");
+                    values[i] = MemoizedV(Value(nullptr), capacity);
+                    break;
+                }
+                case V_PROMISE: {
+                    uint8_t kind = in.u8();
+                    if (kind > Promise::TAKE) throw RuntimeError("image: bad object");
+                    int count = in.i32();
+                    values[i] = PromiseV((Promise::Kind)kind, Value(nullptr), Value(nullptr), count);
+                    break;
+                }
+                case V_PRIM: {
+                    values[i] = primitiveValue((ExprType)in.i32());
+                    if (!values[i].bound()) throw RuntimeError("image: unknown primitive");
+                    break;
+                }
+                case V_FUTURE: {
+                    FutureSnapshot s;
+                    s.failed = in.u8() != 0;
+                    s.error = in.str();
+                    s.output = in.str();
+                    values[i] = finishedFutureV(s);
+                    break;
+                }
+                case V_TERMINATE: values[i] = TerminateV(); break;
+                default: throw RuntimeError("image: bad object");
+            }
+        }
+        // 第二遍：接上 car / cdr、闭包环境和 frame 链。equal? 表的哈希要看键的内容，
+        // 所以键值对先收起来，等所有对象都接好了再插
+        std::vector<std::pair<HashTable *, std::vector<Value>>> tables;
+        for (uint32_t i = 0; i < n; i++) {
+            switch (kinds[i]) {
+                case K_FRAME:
+                    for (auto &slot : frames[i]->slots) slot = value();
+                    frames[i]->next = frame();
+                    break;
+                case V_PAIR: {
+                    Pair *p = values[i].as<Pair>();
+                    p->car = value();
+                    p->cdr = value();
+                    break;
+                }
+                case V_VECTOR:
+                    for (auto &item : values[i].as<Vector>()->items) item = value();
+                    break;
+                case V_HASHTABLE: {
+                    std::vector<Value> entries;
+                    for (uint32_t k = 0; k < 2 * table_sizes[i]; k++) entries.push_back(value());
+                    tables.push_back({values[i].as<HashTable>(), std::move(entries)});
+                    break;
+                }
+                case V_PROC:
+                    values[i].as<Procedure>()->env = frame();
+                    break;
+                case V_MEMO:
+                    values[i].as<Memoized>()->fn = value();
+                    break;
+                case V_PROMISE: {
+                    Promise *p = values[i].as<Promise>();
+                    p->fn = value();
+                    p->source = value();
+                    p->value = value();
+                    break;
+                }
+                case V_FUTURE:
+                    setFutureResult(values[i], value());
+                    break;
+                default:
+                    break;
+            }
+        }
+        for (auto &t : tables) {
+            for (size_t k = 0; k < t.second.size(); k += 2) t.first->set(t.second[k], t.second[k + 1]);
+        }
+        checkProcedures();
+    }
+
+    void load() {
+        uint64_t sum;
+        in.need(sizeof(IMAGE_MAGIC) + sizeof(sum));
+        std::memcpy(&sum, in.end - sizeof(sum), sizeof(sum));
+        in.end -= sizeof(sum);
+        if (checksum(in.p, in.end - in.p) != sum) throw RuntimeError("image: checksum mismatch");
+        if (std::memcmp(in.p, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) throw RuntimeError("image: not an image file");
+        in.p += sizeof(IMAGE_MAGIC);
+        if (in.u32() != IMAGE_VERSION) throw RuntimeError("image: unsupported version");
+
+        atom_map.resize(in.count());
+        for (auto &a : atom_map) a = intern(in.str());
+        cells.assign(atom_map.size(), nullptr);
+        readNodes();
+        readObjects();
+        for (uint32_t n = in.count(); n > 0; n--) {
+            Value *global = cell(in.u32());
+            *global = value();
+        }
+    }
+};
+
+} // namespace
+
+void saveImage(const std::string &path) {
+    ImageWriter w;
+    std::vector<const Value *> roots;
+    std::vector<Atom> names;
+    for (size_t i = 0; i < global_env.size(); i++) {
+        if (!global_env.at(i).bound()) continue; // 只被引用过、从没定义的名字
+        if (!w.addRoot(global_env.at(i))) {
+            std::cerr << "image: not saving " << atomName(global_env.name(i))
+                      << ": it holds a future that has not finished" << std::endl;
+            continue;
+        }
+        names.push_back(global_env.name(i));
+        roots.push_back(&global_env.at(i));
+    }
+    w.writeObjects();
+
+    Out file;
+    file.buf.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    file.u32(IMAGE_VERSION);
+    file.u32((uint32_t)atomCount());
+    for (size_t a = 0; a < atomCount(); a++) file.str(atomName((Atom)a));
+    file.u32(w.node_count);
+    file.buf += w.nodes.buf;
+    file.u32((uint32_t)w.objects.size());
+    file.buf += w.headers.buf;
+    file.buf += w.links.buf;
+    file.u32((uint32_t)roots.size());
+    for (size_t i = 0; i < roots.size(); i++) {
+        file.u32(names[i]);
+        w.value(file, *roots[i]);
+    }
+    file.u64(checksum(file.buf.data(), file.buf.size()));
+
+    std::ofstream os(path, std::ios::binary | std::ios::trunc);
+    os.write(file.buf.data(), file.buf.size());
+    if (!os) throw RuntimeError("image: cannot write " + path);
+}
+
+void loadImage(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw RuntimeError("image: cannot open " + path);
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        throw RuntimeError("image: cannot read " + path);
+    }
+    size_t size = (size_t)st.st_size;
+    void *data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) throw RuntimeError("image: cannot map " + path);
+    ImageLoader loader;
+    loader.in = In{(const char *)data, (const char *)data + size};
+    try {
+        loader.load();
+    } catch (...) {
+        ::munmap(data, size);
+        throw;
+    }
+    ::munmap(data, size);
+}
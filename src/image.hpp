@@ -0,0 +1,25 @@
+#ifndef IMAGE_HPP
+#define IMAGE_HPP
+
+/**
+ * @file image.hpp
+ * @brief Snapshots of the global environment (--save-image / --image)
+ *
+ * An image records the symbol table, every bound global, the heap reachable
+ * from them (pairs, strings, closures and their frames, with sharing and
+ * cycles kept) and the resolved Expr trees of the closures' bodies. Loading
+ * maps the file and rebuilds those objects directly, so a prelude of
+ * definitions is not read, parsed, resolved or evaluated again; bytecode
+ * is still compiled lazily on first call.
+ *
+ * A finished future is saved with its value or error, so touch answers it
+ * at once after loading. A global that reaches a future still queued or
+ * running is left out of the image, with a message naming it on stderr.
+ */
+
+#include <string>
+
+void saveImage(const std::string &path); ///< Skips globals holding unfinished futures; throws RuntimeError if the file cannot be written
+void loadImage(const std::string &path); ///< Throws RuntimeError on a missing or malformed image (checksum, references and variable addresses are all checked)
+
+#endif // IMAGE_HPP
@@ -0,0 +1,75 @@
+/**
+ * @file limits.cpp
+ * @brief Budgets of a form, the native stack floor, and (runtime-stats)
+ */
+
+#include "limits.hpp"
+#include "bigint.hpp"
+#include "pool.hpp"
+#include <chrono>
+#include <pthread.h>
+
+RunLimits run_limits;
+thread_local RunStats run_stats = {0, 0, UINT64_MAX, 0, 0, 0, 0, 0, 0};
+thread_local uintptr_t stack_floor = 0;
+
+LimitExceeded::LimitExceeded(const std::string &what) : RuntimeError(what) {}
+
+namespace {
+
+int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 本线程栈的最低地址加上余量；拿不到栈的范围就不检查
+uintptr_t stackFloor() {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return 0;
+    void *low = nullptr;
+    size_t size = 0;
+    int got = pthread_attr_getstack(&attr, &low, &size);
+    pthread_attr_destroy(&attr);
+    if (got != 0 || size <= 2 * STACK_MARGIN) return 0;
+    return (uintptr_t)low + STACK_MARGIN;
+}
+
+} // namespace
+
+void limitsConfigure() {
+    pool_heap_limit = run_limits.max_heap_mb << 20;
+}
+
+void limitsBegin() {
+    if (stack_floor == 0) stack_floor = stackFloor();
+    run_stats.form_steps = run_stats.steps;
+    run_stats.step_limit = run_limits.max_steps == 0 ? UINT64_MAX : run_stats.steps + run_limits.max_steps;
+    run_stats.peak_depth = run_stats.depth;
+    run_stats.form_allocs = alloc_stats.allocs;
+    run_stats.form_frees = alloc_stats.frees;
+    run_stats.start = now();
+    run_stats.deadline = run_limits.time_ms == 0 ? 0 : run_stats.start + (int64_t)run_limits.time_ms * 1000000;
+}
+
+void limitHit(const char *what) {
+    throw LimitExceeded(what);
+}
+
+void checkClock() {
+    if (now() > run_stats.deadline) limitHit("time limit exceeded");
+}
+
+Value runtimeStats() {
+    const std::pair<const char *, Value> counters[] = {
+        {"steps", integerV((long long)(run_stats.steps - run_stats.form_steps))},
+        {"depth", integerV((long long)run_stats.depth)},
+        {"peak-depth", integerV((long long)run_stats.peak_depth)},
+        {"allocations", integerV((long long)(alloc_stats.allocs - run_stats.form_allocs))},
+        {"frees", integerV((long long)(alloc_stats.frees - run_stats.form_frees))},
+        {"live-bytes", integerV((long long)alloc_stats.live_bytes)},
+        {"elapsed-ms", integerV((now() - run_stats.start) / 1000000)},
+    };
+    Value list = NullV();
+    for (size_t i = sizeof(counters) / sizeof(counters[0]); i-- > 0;)
+        list = PairV(PairV(SymbolV(counters[i].first), counters[i].second), list);
+    return list;
+}
@@ -0,0 +1,110 @@
+#ifndef LIMITS_HPP
+#define LIMITS_HPP
+
+/**
+ * @file limits.hpp
+ * @brief Step, depth, heap and time limits for untrusted programs, and (runtime-stats)
+ *
+ * Every procedure call, in the VM and in the tree-walker alike, counts one
+ * step. With --max-steps N a top-level form that makes more than N calls
+ * is stopped, and with --time-limit MS one that runs longer than MS
+ * milliseconds; the clock is only read every CLOCK_EVERY steps, so a
+ * limited run costs a counter increment and a compare per call.
+ * --max-depth N stops N nested non-tail calls (tail calls do not nest),
+ * and --max-heap MB stops the allocation that would take the thread's
+ * live heap past MB megabytes: pool blocks plus vector elements, hash
+ * table slots, string text and bignum limbs (see AllocStats). Independently
+ * of --max-depth, a call that finds less than STACK_MARGIN of native stack
+ * left is stopped instead of overflowing it, which is what deep non-tail
+ * recursion under --tree used to do.
+ *
+ * A limit raises LimitExceeded, a RuntimeError: the form is abandoned, the
+ * REPL prints RuntimeError as for any other error (and the reason, on
+ * stderr) and goes on with the next form. A future gets fresh step and
+ * time budgets of its own; a limit it hits becomes the error of its touch,
+ * and its steps are credited to whoever touches it, like its allocations.
+ *
+ * (runtime-stats) returns an association list of the counters, for tuning
+ * the limits. steps, peak-depth, allocations, frees and elapsed-ms count
+ * from the start of the current top-level form (or task), so they are
+ * what the limits compare against; depth, the procedure bodies running
+ * around the call on either engine, and live-bytes, the pool blocks the
+ * thread holds, are levels at the moment of the call.
+ */
+
+#include "RE.hpp"
+#include "value.hpp"
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Limits from the command line; 0 means none
+ */
+struct RunLimits {
+    uint64_t max_steps = 0;   ///< --max-steps: calls per top-level form
+    size_t max_depth = 0;     ///< --max-depth: nested non-tail calls
+    size_t max_heap_mb = 0;   ///< --max-heap: megabytes of live heap, see AllocStats::live_bytes
+    unsigned time_ms = 0;     ///< --time-limit: milliseconds per top-level form
+};
+extern RunLimits run_limits;
+
+/**
+ * @brief Counters and budgets of the calling thread
+ */
+struct RunStats {
+    uint64_t steps;           ///< Calls made so far, including those of touched futures
+    uint64_t form_steps;      ///< Value of steps when the current form began
+    uint64_t step_limit;      ///< Value of steps at which the current form stops
+    int64_t start;            ///< steady_clock time the current form began, in ns
+    int64_t deadline;         ///< steady_clock time at which it stops, in ns; 0 for none
+    size_t depth;             ///< Nested non-tail calls running now
+    size_t peak_depth;        ///< Highest depth since the current form began
+    size_t form_allocs;       ///< alloc_stats.allocs when the current form began
+    size_t form_frees;        ///< alloc_stats.frees likewise
+};
+extern thread_local RunStats run_stats;
+extern thread_local uintptr_t stack_floor; ///< Lowest address a call may start at; 0 until limitsBegin()
+
+struct LimitExceeded : RuntimeError {
+    LimitExceeded(const std::string &);
+};
+
+const uint64_t CLOCK_EVERY = 1024;   ///< Steps between reads of the clock (a power of 2)
+const size_t STACK_MARGIN = 256 << 10;
+
+void limitsConfigure();              ///< Apply run_limits; after the command line is read
+void limitsBegin();                  ///< Start the budgets of a top-level form or a task on this thread
+[[noreturn]] void limitHit(const char *);
+void checkClock();
+Value runtimeStats();                ///< (runtime-stats)
+
+/// One call: counted, and checked against the step and time budgets
+inline void countStep() {
+    uint64_t n = ++run_stats.steps;
+    if (n > run_stats.step_limit) limitHit("step limit exceeded");
+    if ((n & (CLOCK_EVERY - 1)) == 0 && run_stats.deadline != 0) checkClock();
+}
+
+/// A non-tail call starts; the matching leaveCall() may be replaced by a CallScope
+inline void enterCall() {
+    char probe;
+    size_t d = ++run_stats.depth;
+    if (d > run_stats.peak_depth) run_stats.peak_depth = d;
+    if (run_limits.max_depth != 0 && d > run_limits.max_depth) limitHit("recursion depth exceeded");
+    if ((uintptr_t)&probe < stack_floor) limitHit("native stack exhausted");
+}
+
+inline void leaveCall() {
+    --run_stats.depth;
+}
+
+/**
+ * @brief Puts depth back as it was, however the calls inside it ended
+ */
+struct CallScope {
+    size_t saved;
+    CallScope() : saved(run_stats.depth) {}
+    ~CallScope() { run_stats.depth = saved; }
+};
+
+#endif // LIMITS_HPP
@@ -3,14 +3,35 @@
 #include "expr.hpp"
 #include "value.hpp"
 #include "RE.hpp"
+#include "pool.hpp"
+#include "gc.hpp"
+#include "vm.hpp"
+#include "image.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "limits.hpp"
 #include <iterator>
+#include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <cerrno>
+#include <csignal>
+#include <algorithm>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
+static bool report_allocs = false; // --alloc-stats：每个顶层表达式后往 stderr 报告分配次数
+
 bool isExplicitVoidCall(Expr expr) {
     MakeVoid* make_void_expr = dynamic_cast<MakeVoid*>(expr.get());
     if (make_void_expr != nullptr) {
@@ -47,37 +68,316 @@ bool isExplicitVoidCall(Expr expr) {
     return false;
 }
 
+// resolve + 求值 + 打印一个已经 parse 好的顶层表达式；(exit) 时返回 false
+static bool evalAndPrint(const Expr &parsed, Assoc &global_env) {
+    Expr expr = optimize(parsed); // constant folding etc., before addresses are assigned
+    expr -> resolve(nullptr); // resolve variables to lexical addresses
+    // stx -> show(std :: cout); // syntax print
+    Value val = evalTopLevel(expr, global_env); // bytecode VM, or the tree-walker under --tree
+    if (val.type() == V_TERMINATE)
+        return false;
+    if (val.type() == V_VOID) {
+        if (isExplicitVoidCall(expr)) val.show(std :: cout);
+    }
+    else val.show(std :: cout); // value print
+    return true;
+}
+
+// 超出 --max-steps 等限制时，标准输出照常只有 RuntimeError，原因写到 stderr
+static void reportError(const RuntimeError &RE) {
+    if (dynamic_cast<const LimitExceeded *>(&RE) != nullptr) std::cerr << "; " << RE.message() << std::endl;
+}
+
+static void reportAllocs(const AllocStats &before) {
+    if (profiling) profileUnwind(); // 出错时还开着的调用到这里一并结束
+    if (report_allocs) {
+        std::cerr << "; allocations: " << alloc_stats.allocs - before.allocs
+                  << ", frees: " << alloc_stats.frees - before.frees
+                  << ", live: " << alloc_stats.allocs - alloc_stats.frees
+                  << ", cycles collected: " << gc_stats.collected << std::endl;
+    }
+}
+
+// --alloc-stats 退出前报告本进程的峰值 RSS（/proc/self/status 的 VmHWM）。
+// 父进程拿到的 ru_maxrss 会带上 exec 之前那个进程的峰值，量不出小程序的内存
+static void reportPeakRss() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") != 0) continue;
+        std::cerr << "; peak rss: " << strtoul(line.c_str() + 6, nullptr, 10) << " kB" << std::endl;
+        return;
+    }
+}
+
 void REPL(){
     // read - evaluation - print loop
     Assoc global_env = empty();
+    Reader reader(std :: cin);
     while (1){
         #ifndef ONLINE_JUDGE
             std::cout << "scm> ";
         #endif
-        Syntax stx = readSyntax(std :: cin); // read
+        gcSafepoint();
+        if (atEndOfInput(reader)) // 输入读完了就结束，不要一直读空符号
+            break;
+        AllocStats before = alloc_stats;
+        limitsBegin();
         try{
+            Syntax stx = readSyntax(reader); // read
             Expr expr = stx -> parse(global_env); // parse
-            // stx -> show(std :: cout); // syntax print
-            Value val = expr -> eval(global_env);
-            if (val -> v_type == V_TERMINATE)
+            if (!evalAndPrint(expr, global_env))
                 break;
-            if (val -> v_type == V_VOID) {
-                if (isExplicitVoidCall(expr)) val.show(std :: cout);
-            }
-            else val -> show(std :: cout); // value print
         }
         catch (const RuntimeError &RE){
             // #ifndef ONLINE_JUDGE 
             // std :: cout << "DEBUG: " << RE.message() << std::endl;
             // #endif
             std :: cout << "RuntimeError";
+            reportError(RE);
         }
+        reportAllocs(before);
         puts("");
     }
 }
 
+/**
+ * @brief Run a whole script without prompts (--batch)
+ *
+ * The input is read and parsed up front (a form that cannot be read or
+ * parsed prints RuntimeError in its place); the forms are then resolved and
+ * evaluated in order, each result followed by a newline as in the REPL,
+ * into one large buffer that is written out at the end (or when full).
+ * Stops at (exit) or after the last form.
+ */
+static void batch(std::istream &in) {
+    static char out_buf[1 << 20];
+    std::ios::sync_with_stdio(false); // 不再和 stdio 同步，之后只能用 cout，不能 puts
+    std::cout.rdbuf()->pubsetbuf(out_buf, sizeof(out_buf));
+    std::cin.tie(nullptr);
+
+    Assoc global_env = empty();
+    Reader reader(in);
+    std::vector<Expr> forms;
+    while (!atEndOfInput(reader)) {
+        try {
+            Syntax stx = readSyntax(reader);
+            forms.push_back(stx -> parse(global_env));
+        }
+        catch (const RuntimeError &RE) {
+            forms.push_back(Expr(nullptr)); // 读不出或解析不了的，轮到它时再报错，保持输出顺序
+        }
+    }
+    for (const Expr &expr : forms) {
+        gcSafepoint();
+        AllocStats before = alloc_stats;
+        limitsBegin();
+        try {
+            if (expr.get() == nullptr)
+                throw RuntimeError("parse error");
+            if (!evalAndPrint(expr, global_env))
+                break;
+        }
+        catch (const RuntimeError &RE) {
+            std :: cout << "RuntimeError";
+            reportError(RE);
+        }
+        reportAllocs(before);
+        std :: cout << '\n';
+    }
+    std :: cout.flush();
+}
+
+/**
+ * @brief Limits of one --server session; 0 means none
+ */
+struct SessionLimits {
+    int max_sessions = 8;   ///< --sessions: children running at once
+    unsigned timeout = 0;   ///< --session-timeout: seconds, from accept to the end
+    size_t memory_mb = 0;   ///< --session-memory: address space cap of the child
+};
+
+// 会话超时：缓冲里还没写出去的输出就不要了，只告诉客户端超时
+static void sessionTimedOut(int) {
+    static const char msg[] = "\n; session timed out\n";
+    ssize_t ignored = write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+    (void)ignored;
+    _exit(124);
+}
+
+// 会话超出 --session-memory：直接在 new 失败的地方结束，不去展开可能很深的调用和数据
+static void sessionOutOfMemory() {
+    std::cout.flush();
+    static const char msg[] = "\n; session out of memory\n";
+    ssize_t ignored = write(STDOUT_FILENO, msg, sizeof(msg) - 1);
+    (void)ignored;
+    _exit(125);
+}
+
+// fork 出来的子进程里跑一个会话：读完整个程序，像 --batch 一样求值，结果写回连接
+static void session(int conn, const SessionLimits &limits) {
+    if (limits.timeout > 0) {
+        signal(SIGALRM, sessionTimedOut);
+        alarm(limits.timeout);
+    }
+    if (limits.memory_mb > 0) {
+        struct rlimit cap;
+        cap.rlim_cur = cap.rlim_max = (rlim_t)limits.memory_mb << 20;
+        setrlimit(RLIMIT_AS, &cap);
+        std::set_new_handler(sessionOutOfMemory);
+    }
+    std::string program;
+    char buf[1 << 16];
+    for (;;) {
+        ssize_t n = read(conn, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        program.append(buf, n);
+    }
+    dup2(conn, STDOUT_FILENO);
+    close(conn);
+    std::istringstream in(program);
+    batch(in);
+}
+
+/**
+ * @brief Serve evaluation sessions on a Unix socket (--server PATH)
+ *
+ * The prelude (--image, then --prelude FILE) is loaded once. Each
+ * connection is one session: the client writes a whole program and shuts
+ * down its side, and reads back what --batch would have printed, e.g.
+ *
+ *     socat - UNIX-CONNECT:/tmp/scm.sock < job.scm
+ *
+ * Every session runs in a child forked from the warm server, so it starts
+ * with the prelude's globals defined and shares their memory copy-on-write,
+ * while whatever it defines or mutates stays in its own process. A session
+ * that crashes, runs out of memory or times out only loses its own
+ * connection.
+ */
+static int serve(const char *path, const SessionLimits &limits) {
+    parallelShutdown(); // 子进程里没有这些线程，fork 之前先停掉
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (listener < 0 || strlen(path) >= sizeof(addr.sun_path)) {
+        std::cerr << "cannot listen on " << path << std::endl;
+        return 1;
+    }
+    std::strcpy(addr.sun_path, path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listener, 64) < 0) {
+        std::cerr << "cannot listen on " << path << std::endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN); // 客户端提前断开只影响那个会话
+    int running = 0;
+    for (;;) {
+        while (running > 0 && waitpid(-1, nullptr, running >= limits.max_sessions ? 0 : WNOHANG) > 0) running--;
+        int conn = accept(listener, nullptr, nullptr);
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept failed" << std::endl;
+            return 1;
+        }
+        std::cout.flush(); // 子进程会继承缓冲区，先清空免得重复输出
+        std::cerr.flush();
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(listener);
+            signal(SIGPIPE, SIG_DFL);
+            session(conn, limits);
+            _exit(0);
+        }
+        close(conn);
+        if (pid > 0) running++;
+        else std::cerr << "fork failed" << std::endl;
+    }
+}
+
+// --prelude：在 fork 会话之前求值，输出照常写到服务进程自己的 stdout
+static void prelude(const char *path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw RuntimeError("cannot open " + std::string(path));
+    Assoc global_env = empty();
+    Reader reader(in);
+    while (!atEndOfInput(reader)) {
+        Syntax stx = readSyntax(reader);
+        Expr expr = stx -> parse(global_env);
+        if (!evalAndPrint(expr, global_env)) break;
+        std::cout << '\n'; // 和 --batch 一样每个结果一行
+    }
+    std::cout.flush();
+}
+
 
 int main(int argc, char *argv[]) {
-    REPL();
+    bool batch_mode = false;
+    const char *script = nullptr; // --batch 后面可以跟一个文件，没有就读 stdin
+    const char *load_image = nullptr;  // --image：启动时先恢复这个镜像里的全局环境
+    const char *save_image = nullptr;  // --save-image：跑完以后把全局环境存下来，还没算完的 future 不存
+    const char *profile_stacks = "profile.folded"; // --profile 的折叠栈输出，--profile-stacks 可以改
+    const char *server = nullptr;      // --server：在这个 Unix socket 上接受会话
+    const char *prelude_file = nullptr; // --prelude：服务启动时先求值的脚本
+    SessionLimits limits;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--alloc-stats") == 0) report_allocs = true;
+        else if (strcmp(argv[i], "--tree") == 0) use_vm = false;
+        else if (strcmp(argv[i], "--batch") == 0) {
+            batch_mode = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') script = argv[++i];
+        }
+        else if (strcmp(argv[i], "--image") == 0 && i + 1 < argc) load_image = argv[++i];
+        else if (strcmp(argv[i], "--save-image") == 0 && i + 1 < argc) save_image = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0) profiling = true;
+        else if (strcmp(argv[i], "--profile-stacks") == 0 && i + 1 < argc) profile_stacks = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) worker_threads = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc) server = argv[++i];
+        else if (strcmp(argv[i], "--prelude") == 0 && i + 1 < argc) prelude_file = argv[++i];
+        else if (strcmp(argv[i], "--sessions") == 0 && i + 1 < argc) limits.max_sessions = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--session-timeout") == 0 && i + 1 < argc) limits.timeout = (unsigned)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--session-memory") == 0 && i + 1 < argc) limits.memory_mb = (size_t)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--max-steps") == 0 && i + 1 < argc) run_limits.max_steps = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--max-depth") == 0 && i + 1 < argc) run_limits.max_depth = (size_t)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--max-heap") == 0 && i + 1 < argc) run_limits.max_heap_mb = (size_t)std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--time-limit") == 0 && i + 1 < argc) run_limits.time_ms = (unsigned)std::max(0, atoi(argv[++i]));
+    }
+    limitsConfigure();
+    try {
+        if (load_image != nullptr) loadImage(load_image);
+        if (server != nullptr && prelude_file != nullptr) prelude(prelude_file);
+    }
+    catch (const RuntimeError &RE) {
+        std::cerr << RE.message() << std::endl;
+        return 1;
+    }
+    if (server != nullptr) return serve(server, limits);
+    std::ifstream file;
+    if (batch_mode && script != nullptr) {
+        file.open(script, std::ios::binary);
+        if (!file) {
+            std::cerr << "cannot open " << script << std::endl;
+            return 1;
+        }
+    }
+    if (!batch_mode) REPL();
+    else if (script == nullptr) batch(std :: cin);
+    else batch(file);
+    if (report_allocs) reportPeakRss();
+    parallelShutdown(); // 还在跑的 future 跑完，没开始的就不跑了
+    if (profiling) {
+        profileReport(std::cerr);
+        std::ofstream stacks(profile_stacks);
+        if (stacks) profileStacks(stacks);
+        else std::cerr << "cannot open " << profile_stacks << std::endl;
+    }
+    try {
+        if (save_image != nullptr) saveImage(save_image);
+    }
+    catch (const RuntimeError &RE) {
+        std::cerr << RE.message() << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -0,0 +1,135 @@
+/**
+ * @file memo.cpp
+ * @brief The LRU cache behind memoize
+ */
+
+#include "memo.hpp"
+#include "RE.hpp"
+#include "hashtable.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+#include "vm.hpp"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+const size_t MEMO_DEFAULT_CAPACITY = 1 << 16;
+
+/**
+ * @brief Entries in recency order, plus an index from argument hash to entry
+ */
+struct MemoCache {
+    struct Entry {
+        std::vector<Value> args;
+        Value result;
+        size_t hash;
+    };
+    std::list<Entry> entries; // 最近用过的在前面
+    std::unordered_multimap<size_t, std::list<Entry>::iterator> index;
+    std::mutex lock;
+
+    std::list<Entry>::iterator find(const Value *args, int argc, size_t h) {
+        auto range = index.equal_range(h);
+        for (auto it = range.first; it != range.second; ++it) {
+            const std::vector<Value> &key = it->second->args;
+            if ((int)key.size() != argc) continue;
+            int i = 0;
+            while (i < argc && valuesEqual(key[i], args[i])) i++;
+            if (i == argc) return it->second;
+        }
+        return entries.end();
+    }
+
+    // 返回是否因为满了而扔掉了最久没用的那个
+    bool insert(std::vector<Value> &&args, const Value &result, size_t h, size_t capacity) {
+        entries.push_front(Entry{std::move(args), result, h});
+        index.emplace(h, entries.begin());
+        if (entries.size() <= capacity) return false;
+        std::list<Entry>::iterator last = std::prev(entries.end());
+        auto range = index.equal_range(last->hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == last) {
+                index.erase(it);
+                break;
+            }
+        }
+        entries.erase(last);
+        return true;
+    }
+};
+
+Memoized::Memoized(const Value &fn, size_t capacity) : ValueBase(V_MEMO), fn(fn), capacity(capacity), cache(new MemoCache()) {}
+
+Memoized::~Memoized() = default;
+
+void Memoized::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+GcObject *Memoized::gcObject() {
+    return this;
+}
+
+// 收集时没有 worker 在跑，缓存不会同时被改
+void Memoized::traverse(GcVisitor &v) {
+    v.visit(fn);
+    for (auto &e : cache->entries) {
+        for (auto &x : e.args) v.visit(x);
+        v.visit(e.result);
+    }
+}
+
+void Memoized::clearRefs() {
+    fn = Value(nullptr);
+    cache->index.clear();
+    cache->entries.clear();
+}
+
+Value MemoizedV(const Value &fn, size_t capacity) {
+    return Value(poolNew<Memoized>(fn, capacity));
+}
+
+Atom memoName(const Memoized *m) {
+    if (m->fn.type() == V_PROC) return m->fn.as<Procedure>()->name;
+    if (m->fn.type() == V_MEMO) return memoName(m->fn.as<Memoized>());
+    return intern("#<primitive>");
+}
+
+bool memoLookup(const Value &f, const Value *args, int argc, size_t &hash, Value &result) {
+    Memoized *m = f.as<Memoized>();
+    MemoCache &cache = *m->cache;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < argc; i++) h = (h ^ hashEqual(args[i])) * 0x100000001b3ULL;
+    hash = (size_t)h;
+    std::lock_guard<std::mutex> guard(cache.lock);
+    auto it = cache.find(args, argc, hash);
+    if (it == cache.entries.end()) return false;
+    cache.entries.splice(cache.entries.begin(), cache.entries, it);
+    result = it->result;
+    if (profiling) profileMemo(memoName(m), true, false);
+    return true;
+}
+
+void memoStore(const Value &f, std::vector<Value> &&args, size_t hash, const Value &result) {
+    Memoized *m = f.as<Memoized>();
+    MemoCache &cache = *m->cache;
+    std::lock_guard<std::mutex> guard(cache.lock);
+    bool evicted = false;
+    auto it = cache.find(args.data(), args.size(), hash); // 递归或者别的线程可能已经算好存进来了
+    if (it != cache.entries.end()) cache.entries.splice(cache.entries.begin(), cache.entries, it);
+    else evicted = cache.insert(std::move(args), result, hash, m->capacity);
+    if (profiling) profileMemo(memoName(m), false, evicted);
+}
+
+Value memoCall(const Value &f, const Value *args, int argc) {
+    size_t hash;
+    Value result(nullptr);
+    if (memoLookup(f, args, argc, hash, result)) return result;
+    // 算的时候不拿锁：f 多半还会递归调用这个过程
+    std::vector<Value> key(args, args + argc);
+    result = applyValue(f.as<Memoized>()->fn, std::vector<Value>(key));
+    memoStore(f, std::move(key), hash, result);
+    return result;
+}
@@ -0,0 +1,50 @@
+#ifndef MEMO_HPP
+#define MEMO_HPP
+
+/**
+ * @file memo.hpp
+ * @brief memoize and define-memoized: procedures with a bounded LRU cache
+ *
+ * (memoize f [capacity]) returns a procedure that calls f only for
+ * argument lists it has not seen yet and otherwise returns the stored
+ * result. Argument lists are compared with equal? and hashed with
+ * hashEqual, so ints, rationals, symbols, strings and lists of them are
+ * all usable keys; mutating a pair, vector or string after it was used as
+ * an argument leaves the old entry behind. Once capacity entries are
+ * stored, each new one drops the least recently used. A call that raises
+ * an error caches nothing.
+ *
+ * (define-memoized (f x ...) body ...) is
+ * (define f (memoize (lambda (x ...) body ...))), so the recursive calls
+ * of f in body go through the cache as well. In the VM a miss is an
+ * ordinary call; under --tree it is a nested C++ call, and a call to a
+ * memoized procedure is never a tail call, since its result must be
+ * stored after it returns.
+ *
+ * The cache is locked, so futures may share a memoized procedure; two
+ * tasks missing on the same arguments at once both call f. With
+ * --profile, hits and misses are reported per procedure.
+ */
+
+#include "value.hpp"
+#include <cstddef>
+#include <vector>
+
+extern const size_t MEMO_DEFAULT_CAPACITY; ///< Capacity when memoize gets none
+
+Value memoCall(const Value &, const Value *, int); ///< Call a Memoized with argc arguments
+
+/**
+ * @brief The two halves of memoCall, for the VM
+ *
+ * On a hit, memoLookup sets result and returns true. On a miss it only
+ * fills in the hash of the arguments; the VM then runs the procedure as an
+ * ordinary call, with no nested C++ frame, and hands its value to
+ * memoStore when it returns.
+ */
+bool memoLookup(const Value &, const Value *, int, size_t &hash, Value &result);
+void memoStore(const Value &, std::vector<Value> &&, size_t hash, const Value &);
+
+Atom memoName(const Memoized *); ///< Name of the memoized procedure, for --profile
+
+#endif // MEMO_HPP
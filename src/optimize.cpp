@@ -0,0 +1,230 @@
+/**
+ * @file optimize.cpp
+ * @brief Simplification pass run between parsing and resolution
+ *
+ * Works bottom-up on the freshly parsed tree, rewriting child pointers in
+ * place. Only rewrites that cannot change what a program prints are made:
+ * a fold whose evaluation raises an error is skipped so the error still
+ * happens at run time, and only initializers without effects are dropped.
+ */
+
+#include "Def.hpp"
+#include "RE.hpp"
+#include "bigint.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <string>
+#include <vector>
+
+namespace {
+
+// 结果只取决于实参、没有副作用、也不会造出新的可变对象的内建过程
+bool isPure(ExprType t) {
+    switch (t) {
+        case E_PLUS: case E_MINUS: case E_MUL: case E_DIV: case E_MODULO: case E_EXPT:
+        case E_LT: case E_LE: case E_EQ: case E_GE: case E_GT:
+        case E_NOT: case E_EQQ: case E_EQUALQ:
+        case E_BOOLQ: case E_INTQ: case E_NULLQ: case E_PAIRQ: case E_PROCQ: case E_SYMBOLQ:
+        case E_LISTQ: case E_STRINGQ: case E_VECTORQ: case E_HASHTABLEQ:
+        case E_STRINGLENGTH: case E_STRINGEQ: case E_STRINGLT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// 求值既不出错也没有副作用，值也不取决于环境
+bool isLiteral(const Expr &e) {
+    switch (e->e_type) {
+        case E_FIXNUM: case E_RATIONAL: case E_BIGNUM: case E_STRING:
+        case E_TRUE: case E_FALSE: case E_VOID:
+            return true;
+        case E_QUOTE:
+            return static_cast<Quote *>(e.get())->datum != nullptr;
+        default:
+            return false;
+    }
+}
+
+// 丢掉也不影响程序的初值：字面量和 lambda
+bool isDroppable(const Expr &e) {
+    return isLiteral(e) || e->e_type == E_LAMBDA;
+}
+
+// 数和布尔值能写回字面量节点；其他结果（新的 pair、字符串……）不折叠
+Expr literal(const Value &v) {
+    switch (v.type()) {
+        case V_INT:
+            return Expr(new Fixnum(v.asInt()));
+        case V_BIGINT: {
+            std::string s;
+            appendDecimal(s, v);
+            return Expr(new Bignum(s));
+        }
+        case V_RATIONAL: {
+            const Rational *r = v.as<Rational>();
+            if (r->numerator.type() == V_INT && r->denominator.type() == V_INT)
+                return rationalLiteral(r->numerator.asInt(), r->denominator.asInt());
+            std::string s;
+            appendDecimal(s, r->numerator);
+            s += '/';
+            appendDecimal(s, r->denominator);
+            return Expr(new Bignum(s));
+        }
+        case V_BOOL:
+            return v.isFalse() ? Expr(new False()) : Expr(new True());
+        default:
+            return Expr(nullptr);
+    }
+}
+
+// 依次交给 f 每一个直接子表达式的引用，f 可以就地替换
+template <typename F>
+void eachChild(const Expr &e, F f) {
+    switch (e->e_type) {
+        case E_AND:
+            for (auto &r : static_cast<AndVar *>(e.get())->rands) f(r);
+            return;
+        case E_OR:
+            for (auto &r : static_cast<OrVar *>(e.get())->rands) f(r);
+            return;
+        case E_BEGIN:
+            for (auto &x : static_cast<Begin *>(e.get())->es) f(x);
+            return;
+        case E_IF: {
+            If *x = static_cast<If *>(e.get());
+            f(x->cond);
+            f(x->conseq);
+            f(x->alter);
+            return;
+        }
+        case E_COND:
+            for (auto &clause : static_cast<Cond *>(e.get())->clauses) {
+                for (auto &x : clause) f(x);
+            }
+            return;
+        case E_APPLY: {
+            Apply *x = static_cast<Apply *>(e.get());
+            f(x->rator);
+            for (auto &r : x->rand) f(r);
+            return;
+        }
+        case E_LAMBDA:
+            f(static_cast<Lambda *>(e.get())->e);
+            return;
+        case E_DEFINE:
+            f(static_cast<Define *>(e.get())->e);
+            return;
+        case E_LET: {
+            Let *x = static_cast<Let *>(e.get());
+            for (auto &p : x->bind) f(p.second);
+            f(x->body);
+            return;
+        }
+        case E_LETREC: {
+            Letrec *x = static_cast<Letrec *>(e.get());
+            for (auto &p : x->bind) f(p.second);
+            f(x->body);
+            return;
+        }
+        case E_SET:
+            f(static_cast<Set *>(e.get())->e);
+            return;
+        default:
+            break;
+    }
+    if (Unary *u = dynamic_cast<Unary *>(e.get())) {
+        f(u->rand);
+    } else if (Binary *b = dynamic_cast<Binary *>(e.get())) {
+        f(b->rand1);
+        f(b->rand2);
+    } else if (Variadic *v = dynamic_cast<Variadic *>(e.get())) {
+        for (auto &r : v->rands) f(r);
+    }
+}
+
+// 子树里有没有按这个名字引用或者 set! 的地方；不管遮蔽，宁可多留
+bool mentions(const Expr &e, Atom a) {
+    if (e->e_type == E_VAR) return static_cast<Var *>(e.get())->atom == a;
+    if (e->e_type == E_SET && static_cast<Set *>(e.get())->atom == a) return true;
+    bool found = false;
+    eachChild(e, [&](Expr &c) {
+        if (!found) found = mentions(c, a);
+    });
+    return found;
+}
+
+// 所有实参都是字面量的纯内建过程：现在就算出来
+Expr fold(const Expr &e) {
+    if (!isPure(e->e_type)) return e;
+    bool constant = true;
+    bool primitive = false; // Apply 等同样 e_type 的节点不在这里处理
+    if (Unary *u = dynamic_cast<Unary *>(e.get())) {
+        primitive = true;
+        constant = isLiteral(u->rand);
+    } else if (Binary *b = dynamic_cast<Binary *>(e.get())) {
+        primitive = true;
+        constant = isLiteral(b->rand1) && isLiteral(b->rand2);
+    } else if (Variadic *v = dynamic_cast<Variadic *>(e.get())) {
+        primitive = true;
+        for (auto &r : v->rands) constant = constant && isLiteral(r);
+    }
+    if (!primitive || !constant) return e;
+    try {
+        Assoc none = empty();
+        Expr folded = literal(e->eval(none));
+        return folded.get() != nullptr ? folded : e;
+    }
+    catch (const RuntimeError &) {
+        return e; // (/ 1 0) 之类：原样留着，运行到这里时再报错
+    }
+}
+
+Expr simplifyBegin(const Expr &e) {
+    Begin *x = static_cast<Begin *>(e.get());
+    std::vector<Expr> es;
+    for (size_t i = 0; i < x->es.size(); i++) {
+        const Expr &item = x->es[i];
+        bool last = i + 1 == x->es.size();
+        if (item->e_type == E_BEGIN && (!last || !static_cast<Begin *>(item.get())->es.empty())) {
+            // 内层 begin 已经化简过，直接摊平；空的 begin 只在末尾时有值（#<void>）
+            for (auto &inner : static_cast<Begin *>(item.get())->es) es.push_back(inner);
+        } else if (last || !isLiteral(item)) {
+            es.push_back(item); // 中间的字面量值会被丢掉，本身也没有效果
+        }
+    }
+    if (es.size() == 1) return es[0];
+    x->es = es;
+    return e;
+}
+
+Expr simplifyLet(const Expr &e) {
+    Let *x = static_cast<Let *>(e.get());
+    std::vector<std::pair<Atom, Expr>> live;
+    for (auto &p : x->bind) {
+        if (!isDroppable(p.second) || mentions(x->body, p.first)) live.push_back(p);
+    }
+    if (live.empty()) return x->body; // body 里的地址在 resolve 时按少一层 frame 算
+    x->bind = live;
+    return e;
+}
+
+} // namespace
+
+Expr optimize(const Expr &e) {
+    eachChild(e, [](Expr &c) { c = optimize(c); });
+    switch (e->e_type) {
+        case E_IF: {
+            If *x = static_cast<If *>(e.get());
+            if (!isLiteral(x->cond)) return e;
+            Assoc none = empty();
+            return x->cond->eval(none).isFalse() ? x->alter : x->conseq;
+        }
+        case E_BEGIN:
+            return simplifyBegin(e);
+        case E_LET:
+            return simplifyLet(e);
+        default:
+            return fold(e);
+    }
+}
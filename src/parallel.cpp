@@ -0,0 +1,338 @@
+/**
+ * @file parallel.cpp
+ * @brief Task deques, worker threads, futures and parallel-map
+ */
+
+#include "parallel.hpp"
+#include "gc.hpp"
+#include "limits.hpp"
+#include "pool.hpp"
+#include "profile.hpp"
+#include "vm.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+int worker_threads = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+thread_local std::ostream *task_output = nullptr;
+thread_local int task_depth = 0;
+
+/**
+ * @brief One call of a thunk, or for parallel-map one call per element of a chunk
+ */
+struct Task {
+    enum State { QUEUED, RUNNING, DONE };
+    std::atomic<int> state;      ///< Whoever moves it from QUEUED to RUNNING runs it
+    Value fn;                    ///< Taken by the running thread
+    std::vector<Value> inputs;   ///< Argument of each call of fn; unused for a thunk
+    bool thunk;                  ///< Call fn once with no arguments
+    std::vector<Value> results;  ///< Stop at the call that failed
+    bool failed;
+    std::string error;
+    std::string output;          ///< What display wrote while it ran
+    AllocStats allocs;           ///< Pool counts of the run, credited to whoever touches it
+    uint64_t steps;              ///< Calls made by the run, likewise
+    std::atomic<bool> delivered; ///< output and allocs handed over already
+    Task(const Value &, std::vector<Value> &&, bool);
+};
+
+Task::Task(const Value &fn, std::vector<Value> &&inputs, bool thunk)
+    : state(QUEUED), fn(fn), inputs(std::move(inputs)), thunk(thunk), failed(false), allocs(), steps(0), delivered(false) {}
+
+namespace {
+
+// 每个线程 CHUNKS_PER_THREAD 块：块太大时快的线程干等，太小时调度开销占上风
+const size_t CHUNKS_PER_THREAD = 4;
+
+struct Deque {
+    std::mutex lock;
+    std::deque<std::shared_ptr<Task>> tasks;
+};
+
+struct Pool {
+    std::vector<std::unique_ptr<Deque>> deques; // 0 归主线程，i 归第 i 个 worker
+    std::vector<std::thread> threads;
+    std::mutex lock;                  // 保护 active，以及睡眠和唤醒
+    std::condition_variable wake;     // 有任务入队，或者有任务做完了
+    std::atomic<size_t> queued;       // 所有 deque 里的条目，包括已经被别人抢先跑掉的
+    int active;                       // 醒着的 worker
+    std::atomic<bool> stop;
+    Pool() : queued(0), active(0), stop(false) {}
+};
+
+// 第一个任务入队时才启动，之后不再释放：退出时还排着的任务就留在里面
+Pool *pool = nullptr;
+thread_local size_t own_deque = 0;
+
+bool claim(Task &t) {
+    int expected = Task::QUEUED;
+    return t.state.compare_exchange_strong(expected, Task::RUNNING);
+}
+
+void run(Task &t) {
+    // 自己持有过程和实参：即使 future 在跑的途中被回收，它们也不会被清掉
+    Value fn = std::move(t.fn);
+    std::vector<Value> inputs = std::move(t.inputs);
+    std::ostringstream out;
+    std::ostream *outer_output = task_output;
+    bool outer_profiling = profiling;
+    AllocStats before = alloc_stats;
+    RunStats outer_budget = run_stats;
+    task_output = &out;
+    profiling = false;
+    task_depth++;
+    limitsBegin(); // 任务有自己的步数和时间预算
+    try {
+        if (t.thunk) {
+            t.results.push_back(applyValue(fn, std::vector<Value>()));
+        } else {
+            for (const Value &x : inputs) t.results.push_back(applyValue(fn, std::vector<Value>(1, x)));
+        }
+    }
+    catch (const RuntimeError &e) {
+        t.failed = true;
+        t.error = e.message();
+    }
+    catch (const std::exception &e) {
+        t.failed = true;
+        t.error = e.what();
+    }
+    task_depth--;
+    profiling = outer_profiling;
+    task_output = outer_output;
+    fn = Value(nullptr); // 先放掉，这些 free 也算在这个任务头上
+    inputs.clear();
+    t.output = out.str();
+    t.allocs.allocs = alloc_stats.allocs - before.allocs;
+    t.allocs.frees = alloc_stats.frees - before.frees;
+    t.allocs.chunks = alloc_stats.chunks - before.chunks;
+    t.allocs.live_bytes = alloc_stats.live_bytes - before.live_bytes;
+    t.steps = run_stats.steps - outer_budget.steps;
+    alloc_stats = before; // 计数跟着结果走，由 touch 它的线程记账
+    run_stats = outer_budget;
+    t.state.store(Task::DONE, std::memory_order_release);
+    if (pool != nullptr) {
+        { std::lock_guard<std::mutex> guard(pool->lock); } // 等待的线程要么还没检查，要么已经在 wait 里
+        pool->wake.notify_all();
+    }
+}
+
+// 自己的 deque 从尾部拿最新的，别人的从头部偷最早的
+std::shared_ptr<Task> take() {
+    size_t n = pool->deques.size();
+    for (size_t k = 0; k < n; k++) {
+        Deque &d = *pool->deques[(own_deque + k) % n];
+        std::lock_guard<std::mutex> guard(d.lock);
+        if (d.tasks.empty()) continue;
+        std::shared_ptr<Task> t;
+        if (k == 0) {
+            t = std::move(d.tasks.back());
+            d.tasks.pop_back();
+        } else {
+            t = std::move(d.tasks.front());
+            d.tasks.pop_front();
+        }
+        pool->queued--;
+        return t;
+    }
+    return nullptr;
+}
+
+void workerMain(size_t id) {
+    own_deque = id;
+    gcWorkerThread();
+    std::unique_lock<std::mutex> lock(pool->lock);
+    for (;;) {
+        pool->wake.wait(lock, [] { return pool->stop || pool->queued > 0; });
+        if (pool->stop) return;
+        pool->active++;
+        lock.unlock();
+        while (!pool->stop) {
+            std::shared_ptr<Task> t = take();
+            if (!t) break;
+            if (claim(*t)) run(*t); // 抢不到的是已经被 touch 的线程自己跑掉的
+        }
+        lock.lock();
+        pool->active--; // 这时手里已经没有任何 Value，收集器可以开始
+    }
+}
+
+void startPool() {
+    pool = new Pool();
+    for (int i = 0; i <= worker_threads; i++) pool->deques.emplace_back(new Deque());
+    gcShare(); // 必须在第一个 worker 起来之前
+    for (int i = 1; i <= worker_threads; i++) pool->threads.emplace_back(workerMain, (size_t)i);
+}
+
+void submit(const std::shared_ptr<Task> &t) {
+    if (worker_threads == 0) return; // 没有 worker：留到 touch 时在那个线程上跑
+    if (pool == nullptr) startPool();
+    Deque &d = *pool->deques[own_deque];
+    {
+        std::lock_guard<std::mutex> guard(d.lock);
+        d.tasks.push_back(t);
+    }
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->queued++;
+    }
+    pool->wake.notify_all();
+}
+
+// 等 t 做完；还没人跑就自己跑，别人在跑就先帮忙做别的任务
+void waitFor(Task &t) {
+    if (claim(t)) {
+        run(t);
+        return;
+    }
+    while (t.state.load(std::memory_order_acquire) != Task::DONE) {
+        if (pool == nullptr) throw RuntimeError("touch: the future is waiting for itself");
+        std::shared_ptr<Task> other = take();
+        if (other) {
+            if (claim(*other)) run(*other);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pool->lock);
+        pool->wake.wait(lock, [&t] { return t.state.load() == Task::DONE || pool->queued > 0; });
+    }
+}
+
+// 第一次 touch 时把缓冲的输出写到当前线程的输出里，分配计数也记到当前线程
+void deliver(Task &t) {
+    if (t.delivered.exchange(true)) return;
+    if (!t.output.empty()) (task_output != nullptr ? *task_output : std::cout) << t.output;
+    alloc_stats.allocs += t.allocs.allocs;
+    alloc_stats.frees += t.allocs.frees;
+    alloc_stats.chunks += t.allocs.chunks;
+    alloc_stats.live_bytes += t.allocs.live_bytes;
+    run_stats.steps += t.steps;
+}
+
+void cancel(Task &t) {
+    int expected = Task::QUEUED;
+    t.state.compare_exchange_strong(expected, Task::DONE);
+}
+
+} // namespace
+
+WorkerPause::WorkerPause() : idle(true) {
+    if (pool == nullptr) return;
+    lock = std::unique_lock<std::mutex>(pool->lock);
+    idle = pool->active == 0;
+}
+
+Future::Future(const std::shared_ptr<Task> &t) : ValueBase(V_FUTURE), task(t) {}
+
+void Future::show(std::ostream &os) {
+    os << "#<future>";
+}
+
+GcObject *Future::gcObject() {
+    return this;
+}
+
+// 收集时没有 worker 在跑，任务里的值不会同时被改
+void Future::traverse(GcVisitor &v) {
+    v.visit(task->fn);
+    for (auto &x : task->inputs) v.visit(x);
+    for (auto &x : task->results) v.visit(x);
+}
+
+void Future::clearRefs() {
+    cancel(*task); // 没人能再 touch 它了，还没跑的就不用跑了
+    task->fn = Value(nullptr);
+    task->inputs.clear();
+    task->results.clear();
+}
+
+Value makeFuture(const Value &thunk) {
+    std::shared_ptr<Task> t = std::make_shared<Task>(thunk, std::vector<Value>(), true);
+    Value future(poolNew<Future>(t));
+    submit(t);
+    return future;
+}
+
+bool futureSnapshot(const Future *f, FutureSnapshot &s) {
+    const Task &t = *f->task;
+    if (t.state.load(std::memory_order_acquire) != Task::DONE) return false;
+    s.failed = t.failed || t.results.empty(); // 被回收器清掉结果的，touch 时也是报错
+    s.error = t.failed ? t.error : "touch: the future was collected";
+    s.output = t.delivered.load() ? std::string() : t.output;
+    s.result = s.failed ? Value(nullptr) : t.results[0];
+    return true;
+}
+
+Value finishedFutureV(const FutureSnapshot &s) {
+    std::shared_ptr<Task> t = std::make_shared<Task>(Value(nullptr), std::vector<Value>(), true);
+    t->state.store(Task::DONE);
+    t->failed = s.failed;
+    t->error = s.error;
+    t->output = s.output;
+    if (!s.failed) t->results.push_back(s.result);
+    return Value(poolNew<Future>(t));
+}
+
+void setFutureResult(const Value &future, const Value &result) {
+    Task &t = *future.as<Future>()->task;
+    if (!t.failed) t.results[0] = result;
+}
+
+Value touchFuture(const Value &v) {
+    if (v.type() != V_FUTURE) throw RuntimeError("touch: not a future");
+    std::shared_ptr<Task> t = v.as<Future>()->task;
+    waitFor(*t);
+    deliver(*t);
+    if (t->failed) throw RuntimeError(t->error);
+    if (t->results.empty()) throw RuntimeError("touch: the future was collected");
+    return t->results[0];
+}
+
+Value parallelMap(const Value &f, const Value &list) {
+    std::vector<Value> items;
+    for (Value p = list; p.type() != V_NULL; p = p.as<Pair>()->cdr) {
+        if (p.type() != V_PAIR) throw RuntimeError("parallel-map: not a list");
+        items.push_back(p.as<Pair>()->car);
+    }
+    if (items.empty()) return NullV();
+    size_t chunks = worker_threads == 0 ? 1 : std::min(items.size(), (size_t)(worker_threads + 1) * CHUNKS_PER_THREAD);
+    std::vector<std::shared_ptr<Task>> tasks;
+    for (size_t i = 0; i < chunks; i++) {
+        size_t lo = items.size() * i / chunks, hi = items.size() * (i + 1) / chunks;
+        tasks.push_back(std::make_shared<Task>(f, std::vector<Value>(items.begin() + lo, items.begin() + hi), false));
+    }
+    // 倒着入队：自己从尾部先拿到第一块，别的线程从头部偷走后面的
+    for (size_t i = chunks; i-- > 0;) submit(tasks[i]);
+    for (size_t i = 0; i < chunks; i++) {
+        Task &t = *tasks[i];
+        waitFor(t);
+        deliver(t);
+        if (t.failed) { // 和顺序的 map 一样：输出到出错的那一次调用为止
+            for (size_t j = i + 1; j < chunks; j++) cancel(*tasks[j]);
+            throw RuntimeError(t.error);
+        }
+    }
+    Value result = NullV();
+    for (size_t i = chunks; i-- > 0;) {
+        std::vector<Value> &results = tasks[i]->results;
+        for (size_t k = results.size(); k-- > 0;) result = PairV(results[k], result);
+    }
+    return result;
+}
+
+void parallelShutdown() {
+    if (pool == nullptr) return;
+    {
+        std::lock_guard<std::mutex> guard(pool->lock);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+    for (auto &t : pool->threads) t.join();
+    pool = nullptr; // 之后再有任务就另起一个（比如 --server fork 出来的会话）
+}
@@ -0,0 +1,81 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+/**
+ * @file parallel.hpp
+ * @brief Futures and parallel-map on a work-stealing thread pool
+ *
+ * (future thunk) queues a call of thunk as a task and returns at once;
+ * (touch f) waits for it and returns its value. (parallel-map f list)
+ * cuts the list into chunks, one task each, and returns the list of
+ * results. Every thread, the main one included, owns a deque of tasks: it
+ * pushes and pops its own at the back and, when that is empty, steals from
+ * the front of the others'. A thread waiting for a result keeps running
+ * queued tasks meanwhile, so nested futures cannot starve the pool.
+ *
+ * What a task may share with the rest of the program:
+ *  - reading globals, closures, pairs, vectors and other values is safe:
+ *    refcounts are atomic, pool allocation is per thread, the symbol table
+ *    is locked, global cells never move, and code is compiled before it
+ *    runs, so nothing is written behind the program's back;
+ *  - define / set! of a global inside a task is an error, since the cells
+ *    are read without locking (here that includes internal defines);
+ *  - mutating a structure that another running task or the main program
+ *    uses at the same time is a data race and is not detected.
+ *
+ * What display writes inside a task is buffered with the task and written
+ * out by the thread that first touches it -- by parallel-map in list order
+ * -- so a program prints the same text whatever the number of threads.
+ * Tasks are not profiled. With --threads 0 no worker is started and each
+ * task runs on the thread that touches it.
+ */
+
+#include "RE.hpp"
+#include "value.hpp"
+#include <mutex>
+#include <ostream>
+#include <string>
+
+extern int worker_threads;                      ///< --threads; default one less than the number of cores
+extern thread_local std::ostream *task_output;  ///< display's stream inside a task, nullptr for std::cout
+extern thread_local int task_depth;             ///< Tasks running on this thread (a waiting thread runs others)
+
+Value makeFuture(const Value &);                 ///< (future thunk)
+Value touchFuture(const Value &);                ///< (touch future)
+Value parallelMap(const Value &, const Value &); ///< (parallel-map f list)
+void parallelShutdown(); ///< Let running tasks finish and stop the workers; queued ones never run, later ones start a new pool
+
+/**
+ * @brief What an image keeps of a future whose task has finished (image.cpp)
+ *
+ * The loaded future answers touch at once, with the same value or error,
+ * and prints the output the task buffered if no touch has printed it yet.
+ */
+struct FutureSnapshot {
+    bool failed;
+    std::string error;
+    std::string output;  ///< Buffered display output not delivered yet
+    Value result;        ///< Unbound if failed
+    FutureSnapshot() : failed(false), result(nullptr) {}
+};
+bool futureSnapshot(const Future *, FutureSnapshot &); ///< false while the task has not finished
+Value finishedFutureV(const FutureSnapshot &);
+void setFutureResult(const Value &future, const Value &result); ///< Fills in result after loading its objects
+
+/**
+ * @brief Globals are read without locks, so tasks must not write them
+ */
+inline void checkGlobalWrite() {
+    if (task_depth > 0) throw RuntimeError("Cannot define or set! a global inside a future");
+}
+
+/**
+ * @brief Held by the collector: while idle, no worker runs a task or can start one
+ */
+struct WorkerPause {
+    std::unique_lock<std::mutex> lock;
+    bool idle;
+    WorkerPause();
+};
+
+#endif // PARALLEL_HPP
@@ -26,6 +26,97 @@ using std::pair;
 extern std::map<std::string, ExprType> primitives;
 extern std::map<std::string, ExprType> reserved_words;
 
+int gcd(int a, int b); // expr.cpp
+
+// HELPER FUNCTION OF CONVERTING TO NUMBER
+std::pair<bool, std::pair<int, int>> parse_rational(const std::string &s) {
+    int n = s.size();
+    int i = 0;
+    int sign = 1;
+
+    // optional sign
+    if (s[i] == '+') i++;
+    else if (s[i] == '-') sign = -1, i++;
+
+    if (i >= n) return {false, {0,1}};
+
+    // integer part
+    long long int_part = 0;
+    bool has_int = false;
+
+    while (i < n && isdigit(s[i])) {
+        has_int = true;
+        int_part = int_part * 10 + (s[i] - '0');
+        i++;
+    }
+
+    // fractional part
+    long long frac_part = 0;
+    long long frac_den = 1;
+    bool has_frac = false;
+
+    if (i < n && s[i] == '.') {
+        i++;
+        while (i < n && isdigit(s[i])) {
+            has_frac = true;
+            frac_part = frac_part * 10 + (s[i] - '0');
+            frac_den *= 10;
+            i++;
+        }
+    }
+
+    // scientific notation
+    long long exp_val = 0;
+    int exp_sign = 1;
+
+    if (i < n && (s[i] == 'e' || s[i] == 'E')) {
+        i++;
+        if (i < n && (s[i] == '+' || s[i] == '-')) {
+            exp_sign = (s[i] == '-') ? -1 : 1;
+            i++;
+        }
+        if (i >= n || !isdigit(s[i])) return {false, {0,1}};
+        while (i < n && isdigit(s[i])) {
+            exp_val = exp_val * 10 + (s[i] - '0');
+            i++;
+        }
+    }
+
+    // no stray characters
+    if (i != n) return {false, {0,1}};
+
+    if (!has_int && !has_frac) return {false, {0,1}};
+
+    // Build rational: (int_part + frac_part/frac_den) * 10^(exp_sign * exp_val)
+    long long num = int_part * frac_den + frac_part;
+    long long den = frac_den;
+
+    // apply exponent
+    long long e = exp_val;
+
+    if (exp_sign == 1) {
+        while (e--) {
+            num *= 10;
+        }
+    } else {
+        while (e--) {
+            den *= 10;
+        }
+    }
+
+    num *= sign;
+    int Gcd = gcd(num, den);
+    num /= Gcd;
+    den /= Gcd;
+    if (den < 0) {
+      num = -num;
+      den = -den;
+    }
+    
+    return {true, {num, den}};
+}
+
+
 /**
  * @brief Default parse method (should be overridden by subclasses)
  */
@@ -39,13 +130,35 @@ Expr Number::parse(Assoc &env) { // n从何来，这个函数是 Number 类的
 
 Expr RationalSyntax::parse(Assoc &env) {
     if (denominator == 0) throw RuntimeError("Invalid denominator");
-    else return Expr(new RationalNum(numerator, denominator));
+    else return rationalLiteral(numerator, denominator);
+}
+
+Expr BigNumberSyntax::parse(Assoc &env) {
+    return Expr(new Bignum(s));
 }
 
 Expr SymbolSyntax::parse(Assoc &env) {
+    // 变量名检查与数字识别只在 parse 时做一次，Var::eval 只负责查找
+    if (('0' <= s[0] && s[0] <= '9') || s[0] == '.' || s[0] == '@') throw RuntimeError("the first character of var is invalid");
+    for (int i = 0; i < s.size(); i++) {
+        if (s[i] == '#' || s[i] == '\'' || s[i] == '\"' || s[i] == '`') throw RuntimeError("the var cannot contain invalid char");
+    }
+    // try to convert to number
+    auto try_convert = parse_rational(s);
+    if (try_convert.first) {
+        if (try_convert.second.second == 1) return Expr(new Fixnum(try_convert.second.first));
+        return rationalLiteral(try_convert.second.first, try_convert.second.second);
+    }
     return Expr(new Var(s));
 }
 
+Expr VectorSyntax::parse(Assoc &env) { // 向量字面量自求值，等同于 '#(...)
+    VectorSyntax *copy = new VectorSyntax();
+    Syntax quoted(copy);
+    copy->stxs = stxs;
+    return Expr(new Quote(quoted));
+}
+
 Expr StringSyntax::parse(Assoc &env) {
     return Expr(new StringExpr(s));
 }
@@ -58,6 +171,14 @@ Expr FalseSyntax::parse(Assoc &env) {
     return Expr(new False());
 }
 
+// delay 的操作数包成 (lambda () e)，剩下的都交给闭包：解析、编译和捕获环境
+static Expr delayThunk(const Syntax &stx, Assoc &env, int line, int column) {
+    Lambda *lambda = new Lambda(vector<Atom>(), new Begin(vector<Expr>(1, stx->parse(env))));
+    Expr result(lambda);
+    if (line > 0) lambda->name = intern("promise@" + std::to_string(line) + ":" + std::to_string(column));
+    return result;
+}
+
 Expr List::parse(Assoc &env) {
     if (stxs.empty()) {
         return Expr(new Quote(Syntax(new List())));
@@ -73,7 +194,7 @@ Expr List::parse(Assoc &env) {
     }
     else{
     string op = id->s; // a string，应该是对应的syntax文本
-    if (find(op, env).get() != nullptr) {
+    if (find(id->atom, env).bound()) {
         //TODO: TO COMPLETE THE PARAMETER PARSER LOGIC
         vector<Expr> parameters; 
         for (int i = 1; i < stxs.size(); i++) {
@@ -225,8 +346,8 @@ Expr List::parse(Assoc &env) {
             }
             throw RuntimeError("Wrong arg number for void");
         } else if (op_type == E_DISPLAY) {
-            if (parameters.size() == 1) {
-                return Expr(new Display(parameters[0]));
+            if (parameters.size() == 1 || parameters.size() == 2) {
+                return Expr(new Display(parameters));
             }
             throw RuntimeError("Wrong arg number for display");
         } else if (op_type == E_EXIT) {
@@ -240,6 +361,176 @@ Expr List::parse(Assoc &env) {
         } else if (op_type == E_SETCDR) {
             if (stxs.size() != 3) throw RuntimeError("Wrong arg num for setcdr!");
             return (new SetCdr(stxs[1]->parse(env), stxs[2]->parse(env)));
+        } else if (op_type == E_MAKEVECTOR) {
+            if (parameters.size() == 1 || parameters.size() == 2) {
+                return Expr(new MakeVector(parameters));
+            }
+            throw RuntimeError("Wrong arg number for make-vector");
+        } else if (op_type == E_VECTOR) {
+            return Expr(new VectorFunc(parameters));
+        } else if (op_type == E_VECTORREF) {
+            if (parameters.size() == 2) {
+                return Expr(new VectorRef(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for vector-ref");
+        } else if (op_type == E_VECTORSET) {
+            if (parameters.size() == 3) {
+                return Expr(new VectorSet(parameters));
+            }
+            throw RuntimeError("Wrong arg number for vector-set!");
+        } else if (op_type == E_VECTORLENGTH) {
+            if (parameters.size() == 1) {
+                return Expr(new VectorLength(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for vector-length");
+        } else if (op_type == E_VECTORFILL) {
+            if (parameters.size() == 2) {
+                return Expr(new VectorFill(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for vector-fill!");
+        } else if (op_type == E_LIST2VECTOR) {
+            if (parameters.size() == 1) {
+                return Expr(new ListToVector(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for list->vector");
+        } else if (op_type == E_VECTOR2LIST) {
+            if (parameters.size() == 1) {
+                return Expr(new VectorToList(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for vector->list");
+        } else if (op_type == E_VECTORQ) {
+            if (parameters.size() == 1) {
+                return Expr(new IsVector(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for vector?");
+        } else if (op_type == E_MAKEHASH) {
+            if (parameters.size() <= 1) {
+                return Expr(new MakeHashTable(parameters));
+            }
+            throw RuntimeError("Wrong arg number for make-hash-table");
+        } else if (op_type == E_HASHREF) {
+            if (parameters.size() == 2 || parameters.size() == 3) {
+                return Expr(new HashTableRef(parameters));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-ref");
+        } else if (op_type == E_HASHSET) {
+            if (parameters.size() == 3) {
+                return Expr(new HashTableSet(parameters));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-set!");
+        } else if (op_type == E_FUTURE) {
+            if (parameters.size() == 1) {
+                return Expr(new FutureFunc(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for future");
+        } else if (op_type == E_TOUCH) {
+            if (parameters.size() == 1) {
+                return Expr(new Touch(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for touch");
+        } else if (op_type == E_PARALLELMAP) {
+            if (parameters.size() == 2) {
+                return Expr(new ParallelMap(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for parallel-map");
+        } else if (op_type == E_MEMOIZE) {
+            if (parameters.size() == 1 || parameters.size() == 2) {
+                return Expr(new Memoize(parameters));
+            }
+            throw RuntimeError("Wrong arg number for memoize");
+        } else if (op_type == E_FORCE || op_type == E_MAKEPROMISE || op_type == E_PROMISEQ
+                   || op_type == E_STREAMCAR || op_type == E_STREAMCDR) {
+            if (parameters.size() != 1) throw RuntimeError("Wrong arg number for " + op);
+            if (op_type == E_FORCE) return Expr(new Force(parameters[0]));
+            if (op_type == E_MAKEPROMISE) return Expr(new MakePromise(parameters[0]));
+            if (op_type == E_PROMISEQ) return Expr(new IsPromise(parameters[0]));
+            if (op_type == E_STREAMCAR) return Expr(new StreamCar(parameters[0]));
+            return Expr(new StreamCdr(parameters[0]));
+        } else if (op_type == E_STREAMMAP || op_type == E_STREAMFILTER || op_type == E_STREAMTAKE) {
+            if (parameters.size() != 2) throw RuntimeError("Wrong arg number for " + op);
+            if (op_type == E_STREAMMAP) return Expr(new StreamMap(parameters[0], parameters[1]));
+            if (op_type == E_STREAMFILTER) return Expr(new StreamFilter(parameters[0], parameters[1]));
+            return Expr(new StreamTake(parameters[0], parameters[1]));
+        } else if (op_type == E_STREAM2LIST) {
+            if (parameters.size() == 1 || parameters.size() == 2) {
+                return Expr(new StreamToList(parameters));
+            }
+            throw RuntimeError("Wrong arg number for stream->list");
+        } else if (op_type == E_STRINGLENGTH || op_type == E_STRING2SYMBOL || op_type == E_SYMBOL2STRING
+                   || op_type == E_NUMBER2STRING || op_type == E_STRING2NUMBER || op_type == E_GETOUTPUTSTRING) {
+            if (parameters.size() != 1) throw RuntimeError("Wrong arg number for " + op);
+            if (op_type == E_STRINGLENGTH) return Expr(new StringLength(parameters[0]));
+            if (op_type == E_STRING2SYMBOL) return Expr(new StringToSymbol(parameters[0]));
+            if (op_type == E_SYMBOL2STRING) return Expr(new SymbolToString(parameters[0]));
+            if (op_type == E_NUMBER2STRING) return Expr(new NumberToString(parameters[0]));
+            if (op_type == E_STRING2NUMBER) return Expr(new StringToNumber(parameters[0]));
+            return Expr(new GetOutputString(parameters[0]));
+        } else if (op_type == E_STRINGEQ || op_type == E_STRINGLT) {
+            if (parameters.size() != 2) throw RuntimeError("Wrong arg number for " + op);
+            if (op_type == E_STRINGEQ) return Expr(new StringEq(parameters[0], parameters[1]));
+            return Expr(new StringLess(parameters[0], parameters[1]));
+        } else if (op_type == E_STRINGAPPEND) {
+            return Expr(new StringAppend(parameters));
+        } else if (op_type == E_SUBSTRING) {
+            if (parameters.size() == 2 || parameters.size() == 3) {
+                return Expr(new Substring(parameters));
+            }
+            throw RuntimeError("Wrong arg number for substring");
+        } else if (op_type == E_WRITESTRING) {
+            if (parameters.size() == 1 || parameters.size() == 2) {
+                return Expr(new WriteString(parameters));
+            }
+            throw RuntimeError("Wrong arg number for write-string");
+        } else if (op_type == E_OPENOUTPUTSTRING) {
+            if (parameters.size() == 0) {
+                return Expr(new OpenOutputString(parameters));
+            }
+            throw RuntimeError("Wrong arg number for open-output-string");
+        } else if (op_type == E_RUNTIMESTATS) {
+            if (parameters.size() == 0) {
+                return Expr(new RuntimeStats(parameters));
+            }
+            throw RuntimeError("Wrong arg number for runtime-stats");
+        } else if (op_type == E_HASHDELETE) {
+            if (parameters.size() == 2) {
+                return Expr(new HashTableDelete(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-delete!");
+        } else if (op_type == E_HASHCONTAINS) {
+            if (parameters.size() == 2) {
+                return Expr(new HashTableContains(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-contains?");
+        } else if (op_type == E_HASHCOUNT) {
+            if (parameters.size() == 1) {
+                return Expr(new HashTableCount(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-count");
+        } else if (op_type == E_HASHKEYS) {
+            if (parameters.size() == 1) {
+                return Expr(new HashTableKeys(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-keys");
+        } else if (op_type == E_HASHVALUES) {
+            if (parameters.size() == 1) {
+                return Expr(new HashTableValues(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table-values");
+        } else if (op_type == E_HASH2ALIST) {
+            if (parameters.size() == 1) {
+                return Expr(new HashTableToAlist(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table->alist");
+        } else if (op_type == E_HASHTABLEQ) {
+            if (parameters.size() == 1) {
+                return Expr(new IsHashTable(parameters[0]));
+            }
+            throw RuntimeError("Wrong arg number for hash-table?");
+        } else if (op_type == E_EQUALQ) {
+            if (parameters.size() == 2) {
+                return Expr(new IsEqual(parameters[0], parameters[1]));
+            }
+            throw RuntimeError("Wrong arg number for equal?");
         } else if (op_type == E_EXPT) {
             if (stxs.size() != 3) throw RuntimeError("Wrong arg num for expt");
             return (new Expt(stxs[1]->parse(env), stxs[2]->parse(env)));
@@ -268,7 +559,7 @@ Expr List::parse(Assoc &env) {
                     if (argi == nullptr) throw RuntimeError("Wrong arg format for Cond");
                     vector<Expr> argi_v;
                     SymbolSyntax* maybe_else = dynamic_cast<SymbolSyntax*>(argi->stxs[0].get());
-                    if (maybe_else != nullptr && maybe_else->s == "else" && find("else", env).get() == nullptr) {
+                    if (maybe_else != nullptr && maybe_else->s == "else" && !find(maybe_else->atom, env).bound()) {
                         if (i != stxs.size() - 1) throw RuntimeError("else must be last clause");
                         if (argi->stxs.size() == 1) throw RuntimeError("else must has a else clause");
                         else argi_v.push_back(TrueSyntax().parse(env)); // 如果真的是else就直接放个true
@@ -293,29 +584,37 @@ Expr List::parse(Assoc &env) {
                 if (stxs.size() < 3) throw RuntimeError("Invalid arg num of lambda");
                 List* paras = dynamic_cast<List*>(stxs[1].get());
                 if (paras == nullptr) throw RuntimeError("Invalid arg format for lambda");
-                vector<string> real_paras;
+                vector<Atom> real_paras;
                 Assoc parse_env = env; 
                 for (int i = 0; i < paras->stxs.size(); i++) {
                     SymbolSyntax* this_para = dynamic_cast<SymbolSyntax*>(paras->stxs[i].get());
                     if (this_para == nullptr) throw RuntimeError("Invalid parameter format for lambda");
-                    real_paras.push_back(this_para->s);
-                    parse_env = extend(this_para->s, VoidV(), parse_env);
+                    real_paras.push_back(this_para->atom);
+                    parse_env = extend(this_para->atom, VoidV(), parse_env);
                 }
                 std::vector<Expr> ld_e;
                 for (int i = 2; i < stxs.size(); i++) {
                     ld_e.push_back(stxs[i]->parse(parse_env));
                 }
-                return (new Lambda(real_paras, new Begin(ld_e)));
+                Lambda *lambda = new Lambda(real_paras, new Begin(ld_e));
+                Expr result(lambda);
+                if (line > 0) lambda->name = intern("lambda@" + std::to_string(line) + ":" + std::to_string(column)); // 匿名的用源码位置当名字
+                return result;
                 break;
             }
+            case E_DEFINEMEMO: // 和函数形式的 define 一样，只是 lambda 外面再包一层 memoize
             case E_DEFINE:{
+                bool memoized = reserved_words[op] == E_DEFINEMEMO;
                 if (stxs.size() < 3) throw RuntimeError("Invalid arg num for Define");
                 if (SymbolSyntax* def_var = dynamic_cast<SymbolSyntax*>(stxs[1].get())) {
+                    if (memoized) throw RuntimeError("define-memoized needs the (define-memoized (f x ...) body ...) form");
                     if (primitives.count(def_var->s) || reserved_words.count(def_var->s)) throw RuntimeError("the var's name shouldn't be a reserved name");
                     std::vector<Expr> ld_e;
                     for (int i = 2; i < stxs.size(); i++) {
                         ld_e.push_back(stxs[i]->parse(env));
                     }
+                    if (ld_e.size() == 1 && ld_e[0]->e_type == E_LAMBDA) // (define f (lambda ...)) 也叫 f
+                        static_cast<Lambda *>(ld_e[0].get())->name = def_var->atom;
                     return (new Define(def_var->s, new Begin(ld_e)));
                 }
 
@@ -327,19 +626,23 @@ Expr List::parse(Assoc &env) {
                     }
                     if (primitives.count(def_var->s) || reserved_words.count(def_var->s)) throw RuntimeError("the var's name shouldn't be a reserved name");
                     
-                    vector<string> lambda_paras;
+                    vector<Atom> lambda_paras;
                     Assoc parse_env = env;
                     for (int i = 1; i < def_var_lst->stxs.size(); i++) { // 注意从第二个参数开始进lambda
                         SymbolSyntax* this_para = dynamic_cast<SymbolSyntax*>(def_var_lst->stxs[i].get());
                         if (this_para == nullptr) throw RuntimeError("Invalid parameter format for lambda");
-                        lambda_paras.push_back(this_para->s); 
-                        parse_env = extend(this_para->s, VoidV(), parse_env);                       
+                        lambda_paras.push_back(this_para->atom); 
+                        parse_env = extend(this_para->atom, VoidV(), parse_env);                       
                     }
                     std::vector<Expr> lambda_expr;
                     for (int i = 2; i < stxs.size(); i++) {
                         lambda_expr.push_back(stxs[i]->parse(parse_env));
                     }
-                    return (new Define(def_var->s, new Lambda(lambda_paras,new Begin(lambda_expr))));
+                    Lambda *lambda = new Lambda(lambda_paras, new Begin(lambda_expr));
+                    Expr body(lambda);
+                    lambda->name = def_var->atom;
+                    if (memoized) body = Expr(new Memoize(std::vector<Expr>(1, body)));
+                    return (new Define(def_var->s, body));
                 }
                 throw RuntimeError("invalid var type for define");
                 break;
@@ -349,16 +652,16 @@ Expr List::parse(Assoc &env) {
                 List* param_lst = dynamic_cast<List*>(stxs[1].get());
                 if (!param_lst) throw RuntimeError("invalid param format for let 1");
                 
-                std::vector<std::pair<std::string, Expr>> bind;
-                vector<string> shadowed_names;
+                std::vector<std::pair<Atom, Expr>> bind;
+                vector<Atom> shadowed_names;
                 for (auto param : param_lst->stxs){
                     List* unpack_param = dynamic_cast<List*>(param.get());
                     if (!unpack_param) throw RuntimeError("invalid param format for let 2");
                     if (unpack_param->stxs.size() != 2) throw RuntimeError("invalid param format for let 3");
                     SymbolSyntax* this_formal = dynamic_cast<SymbolSyntax*>(unpack_param->stxs[0].get());
                     if (this_formal == nullptr) throw RuntimeError("invalid param format for let 4");
-                    bind.push_back({this_formal->s, unpack_param->stxs[1]->parse(env)});
-                    shadowed_names.push_back(this_formal->s);
+                    bind.push_back({this_formal->atom, unpack_param->stxs[1]->parse(env)});
+                    shadowed_names.push_back(this_formal->atom);
                 }
                 
                 Assoc parse_env = env; 
@@ -376,7 +679,7 @@ Expr List::parse(Assoc &env) {
                 if (stxs.size() <= 2) throw RuntimeError("invalid var num for letr");
                 List* param_lst = dynamic_cast<List*>(stxs[1].get());
                 if (!param_lst) throw RuntimeError("invalid param format for letr");
-                vector<string> names;
+                vector<Atom> names;
                 vector<Syntax> raw_exprs; 
                 for (auto param : param_lst->stxs){
                     List* unpack_param = dynamic_cast<List*>(param.get());
@@ -384,7 +687,7 @@ Expr List::parse(Assoc &env) {
                         throw RuntimeError("invalid param format for letr");
                     SymbolSyntax* this_formal = dynamic_cast<SymbolSyntax*>(unpack_param->stxs[0].get());
                     if (!this_formal) throw RuntimeError("invalid param format for letr");
-                    names.push_back(this_formal->s);
+                    names.push_back(this_formal->atom);
                     raw_exprs.push_back(unpack_param->stxs[1]); 
                 }
 
@@ -393,7 +696,7 @@ Expr List::parse(Assoc &env) {
                     parse_env = extend(name, VoidV(), parse_env);
                 }
 
-                std::vector<std::pair<std::string, Expr>> bind;
+                std::vector<std::pair<Atom, Expr>> bind;
                 for (int i = 0; i < names.size(); i++) {
                     bind.push_back({names[i], raw_exprs[i]->parse(parse_env)});
                 }
@@ -405,6 +708,12 @@ Expr List::parse(Assoc &env) {
                 return (new Letrec(bind, new Begin(ld_e)));
                 break;
             }
+            case E_DELAY:
+                if (stxs.size() != 2) throw RuntimeError("Invalid delay format");
+                return Expr(new Delay(delayThunk(stxs[1], env, line, column)));
+            case E_CONSSTREAM:
+                if (stxs.size() != 3) throw RuntimeError("Invalid cons-stream format");
+                return Expr(new Cons(stxs[1]->parse(env), Expr(new Delay(delayThunk(stxs[2], env, line, column)))));
             case E_SET: {
                 if (stxs.size() != 3) throw RuntimeError("Wrong arg num for set!");
                 if (SymbolSyntax* target = dynamic_cast<SymbolSyntax*>(stxs[1].get())) { //不应该提前做检查
@@ -0,0 +1,87 @@
+/**
+ * @file pool.cpp
+ * @brief Free-list pools behind poolNew()
+ */
+
+#include "pool.hpp"
+#include "limits.hpp"
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+// 以 16 字节为粒度分级，超过 MAX_POOLED 的直接走 operator new
+static const size_t GRAIN = 16;
+static const size_t MAX_POOLED = 256;
+static const size_t NUM_CLASSES = MAX_POOLED / GRAIN;
+static const size_t CHUNK_SIZE = 64 * 1024;
+
+struct FreeBlock {
+    FreeBlock *next;
+};
+
+// 都是 POD，零初始化且没有析构函数：全局对象在退出时析构、往回 free 也是安全的。
+// 每个线程一套，chunk 从不还给系统，所以线程之间互相 free 对方的 block 也没关系
+static thread_local FreeBlock *free_lists[NUM_CLASSES];
+thread_local AllocStats alloc_stats;
+size_t pool_heap_limit = 0;
+
+static inline size_t sizeClass(size_t n) {
+    return (n + GRAIN - 1) / GRAIN - 1;
+}
+
+// 所有 chunk 记在一张全局表里：worker 线程退出后它 free list 上的 chunk 也仍然可达
+static void keepChunk(char *chunk) {
+    static std::mutex *lock = new std::mutex();
+    static std::vector<char *> *chunks = new std::vector<char *>();
+    std::lock_guard<std::mutex> guard(*lock);
+    chunks->push_back(chunk);
+}
+
+// 取一整块 chunk 切成同一尺寸的 block，串进对应的 free list
+static void refill(size_t cls) {
+    size_t block = (cls + 1) * GRAIN;
+    char *chunk = static_cast<char *>(::operator new(CHUNK_SIZE));
+    keepChunk(chunk);
+    alloc_stats.chunks++;
+    size_t count = CHUNK_SIZE / block;
+    for (size_t i = 0; i < count; i++) {
+        FreeBlock *b = reinterpret_cast<FreeBlock *>(chunk + i * block);
+        b->next = free_lists[cls];
+        free_lists[cls] = b;
+    }
+}
+
+// 超出 --max-heap：这次不分配，计数也退回去
+static void heapFull(size_t n) {
+    alloc_stats.live_bytes -= n;
+    limitHit("heap limit exceeded");
+}
+
+void heapCharge(size_t n) {
+    alloc_stats.live_bytes += n;
+    if (pool_heap_limit != 0 && alloc_stats.live_bytes > (std::ptrdiff_t)pool_heap_limit) heapFull(n);
+}
+
+void *poolAlloc(size_t n) {
+    heapCharge(n);
+    alloc_stats.allocs++;
+    if (n == 0 || n > MAX_POOLED) return ::operator new(n);
+    size_t cls = sizeClass(n);
+    if (free_lists[cls] == nullptr) refill(cls);
+    FreeBlock *b = free_lists[cls];
+    free_lists[cls] = b->next;
+    return b;
+}
+
+void poolFree(void *p, size_t n) {
+    alloc_stats.frees++;
+    alloc_stats.live_bytes -= n;
+    if (n == 0 || n > MAX_POOLED) {
+        ::operator delete(p);
+        return;
+    }
+    FreeBlock *b = static_cast<FreeBlock *>(p);
+    size_t cls = sizeClass(n);
+    b->next = free_lists[cls];
+    free_lists[cls] = b;
+}
@@ -0,0 +1,113 @@
+#ifndef POOL_HPP
+#define POOL_HPP
+
+/**
+ * @file pool.hpp
+ * @brief Size-class pool allocator for runtime objects
+ *
+ * Pairs, procedures, environment frames and the other heap values are
+ * created through poolNew<T>(), which uses std::allocate_shared so the
+ * object and its shared_ptr control block share one block. Blocks come
+ * from per-size-class free lists carved out of large chunks, so the
+ * steady state of a list-heavy program never reaches malloc.
+ *
+ * The free lists and counters are per thread, so pool worker threads never
+ * contend on them; a block freed on another thread than the one that
+ * allocated it simply joins the freeing thread's list.
+ */
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Allocation counters of the calling thread, reported by --alloc-stats
+ *
+ * A task run on a worker hands its counts back to whoever touches its
+ * result (parallel.cpp), so the main thread's totals still cover them.
+ * live_bytes is signed: a thread that frees blocks another one allocated
+ * can go below zero.
+ */
+struct AllocStats {
+    size_t allocs;   ///< Blocks handed out (pooled or not)
+    size_t frees;    ///< Blocks given back
+    size_t chunks;   ///< Chunks requested from the system for the pools
+    std::ptrdiff_t live_bytes; ///< Bytes handed out minus bytes given back, with what heapCharge counted
+};
+extern thread_local AllocStats alloc_stats;
+
+/// --max-heap in bytes, 0 for none: poolAlloc and heapCharge throw a LimitExceeded rather than go past it
+extern size_t pool_heap_limit;
+
+void *poolAlloc(size_t);
+void poolFree(void *, size_t);
+void heapCharge(size_t);              ///< Count n bytes held outside the pool in live_bytes, checked against --max-heap
+inline void heapRelease(size_t n) {   ///< Undo heapCharge when those bytes are freed
+    alloc_stats.live_bytes -= n;
+}
+
+/**
+ * @brief Minimal C++11 allocator backed by poolAlloc/poolFree
+ */
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+    PoolAllocator() {}
+    template <typename U> PoolAllocator(const PoolAllocator<U> &) {}
+    T *allocate(size_t n) { return static_cast<T *>(poolAlloc(n * sizeof(T))); }
+    void deallocate(T *p, size_t n) { poolFree(p, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) { return false; }
+
+/**
+ * @brief C++11 allocator for the storage a value owns beside its pooled block
+ *
+ * Vector elements and hash table slots can be far larger than any pool
+ * block. They come from operator new and are not counted as allocations,
+ * but their bytes are charged to live_bytes before they are allocated, so
+ * --max-heap refuses a huge make-vector instead of letting it through.
+ */
+template <typename T>
+struct HeapAllocator {
+    typedef T value_type;
+    HeapAllocator() {}
+    template <typename U> HeapAllocator(const HeapAllocator<U> &) {}
+    T *allocate(size_t n) {
+        heapCharge(n * sizeof(T));
+        try {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        catch (...) {
+            heapRelease(n * sizeof(T));
+            throw;
+        }
+    }
+    void deallocate(T *p, size_t n) {
+        ::operator delete(p);
+        heapRelease(n * sizeof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const HeapAllocator<T> &, const HeapAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const HeapAllocator<T> &, const HeapAllocator<U> &) { return false; }
+
+template <typename T>
+using HeapVector = std::vector<T, HeapAllocator<T>>;
+
+/**
+ * @brief Create a shared object whose storage (with control block) is pooled
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> poolNew(Args &&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif // POOL_HPP
@@ -0,0 +1,194 @@
+/**
+ * @file profile.cpp
+ * @brief Shadow stack, call tree and reports behind --profile
+ */
+
+#include "profile.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+thread_local bool profiling = false;
+
+namespace {
+
+// 调用树最多这么深，更深的递归都记在这一层的节点上，免得折叠栈文件随递归深度平方增长
+const size_t MAX_TREE_DEPTH = 200;
+
+struct Stats {
+    uint64_t calls;
+    uint64_t self_ns;
+    uint64_t total_ns;
+    uint64_t self_allocs;
+    uint64_t total_allocs;
+    int active;          // 正在进行的调用层数：递归时只有最外层那次计入 total
+};
+
+struct Node {
+    Atom name;
+    Node *parent;
+    size_t depth;
+    uint64_t self_ns;
+    std::vector<std::unique_ptr<Node>> children; // 一般只有几个，线性找就够了；树最深 MAX_TREE_DEPTH，析构递归也没问题
+};
+
+struct Activation {
+    Node *node;
+    Stats *stats;
+    uint64_t start_ns;
+    uint64_t child_ns;   // 子调用（含尾调用接力）花掉的时间
+    size_t start_allocs;
+    size_t child_allocs;
+};
+
+struct MemoStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+// 节点和统计一直用到进程退出
+std::unordered_map<Atom, Stats> table;
+std::unordered_map<Atom, MemoStats> memo_table;
+Node root = {0, nullptr, 0, 0, {}};
+std::vector<Activation> shadow;
+
+uint64_t now() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Node *child(Node *parent, Atom name) {
+    if (parent->depth >= MAX_TREE_DEPTH) return parent;
+    for (auto &c : parent->children) {
+        if (c->name == name) return c.get();
+    }
+    parent->children.emplace_back(new Node{name, parent, parent->depth + 1, 0, {}});
+    return parent->children.back().get();
+}
+
+void push(Node *parent, Atom name) {
+    Stats &s = table[name];
+    s.calls++;
+    s.active++;
+    shadow.push_back(Activation{child(parent, name), &s, now(), 0, alloc_stats.allocs, 0});
+}
+
+void pop() {
+    Activation a = shadow.back();
+    shadow.pop_back();
+    uint64_t elapsed = now() - a.start_ns;
+    size_t allocs = alloc_stats.allocs - a.start_allocs;
+    a.node->self_ns += elapsed - a.child_ns;
+    a.stats->self_ns += elapsed - a.child_ns;
+    a.stats->self_allocs += allocs - a.child_allocs;
+    if (--a.stats->active == 0) {
+        a.stats->total_ns += elapsed;
+        a.stats->total_allocs += allocs;
+    }
+    if (!shadow.empty()) {
+        shadow.back().child_ns += elapsed;
+        shadow.back().child_allocs += allocs;
+    }
+}
+
+Node *current() {
+    return shadow.empty() ? &root : shadow.back().node;
+}
+
+} // namespace
+
+void profileEnter(Atom name) {
+    push(current(), name);
+}
+
+void profileTail(Atom name) {
+    if (shadow.empty()) { // 顶层表达式本身做的尾调用
+        push(&root, name);
+        return;
+    }
+    Node *parent = shadow.back().node->parent;
+    pop();
+    push(parent, name);
+}
+
+void profileExit() {
+    if (!shadow.empty()) pop();
+}
+
+void profileUnwind() {
+    while (!shadow.empty()) pop();
+}
+
+void profileMemo(Atom name, bool hit, bool evicted) {
+    MemoStats &s = memo_table[name];
+    if (hit) s.hits++;
+    else s.misses++;
+    if (evicted) s.evictions++;
+}
+
+void profileReport(std::ostream &os) {
+    std::vector<std::pair<Atom, const Stats *>> rows;
+    uint64_t calls = 0;
+    for (auto &entry : table) {
+        rows.push_back({entry.first, &entry.second});
+        calls += entry.second.calls;
+    }
+    std::sort(rows.begin(), rows.end(), [](const std::pair<Atom, const Stats *> &a, const std::pair<Atom, const Stats *> &b) {
+        if (a.second->self_ns != b.second->self_ns) return a.second->self_ns > b.second->self_ns;
+        return atomName(a.first) < atomName(b.first);
+    });
+    os << "; profile: " << rows.size() << " procedures, " << calls << " calls\n";
+    os << ";" << std::setw(12) << "calls" << std::setw(12) << "self ms" << std::setw(12) << "total ms"
+       << std::setw(12) << "self alloc" << std::setw(12) << "total alloc" << "  procedure\n";
+    os << std::fixed << std::setprecision(3);
+    for (auto &row : rows) {
+        const Stats &s = *row.second;
+        os << ";" << std::setw(12) << s.calls << std::setw(12) << s.self_ns / 1e6 << std::setw(12) << s.total_ns / 1e6
+           << std::setw(12) << s.self_allocs << std::setw(12) << s.total_allocs << "  " << atomName(row.first) << '\n';
+    }
+    os << std::defaultfloat;
+    if (!memo_table.empty()) {
+        std::vector<std::pair<Atom, const MemoStats *>> memos;
+        for (auto &entry : memo_table) memos.push_back({entry.first, &entry.second});
+        std::sort(memos.begin(), memos.end(), [](const std::pair<Atom, const MemoStats *> &a, const std::pair<Atom, const MemoStats *> &b) {
+            return atomName(a.first) < atomName(b.first);
+        });
+        os << "; memoized: " << memos.size() << " procedures\n";
+        os << ";" << std::setw(12) << "hits" << std::setw(12) << "misses" << std::setw(12) << "hit rate"
+           << std::setw(12) << "evictions" << "  procedure\n";
+        for (auto &row : memos) {
+            const MemoStats &s = *row.second;
+            os << ";" << std::setw(12) << s.hits << std::setw(12) << s.misses << std::setw(11) << std::fixed << std::setprecision(1)
+               << 100.0 * s.hits / (s.hits + s.misses) << "%" << std::setw(12) << s.evictions << "  " << atomName(row.first) << '\n';
+        }
+        os << std::defaultfloat;
+    }
+    os.flush();
+}
+
+void profileStacks(std::ostream &os) {
+    // 不递归地先序遍历调用树，path 是从根到当前节点的名字
+    std::vector<std::pair<const Node *, size_t>> todo;
+    std::vector<Atom> path;
+    for (auto &c : root.children) todo.push_back({c.get(), 1});
+    while (!todo.empty()) {
+        const Node *n = todo.back().first;
+        size_t depth = todo.back().second;
+        todo.pop_back();
+        path.resize(depth - 1);
+        path.push_back(n->name);
+        if (n->self_ns > 0) {
+            for (size_t i = 0; i < path.size(); i++) os << (i ? ";" : "") << atomName(path[i]);
+            os << ' ' << n->self_ns << '\n';
+        }
+        for (auto &c : n->children) todo.push_back({c.get(), depth + 1});
+    }
+    os.flush();
+}
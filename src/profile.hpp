@@ -0,0 +1,36 @@
+#ifndef PROFILE_HPP
+#define PROFILE_HPP
+
+/**
+ * @file profile.hpp
+ * @brief Per-procedure call profiler (--profile)
+ *
+ * Both engines report each activation of a Scheme procedure: entering it,
+ * replacing it by a tail call, and leaving it. The profiler keeps its own
+ * shadow stack and a call tree keyed by procedure name (the define'd name,
+ * or "lambda@line:column" for anonymous lambdas), and accumulates calls,
+ * self / inclusive time and pool allocations. Primitives are not counted
+ * separately; their cost is part of the calling procedure's self time.
+ * Procedures made by memoize also get their cache hits and misses counted.
+ *
+ * Every hook is guarded by the `profiling` flag at the call site, so with
+ * the mode off a call costs one predictable branch. The flag is per
+ * thread and only ever set on the main thread: tasks running on pool
+ * workers are not profiled.
+ */
+
+#include "atom.hpp"
+#include <ostream>
+
+extern thread_local bool profiling; ///< Set by --profile before anything runs
+
+void profileEnter(Atom);  ///< A procedure starts running inside the current one
+void profileTail(Atom);   ///< The current procedure tail-calls another
+void profileExit();       ///< The current procedure returns
+void profileUnwind();     ///< Close every open activation (after a top-level form, also on error)
+void profileMemo(Atom, bool hit, bool evicted); ///< A memoized procedure answered from its cache, or computed and stored a result
+
+void profileReport(std::ostream &);      ///< Table sorted by self time
+void profileStacks(std::ostream &);      ///< Collapsed stacks: "f;g;h <self ns>" per line
+
+#endif // PROFILE_HPP
@@ -0,0 +1,131 @@
+/**
+ * @file resolve.cpp
+ * @brief Lexical addressing pass run between parsing and evaluation
+ *
+ * Every variable reference is turned into a (depth, slot) pair pointing into
+ * the frame chain built at runtime, or into a direct pointer to its global
+ * binding cell, so that eval never has to compare names.
+ */
+
+#include "Def.hpp"
+#include "expr.hpp"
+#include "value.hpp"
+#include <string>
+#include <vector>
+#include <map>
+
+using std::string;
+using std::vector;
+
+extern std::map<std::string, ExprType> primitives;
+
+Scope::Scope(const vector<Atom> &xs, Scope *next) : names(xs), next(next) {}
+
+bool Scope::lookup(Atom x, int &depth, int &slot) const {
+    int d = 0;
+    for (const Scope *s = this; s != nullptr; s = s->next, d++) {
+        // 从后往前找，和原来 extend 的覆盖顺序一致（同名参数后者生效）
+        for (int i = (int)s->names.size() - 1; i >= 0; i--) {
+            if (s->names[i] == x) {
+                depth = d;
+                slot = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool lookupIn(Scope *scope, Atom x, int &depth, int &slot) {
+    return scope != nullptr && scope->lookup(x, depth, slot);
+}
+
+void ExprBase::resolve(Scope *scope) {} // 字面量、quote 等没有变量
+
+void Unary::resolve(Scope *scope) {
+    rand->resolve(scope);
+}
+
+void Binary::resolve(Scope *scope) {
+    rand1->resolve(scope);
+    rand2->resolve(scope);
+}
+
+void Variadic::resolve(Scope *scope) {
+    for (auto &r : rands) r->resolve(scope);
+}
+
+void AndVar::resolve(Scope *scope) {
+    for (auto &r : rands) r->resolve(scope);
+}
+
+void OrVar::resolve(Scope *scope) {
+    for (auto &r : rands) r->resolve(scope);
+}
+
+void Begin::resolve(Scope *scope) {
+    for (auto &x : es) x->resolve(scope);
+}
+
+void If::resolve(Scope *scope) {
+    cond->resolve(scope);
+    conseq->resolve(scope);
+    alter->resolve(scope);
+}
+
+void Cond::resolve(Scope *scope) {
+    for (auto &clause : clauses) {
+        for (auto &x : clause) x->resolve(scope);
+    }
+}
+
+void Var::resolve(Scope *scope) {
+    if (lookupIn(scope, atom, depth, slot)) return;
+    depth = -1;
+    cell = globalCell(atom);
+    // 内建过程的名字不能被 define，第一次当作值引用时把共享的 Primitive 放进全局 cell
+    if (!cell->bound()) {
+        auto it = primitives.find(x);
+        if (it != primitives.end()) *cell = primitiveValue(it->second);
+    }
+}
+
+void Apply::resolve(Scope *scope) {
+    rator->resolve(scope);
+    for (auto &r : rand) r->resolve(scope);
+}
+
+void Lambda::resolve(Scope *scope) {
+    Scope body_scope(x, scope); // 与 Apply 建立的 frame 一一对应
+    e->resolve(&body_scope);
+}
+
+void Define::resolve(Scope *scope) {
+    cell = globalCell(var); // define 总是写全局
+    e->resolve(scope);
+}
+
+void Let::resolve(Scope *scope) {
+    vector<Atom> names;
+    for (auto &p : bind) {
+        p.second->resolve(scope); // 初值在外层作用域求值
+        names.push_back(p.first);
+    }
+    Scope body_scope(names, scope);
+    body->resolve(&body_scope);
+}
+
+void Letrec::resolve(Scope *scope) {
+    vector<Atom> names;
+    for (auto &p : bind) names.push_back(p.first);
+    Scope body_scope(names, scope);
+    for (auto &p : bind) p.second->resolve(&body_scope);
+    body->resolve(&body_scope);
+}
+
+void Set::resolve(Scope *scope) {
+    e->resolve(scope);
+    if (lookupIn(scope, atom, depth, slot)) return;
+    depth = -1;
+    cell = globalCell(atom);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file stream.cpp
+ * @brief Forcing promises, and the cells built by stream-map / stream-filter / stream-take
+ */
+
+#include "stream.hpp"
+#include "RE.hpp"
+#include "pool.hpp"
+#include "vm.hpp"
+#include <utility>
+#include <vector>
+
+Promise::Promise(Kind kind, const Value &fn, const Value &source, int count)
+    : ValueBase(V_PROMISE), kind(kind), fn(fn), source(source), count(count), value(Value(nullptr)) {}
+
+Promise::~Promise() {
+    releaseChain(value);
+}
+
+void Promise::show(std::ostream &os) {
+    os << "#<promise>";
+}
+
+GcObject *Promise::gcObject() {
+    return this;
+}
+
+void Promise::traverse(GcVisitor &v) {
+    v.visit(fn);
+    v.visit(source);
+    v.visit(value);
+}
+
+void Promise::clearRefs() {
+    fn = Value(nullptr);
+    source = Value(nullptr);
+    value = Value(nullptr);
+}
+
+Value PromiseV(Promise::Kind kind, const Value &fn, const Value &source, int count) {
+    return Value(poolNew<Promise>(kind, fn, source, count));
+}
+
+Value ForcedPromiseV(const Value &v) {
+    if (v.type() == V_PROMISE) return v;
+    Value p = PromiseV(Promise::FORCED, Value(nullptr), Value(nullptr));
+    p.as<Promise>()->value = v;
+    return p;
+}
+
+namespace {
+
+// 流的下一格：'() 或者一个 pair
+Value next(const Value &rest, const char *who) {
+    Value cell = forcePromise(rest);
+    if (cell.type() != V_NULL && cell.type() != V_PAIR) throw RuntimeError(std::string(who) + ": not a stream");
+    return cell;
+}
+
+Value mapFrom(const Value &f, const Value &rest) {
+    Value cell = next(rest, "stream-map");
+    if (cell.type() == V_NULL) return NullV();
+    Pair *p = cell.as<Pair>();
+    Value head = applyValue(f, std::vector<Value>(1, p->car));
+    return PairV(head, PromiseV(Promise::MAP, f, p->cdr));
+}
+
+// 跳过不满足的元素。rest 跟着往后走，所以跳过的格子马上就能释放；
+// pred 出错时 rest 停在还没判断完的那一格，再 force 一次从那里接着找，结果不变
+Value filterFrom(const Value &pred, Value &rest) {
+    for (;;) {
+        Value cell = next(rest, "stream-filter");
+        if (cell.type() == V_NULL) return NullV();
+        Pair *p = cell.as<Pair>();
+        if (!applyValue(pred, std::vector<Value>(1, p->car)).isFalse()) return PairV(p->car, PromiseV(Promise::FILTER, pred, p->cdr));
+        rest = p->cdr;
+    }
+}
+
+Value takeFrom(const Value &rest, int n) {
+    if (n <= 0) return NullV(); // 够数了就不再 force 源
+    Value cell = next(rest, "stream-take");
+    if (cell.type() == V_NULL) return NullV();
+    Pair *p = cell.as<Pair>();
+    return PairV(p->car, PromiseV(Promise::TAKE, Value(nullptr), p->cdr, n - 1));
+}
+
+// 算出 promise 的值；p 的状态只在 filter 里往后推进，别的情况原样留着，出错了可以再 force
+Value compute(Promise *p) {
+    Value fn = p->fn; // 重入的 force 可能把 p 的字段清掉
+    switch (p->kind) {
+        case Promise::THUNK:
+            return applyValue(fn, std::vector<Value>());
+        case Promise::MAP:
+            return mapFrom(fn, Value(p->source));
+        case Promise::FILTER:
+            return filterFrom(fn, p->source);
+        case Promise::TAKE:
+            return takeFrom(Value(p->source), p->count);
+        default:
+            return p->value;
+    }
+}
+
+} // namespace
+
+Value forcePromise(const Value &v) {
+    if (v.type() != V_PROMISE) return v;
+    Value keep = v; // v 可能是某个 pair 的 cdr，算的过程中那个 pair 也许就没了
+    Promise *p = keep.as<Promise>();
+    if (p->kind == Promise::FORCED) return p->value;
+    Value result = compute(p);
+    if (p->kind != Promise::FORCED) { // thunk 里重入的 force 已经算好时，以先得到的值为准
+        p->value = std::move(result);
+        p->kind = Promise::FORCED;
+        p->fn = Value(nullptr);
+        p->source = Value(nullptr);
+    }
+    return p->value;
+}
+
+Value streamCdr(const Value &s) {
+    if (s.type() != V_PAIR) throw RuntimeError("stream-cdr: not a stream");
+    return forcePromise(s.as<Pair>()->cdr);
+}
+
+Value streamMap(const Value &f, const Value &s) {
+    return mapFrom(f, s);
+}
+
+Value streamFilter(const Value &pred, Value &&s) {
+    Value rest = std::move(s);
+    return filterFrom(pred, rest);
+}
+
+Value streamTake(const Value &s, int n) {
+    return takeFrom(s, n);
+}
+
+Value streamToList(const Value &s, int limit) {
+    Value head = NullV();
+    Pair *last = nullptr;
+    Value rest = s;
+    for (int i = 0; limit < 0 || i < limit; i++) {
+        Value cell = next(rest, "stream->list");
+        if (cell.type() == V_NULL) break;
+        Value item = PairV(cell.as<Pair>()->car, NullV());
+        if (last != nullptr) last->cdr = item;
+        else head = item;
+        last = item.as<Pair>();
+        rest = cell.as<Pair>()->cdr;
+    }
+    return head;
+}
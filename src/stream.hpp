@@ -0,0 +1,40 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+/**
+ * @file stream.hpp
+ * @brief Promises and the native stream combinators
+ *
+ * (delay e) makes a promise that evaluates e the first time it is forced
+ * and remembers the value; (cons-stream a b) is (cons a (delay b)). A
+ * stream is '() or a pair whose cdr is a promise of a stream; a plain
+ * list also works as a finite stream, since forcing a value that is not a
+ * promise returns it unchanged.
+ *
+ * stream-map, stream-filter and stream-take build their result one cell
+ * at a time, with native promises holding only the procedure and the rest
+ * of the source, so a loop over their result that drops the cells behind
+ * it runs in constant memory. Each force runs at most one thunk, and
+ * stream-filter skips rejected elements in a loop, so neither depends on
+ * the C++ stack growing with the length of the stream. Dropping a long
+ * forced stream frees it in a loop as well (releaseChain). A call of
+ * stream-filter takes its stream argument over instead of keeping it
+ * until it returns, so the cells skipped before the first match are freed
+ * as the scan passes them, unless something else (a variable, say) still
+ * holds the head. stream-filter called as a value, through apply or a
+ * variable bound to it, copies its arguments and keeps them to the end.
+ *
+ * A promise is forced without locking: forcing the same promise from two
+ * futures at once is a data race, like any other shared mutation.
+ */
+
+#include "value.hpp"
+
+Value forcePromise(const Value &);                  ///< (force p); any other value is returned as is
+Value streamCdr(const Value &);                     ///< (stream-cdr s)
+Value streamMap(const Value &f, const Value &s);    ///< (stream-map f s)
+Value streamFilter(const Value &f, Value &&s);      ///< (stream-filter pred s); takes s over
+Value streamTake(const Value &s, int n);            ///< (stream-take s n)
+Value streamToList(const Value &s, int limit);      ///< (stream->list s [n]); limit -1 for the whole stream
+
+#endif // STREAM_HPP
@@ -0,0 +1,184 @@
+/**
+ * @file strings.cpp
+ * @brief Slices and ropes behind String, string-append / substring, and string ports
+ */
+
+#include "strings.hpp"
+#include "RE.hpp"
+#include "pool.hpp"
+#include <algorithm>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// 两段加起来不超过这么长就直接拷成一块，比多建一个节点省
+const size_t SMALL_APPEND = 64;
+
+std::mutex flatten_lock;
+
+// 文本缓冲区记在 live_bytes 上（已经 heapCharge 过 bytes），最后一个切片放掉时退回
+struct TextRelease {
+    size_t bytes;
+    void operator()(const std::string *s) const {
+        delete s;
+        heapRelease(bytes);
+    }
+};
+
+std::shared_ptr<const std::string> chargedText(std::string &&s, size_t bytes) {
+    return std::shared_ptr<const std::string>(new std::string(std::move(s)), TextRelease{bytes});
+}
+
+const String *str(const Value &v, const char *who) {
+    if (v.type() != V_STRING) throw RuntimeError(std::string(who) + ": not a string");
+    return v.as<String>();
+}
+
+} // namespace
+
+String::String(const std::string &s)
+    : ValueBase(V_STRING), length(s.size()), offset(0), left(Value(nullptr)), right(Value(nullptr)), flat(true) {
+    heapCharge(length);
+    buf = chargedText(std::string(s), length);
+}
+
+String::String(const std::shared_ptr<const std::string> &text, size_t start, size_t length)
+    : ValueBase(V_STRING), length(length), buf(text), offset(start),
+      left(Value(nullptr)), right(Value(nullptr)), flat(true) {}
+
+String::String(const Value &a, const Value &b)
+    : ValueBase(V_STRING), length(a.as<String>()->length + b.as<String>()->length), offset(0),
+      left(a), right(b), flat(false) {}
+
+// 长 rope 的左边一路套下去，递归析构会爆栈；只剩自己引用的节点挪出来逐个放掉
+String::~String() {
+    if (!left.ptr && !right.ptr) return;
+    std::vector<Value> dying;
+    dying.push_back(std::move(left));
+    dying.push_back(std::move(right));
+    while (!dying.empty()) {
+        Value v = std::move(dying.back());
+        dying.pop_back();
+        if (!v.ptr || v.ptr.use_count() != 1) continue;
+        String *s = v.as<String>();
+        if (s->left.ptr) dying.push_back(std::move(s->left));
+        if (s->right.ptr) dying.push_back(std::move(s->right));
+    }
+}
+
+// 按从左到右的顺序收集所有叶子；拍平过的子串直接当叶子用
+void String::flatten() const {
+    std::lock_guard<std::mutex> guard(flatten_lock);
+    if (flat.load(std::memory_order_relaxed)) return; // 等锁的时候别人已经拍平了
+    heapCharge(length); // 超出 --max-heap 时 rope 原样留着
+    std::string out;
+    out.reserve(length);
+    std::vector<const String *> todo(1, this);
+    while (!todo.empty()) {
+        const String *s = todo.back();
+        todo.pop_back();
+        if (s->flat.load(std::memory_order_relaxed)) {
+            out.append(s->buf->data() + s->offset, s->length);
+            continue;
+        }
+        todo.push_back(s->right.as<String>());
+        todo.push_back(s->left.as<String>());
+    }
+    buf = chargedText(std::move(out), length);
+    offset = 0;
+    Value l = std::move(left), r = std::move(right); // 两半最后才放，上面还在读它们
+    left = Value(nullptr);
+    right = Value(nullptr);
+    flat.store(true, std::memory_order_release);
+}
+
+const char *String::data() const {
+    if (!flat.load(std::memory_order_acquire)) flatten();
+    return buf->data() + offset;
+}
+
+std::string String::str() const {
+    return std::string(data(), length);
+}
+
+std::shared_ptr<const std::string> String::text() const {
+    data();
+    return buf;
+}
+
+size_t String::start() const {
+    data();
+    return offset;
+}
+
+void String::show(std::ostream &os) {
+    os << "\"";
+    os.write(data(), length);
+    os << "\"";
+}
+
+Value StringV(const std::string &s) {
+    return Value(poolNew<String>(s));
+}
+
+Value stringAppend(const Value *args, int n) {
+    Value result(nullptr);
+    for (int i = 0; i < n; i++) {
+        const String *s = str(args[i], "string-append");
+        if (s->length == 0) continue;
+        if (!result.bound()) {
+            result = args[i]; // 只有一段非空时原样返回，不必新建
+            continue;
+        }
+        const String *r = result.as<String>();
+        if (r->length + s->length <= SMALL_APPEND) {
+            std::string joined;
+            joined.reserve(r->length + s->length);
+            joined.append(r->data(), r->length);
+            joined.append(s->data(), s->length);
+            result = StringV(joined);
+        } else {
+            result = Value(poolNew<String>(result, args[i]));
+        }
+    }
+    return result.bound() ? result : StringV("");
+}
+
+Value substring(const Value &v, int start, int end) {
+    const String *s = str(v, "substring");
+    if (start < 0 || end < start || (size_t)end > s->length) throw RuntimeError("substring: index out of range");
+    if (start == 0 && (size_t)end == s->length) return v;
+    return Value(poolNew<String>(s->text(), s->start() + start, (size_t)(end - start)));
+}
+
+int stringCompare(const Value &a, const Value &b) {
+    const String *x = str(a, "string comparison"), *y = str(b, "string comparison");
+    int c = std::memcmp(x->data(), y->data(), std::min(x->length, y->length));
+    if (c != 0) return c;
+    return x->length < y->length ? -1 : x->length > y->length ? 1 : 0;
+}
+
+bool stringEqual(const String *a, const String *b) {
+    if (a == b) return true;
+    if (a->length != b->length) return false;
+    const char *x = a->data(), *y = b->data();
+    return x == y || std::memcmp(x, y, a->length) == 0;
+}
+
+// ============================================================================
+// Output string ports
+// ============================================================================
+
+StringPort::StringPort() : ValueBase(V_PORT) {}
+
+void StringPort::show(std::ostream &os) {
+    os << "#<string-port>";
+}
+
+Value OutputStringV(const std::string &contents) {
+    Value v(poolNew<StringPort>());
+    v.as<StringPort>()->out << contents;
+    return v;
+}
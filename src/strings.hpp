@@ -0,0 +1,40 @@
+#ifndef STRINGS_HPP
+#define STRINGS_HPP
+
+/**
+ * @file strings.hpp
+ * @brief String primitives over shared, immutable text, and output string ports
+ *
+ * A string literal is built once, when its expression is parsed, and every
+ * evaluation returns that same value. substring returns a slice of the
+ * text it was taken from instead of a copy, and string-append only links
+ * its arguments into a rope, so appending in a loop costs one node per
+ * step; the characters are gathered once, when the result is first read.
+ * Short results are still copied into a single buffer, since a node costs
+ * more than a few characters. Strings cannot be mutated, so none of this
+ * sharing is visible.
+ *
+ * (open-output-string) makes a port that display and write-string append
+ * to, and (get-output-string port) returns what has been written so far.
+ */
+
+#include "value.hpp"
+#include <sstream>
+
+Value stringAppend(const Value *, int);                   ///< (string-append s ...)
+Value substring(const Value &, int start, int end);       ///< Characters [start, end), sharing the text
+int stringCompare(const Value &, const Value &);          ///< Negative, zero or positive, like memcmp
+bool stringEqual(const String *, const String *);
+
+/**
+ * @brief Output string port: everything displayed to it is kept in out
+ */
+struct StringPort : ValueBase {
+    static const ValueType TAG = V_PORT; ///< Tag checked by Value::as<StringPort>()
+    std::ostringstream out;
+    StringPort();
+    virtual void show(std::ostream &) override;
+};
+Value OutputStringV(const std::string &contents = std::string());
+
+#endif // STRINGS_HPP
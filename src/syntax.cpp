@@ -1,6 +1,10 @@
 #include "syntax.hpp"
+#include "RE.hpp"
+#include <cerrno>
+#include <climits>
 #include <cstring>
 #include <iostream>
+#include <unistd.h>
 #include <vector>
 
 Syntax::Syntax(SyntaxBase *stx) : ptr(stx) {}
@@ -18,6 +22,11 @@ void RationalSyntax::show(std::ostream &os) {
   os << numerator << "/" << denominator;
 }
 
+BigNumberSyntax::BigNumberSyntax(const std::string &s1) : s(s1) {}
+void BigNumberSyntax::show(std::ostream &os) {
+  os << s;
+}
+
 void TrueSyntax::show(std::ostream &os) {
   os << "#t";
 }
@@ -26,7 +35,7 @@ void FalseSyntax::show(std::ostream &os) {
   os << "#f";
 }
 
-SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1) {}
+SymbolSyntax::SymbolSyntax(const std::string &s1) : s(s1), atom(intern(s1)) {}
 void SymbolSyntax::show(std::ostream &os) {
     os << s;
 }
@@ -36,7 +45,7 @@ void StringSyntax::show(std::ostream &os) {
     os << "\"" << s << "\"";
 }
 
-List::List() {}
+List::List() : line(0), column(0) {}
 void List::show(std::ostream &os) {
     os << '(';
     for (auto stx : stxs) {
@@ -46,180 +55,233 @@ void List::show(std::ostream &os) {
     os << ')';
 }
 
-std::istream &readSpace(std::istream &is) {
+VectorSyntax::VectorSyntax() {}
+void VectorSyntax::show(std::ostream &os) {
+    os << "#(";
+    for (auto stx : stxs) {
+        stx->show(os);
+        os << ' ';
+    }
+    os << ')';
+}
+
+static const size_t READ_BLOCK = 1 << 16;
+
+Reader::Reader(std::istream &is) : is(is), fd(&is == &std::cin ? 0 : -1), buf(READ_BLOCK), cur(0), end(0), line(1), line_start(0) {}
+
+bool Reader::fill(size_t keep) {
+  // 把还要用的部分挪到开头，放不下就扩容
+  std::memmove(buf.data(), buf.data() + keep, end - keep);
+  cur -= keep;
+  end -= keep;
+  line_start -= (long)keep;
+  if (buf.size() - end < READ_BLOCK / 2)
+    buf.resize(buf.size() * 2);
+  if (is.tie()) is.tie()->flush(); // 和 istream 一样，读之前先把提示符刷出去
+  long n;
+  if (fd >= 0) {
+    do n = ::read(fd, buf.data() + end, buf.size() - end); // 终端 / 管道有多少给多少，不会等满一块
+    while (n < 0 && errno == EINTR);
+  } else {
+    n = is.rdbuf()->sgetn(buf.data() + end, buf.size() - end);
+  }
+  if (n <= 0) return false;
+  end += n;
+  return true;
+}
+
+static inline bool isDelimiter(int c) {
+  return c == '(' || c == ')' ||
+         c == '[' || c == ']' ||
+         c == ';' ||  // 分号也是分隔符
+         isspace(c) ||
+         c == EOF;
+}
+
+size_t Reader::token(const char *&s) {
+  size_t start = cur, i = cur;
+  while (true) {
+    if (i == end) {
+      size_t len = i - start;
+      bool more = fill(start); // 不管读没读到，fill 都已经把 token 挪到了开头
+      start = 0;
+      i = len;
+      if (!more) break;
+    }
+    if (isDelimiter((unsigned char)buf[i])) break;
+    i++;
+  }
+  cur = i;
+  s = buf.data() + start;
+  return i - start;
+}
+
+static Reader &readSpace(Reader &in) {
   while (true) {
     // 跳过空白字符
-    while (isspace(is.peek()))
-      is.get();
-    
+    int c = in.peek();
+    while (isspace(c)) {
+      in.cur++;
+      if (c == '\n') in.newline();
+      c = in.peek();
+    }
     // 检查是否是注释
-    if (is.peek() == ';') {
-      // 跳过注释直到行末
-      while (is.peek() != '\n' && is.peek() != EOF)
-        is.get();
-      // 继续循环以跳过注释后的空白字符
-    } else {
-      // 没有更多空白字符或注释，退出循环
-      break;
+    if (c != ';') break;
+    // 跳过注释直到行末，然后继续跳过注释后的空白
+    while (c != '\n' && c != EOF) {
+      in.cur++;
+      c = in.peek();
     }
   }
-  return is;
+  return in;
 }
 
-Syntax readList(std::istream &is);
+static Syntax readList(Reader &in);
+static void readItems(Reader &, std::vector<Syntax> &);
 
-// Helper function to try parsing as integer or rational
-bool tryParseNumber(const std::string &s, int &result) {
+// 从 p 开始读一个可带符号的十进制整数，停在第一个非数字字符上
+// 超出 int 范围时 big 置位，value 无意义（整个 token 交给 bignum 处理）
+static const char *scanInteger(const char *p, const char *e, int &value, bool &big) {
   bool neg = false;
-  int n = 0;
-  int i = 0;
-  
-  // Single '+' or '-' are not numbers
-  if (s.size() == 1 && (s[0] == '+' || s[0] == '-'))
-    return false;
-  
-  // Handle sign
-  if (s[0] == '-') {
-    i += 1;
-    neg = true;
-  } else if (s[0] == '+') {
-    i += 1;
+  if (p < e && (*p == '+' || *p == '-')) {
+    neg = *p == '-';
+    p++;
   }
-  
-  // Check if all remaining characters are digits
-  for (; i < s.size(); i++) {
-    if ('0' <= s[i] && s[i] <= '9') {
-      n = n * 10 + s[i] - '0';
-    } else {
-      return false;  // Not a valid number
+  unsigned long long n = 0;
+  big = false;
+  for (; p < e && '0' <= *p && *p <= '9'; p++) {
+    if (!big) {
+      n = n * 10 + (*p - '0');
+      big = n > (unsigned long long)INT_MAX + (neg ? 1 : 0);
     }
   }
-  
-  result = neg ? -n : n;
-  return true;
+  value = big ? 0 : (int)(neg ? -(long long)n : (long long)n);
+  return p;
 }
 
-// Helper function to try parsing as rational number
-bool tryParseRational(const std::string &s, int &numerator, int &denominator) {
-  size_t slash_pos = s.find('/');
-  if (slash_pos == std::string::npos || slash_pos == 0 || slash_pos == s.size() - 1) {
-    return false; // No slash or slash at beginning/end
-  }
-  
-  std::string num_str = s.substr(0, slash_pos);
-  std::string den_str = s.substr(slash_pos + 1);
-  
-  // Parse numerator (can be negative)
-  if (!tryParseNumber(num_str, numerator)) {
-    return false;
-  }
-  
-  // Parse denominator (must be positive)
-  if (!tryParseNumber(den_str, denominator) || denominator <= 0) {
-    return false;
-  }
-  
-  return true;
+static inline bool isLoneSign(const char *p, const char *e) {
+  return e - p == 1 && (*p == '+' || *p == '-');
 }
 
-// Helper function to create identifier/symbol syntax
-Syntax createIdentifierSyntax(const std::string &s) {
-  if (s == "#t")
+// 一遍扫完 token 决定它是整数、有理数还是标识符
+// 规则同以前：单独的 + / - 不是数；分母必须为正，否则整个 token 当作符号
+static Syntax classifyToken(const char *p, size_t len) {
+  const char *e = p + len;
+  if (!isLoneSign(p, e)) {
+    int n;
+    bool n_big;
+    const char *q = scanInteger(p, e, n, n_big);
+    if (q == e) {
+      if (n_big) return Syntax(new BigNumberSyntax(std::string(p, len)));
+      return Syntax(new Number(n));
+    }
+    if (*q == '/' && q != p && q + 1 != e && !isLoneSign(p, q) && !isLoneSign(q + 1, e)) {
+      int d;
+      bool d_big;
+      if (scanInteger(q + 1, e, d, d_big) == e && (d_big ? q[1] != '-' : d > 0)) {
+        if (n_big || d_big) return Syntax(new BigNumberSyntax(std::string(p, len)));
+        return Syntax(new RationalSyntax(n, d));
+      }
+    }
+  }
+  if (len == 2 && p[0] == '#' && p[1] == 't')
     return Syntax(new TrueSyntax());
-  if (s == "#f")
+  if (len == 2 && p[0] == '#' && p[1] == 'f')
     return Syntax(new FalseSyntax());
-  return Syntax(new SymbolSyntax(s));
+  return Syntax(new SymbolSyntax(std::string(p, len)));
 }
 
 // no leading space
-Syntax readItem(std::istream &is) {
-  if (is.peek() == '(' || is.peek() == '[') {
-    is.get();
-    return readList(is); // 续215行，Readlist是最基本的东西，只要第一个是(就会开始使用List
+static Syntax readItem(Reader &in) {
+  int c = in.peek();
+  if (c == '(' || c == '[') {
+    int line = in.line, column = in.column();
+    in.cur++;
+    Syntax list = readList(in); // Readlist是最基本的东西，只要第一个是(就会开始使用List
+    static_cast<List *>(list.get())->line = line;
+    static_cast<List *>(list.get())->column = column;
+    return list; // Readlist是最基本的东西，只要第一个是(就会开始使用List
   }
-  if (is.peek() == '\'')
+  if (c == '\'')
   {
-    is.get();
+    in.cur++;
     // 读取单引号后的语法元素
-    Syntax quoted_syntax = readItem(is);
-    
+    Syntax quoted_syntax = readItem(in);
+
     // 创建 (quote <syntax>) 的列表结构
     List *quote_list = new List();
     quote_list->stxs.push_back(Syntax(new SymbolSyntax("quote")));
     quote_list->stxs.push_back(quoted_syntax);
-    
+
     return Syntax(quote_list);
   }
   // 处理字符串字面量
-  if (is.peek() == '"') {
-    is.get(); // 消费开始的双引号
+  if (c == '"') {
+    in.cur++; // 消费开始的双引号
     std::string str;
-    while (is.peek() != '"' && is.peek() != EOF) {
-      char c = is.get();
+    while ((c = in.get()) != '"' && c != EOF) {
+      if (c == '\n') in.newline();
       if (c == '\\') {
         // 处理转义字符
-        char next = is.get();
+        int next = in.get();
         switch (next) {
           case 'n': str.push_back('\n'); break;
           case 't': str.push_back('\t'); break;
           case 'r': str.push_back('\r'); break;
           case '\\': str.push_back('\\'); break;
           case '"': str.push_back('"'); break;
+          case EOF: break;
           default: str.push_back(next); break;
         }
       } else {
         str.push_back(c);
       }
     }
-    if (is.peek() == '"') {
-      is.get(); // 消费结束的双引号
-    }
     return Syntax(new StringSyntax(str));
   }
-  
-  // Read token
-  std::string s;
-  do {
-    int c = is.peek();
-    if (c == '(' || c == ')' ||
-        c == '[' || c == ']' || 
-        c == ';' ||  // 添加分号作为分隔符
-        isspace(c) ||
-        c == EOF)
-      break;
-    is.get();
-    s.push_back(c);
-  } while (true);
-  
-  // Try parsing as rational first
-  int numerator, denominator;
-  if (tryParseRational(s, numerator, denominator)) {
-    return Syntax(new RationalSyntax(numerator, denominator));
+
+  if (c == ')' || c == ']') { // 多出来的右括号：吃掉再报错，不然调用方会一直原地读到空符号
+    int line = in.line, column = in.column();
+    in.cur++;
+    throw RuntimeError("unexpected '" + std::string(1, (char)c) + "' at line " + std::to_string(line) + ", column " + std::to_string(column));
   }
-  
-  // Try parsing as integer
-  int number_value;
-  if (tryParseNumber(s, number_value)) {
-    return Syntax(new Number(number_value));
+
+  const char *s;
+  size_t len = in.token(s);
+  if (len == 1 && *s == '#' && in.peek() == '(') { // '(' 是分隔符，#( 会读成单独一个 # 后面跟着表
+    in.cur++;
+    VectorSyntax *vec = new VectorSyntax();
+    Syntax result(vec);
+    readItems(in, vec->stxs);
+    return result;
   }
-  
-  // Not a number, treat as identifier/symbol
-  return createIdentifierSyntax(s);
+  return classifyToken(s, len);
+}
+
+// 读到 ')' / ']' 为止，括号本身也吃掉
+static void readItems(Reader &in, std::vector<Syntax> &stxs) {
+  int c;
+  while ((c = readSpace(in).peek()) != ')' && c != ']' && c != EOF)
+    stxs.push_back(readItem(in));
+  in.get(); // ')' 或 ']'
 }
 
-Syntax readList(std::istream &is) {
-    List *stx = new List();
-    while (readSpace(is).peek() != ')' && readSpace(is).peek() != ')')
-        stx->stxs.push_back(readItem(is));
-    is.get(); // ')'
-    return Syntax(stx);
+static Syntax readList(Reader &in) {
+  List *stx = new List();
+  Syntax result(stx);
+  readItems(in, stx->stxs);
+  return result;
 } // 这里介绍了，readList和list的parser是最基本的内容。原因见上
 
-Syntax readSyntax(std::istream &is) {
-  return readItem(readSpace(is));
+Syntax readSyntax(Reader &in) {
+  return readItem(readSpace(in));
+}
+
+bool atEndOfInput(Reader &in) {
+  return readSpace(in).peek() == EOF;
 }
 
-std::istream &operator>>(std::istream &is, Syntax &stx) {
-  stx = readSyntax(is);
-  return is;
+Reader &operator>>(Reader &in, Syntax &stx) {
+  stx = readSyntax(in);
+  return in;
 }
@@ -1,10 +1,13 @@
 #ifndef SYNTAX 
 #define SYNTAX
 
+#include <cstdio>
 #include <cstring>
+#include <istream>
 #include <memory>
 #include <vector>
 #include "Def.hpp"
+#include "atom.hpp"
 
 struct SyntaxBase {
     virtual Expr parse(Assoc &) = 0;
@@ -36,6 +39,17 @@ struct RationalSyntax : SyntaxBase {
     virtual void show(std::ostream &) override;
 };
 
+/**
+ * @brief Number literal with a part outside the int range
+ * Keeps the token text ("digits" or "digits/digits") for the bignum code.
+ */
+struct BigNumberSyntax : SyntaxBase {
+    std::string s;
+    BigNumberSyntax(const std::string &);
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
 struct TrueSyntax : SyntaxBase {
     // This will not match
     virtual Expr parse(Assoc &) override;
@@ -50,6 +64,7 @@ struct FalseSyntax : SyntaxBase {
 
 struct SymbolSyntax : SyntaxBase {
     std::string s;
+    Atom atom;  ///< Interned ID of s
     SymbolSyntax(const std::string &);
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
@@ -64,12 +79,51 @@ struct StringSyntax : SyntaxBase {
 
 struct List : SyntaxBase {
     std::vector<Syntax> stxs; // stxs[i].get()指向一个Syntaxbase
+    int line;    ///< Source position of the opening parenthesis, 0 if built by hand
+    int column;
     List();
     virtual Expr parse(Assoc &) override;
     virtual void show(std::ostream &) override;
 };
 
-Syntax readSyntax(std::istream &);
+/**
+ * @brief Vector literal #( ... )
+ * Self-evaluating: parses to a Quote of itself.
+ */
+struct VectorSyntax : SyntaxBase {
+    std::vector<Syntax> stxs;
+    VectorSyntax();
+    virtual Expr parse(Assoc &) override;
+    virtual void show(std::ostream &) override;
+};
+
+/**
+ * @brief Block-buffered character source for the reader
+ *
+ * Input is pulled in large blocks (read(2) for std::cin, sgetn for other
+ * streams) and tokens are scanned as spans of the buffer; a token cut by
+ * the end of a block is moved to the front before the next block is
+ * appended, so nothing on the hot path copies substrings.
+ */
+struct Reader {
+    std::istream &is;
+    int fd;                ///< Descriptor read directly, or -1 to go through is.rdbuf()
+    std::vector<char> buf;
+    size_t cur;            ///< Next unread character
+    size_t end;            ///< One past the last buffered character
+    int line;              ///< Line of buf[cur], from 1
+    long line_start;       ///< Offset in buf where that line starts (negative once it is shifted out)
+    Reader(std::istream &);
+    int peek() { return cur < end || fill(cur) ? (unsigned char)buf[cur] : EOF; }
+    int get() { int c = peek(); if (c != EOF) cur++; return c; }
+    bool fill(size_t keep);          ///< Keep buf[keep, end), append a block; false at end of input
+    size_t token(const char *&);     ///< Scan the next token in place and return its length
+    void newline() { line++; line_start = (long)cur; } ///< Just consumed a '\n'
+    int column() const { return (int)((long)cur - line_start) + 1; }
+};
+
+Syntax readSyntax(Reader &);
+bool atEndOfInput(Reader &); ///< Skip blanks and comments; true if nothing is left
 
-std::istream &operator>>(std::istream &, Syntax);
+Reader &operator>>(Reader &, Syntax &);
 #endif
\ No newline at end of file
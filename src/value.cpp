@@ -7,6 +7,8 @@
  */
 
 #include "value.hpp"
+#include "pool.hpp"
+#include "bigint.hpp"
 
 // ============================================================================
 // Base ValueBase Implementation
@@ -14,17 +16,30 @@
 
 ValueBase::ValueBase(ValueType vt) : v_type(vt) {}
 
-void ValueBase::showCdr(std::ostream &os) {
-    os << " . ";
-    show(os);
-    os << ')';
+GcObject *ValueBase::gcObject() {
+    return nullptr;
 }
 
 // ============================================================================
 // Value Smart Pointer Implementation
 // ============================================================================
 
-Value::Value(ValueBase *ptr) : ptr(ptr) {}
+// 空指针不要交给 shared_ptr 的裸指针构造函数：那样也会分配一个控制块
+Value::Value(ValueBase *p) : tag(p ? p->v_type : V_UNBOUND), imm(0), ptr(p ? std::shared_ptr<ValueBase>(p) : std::shared_ptr<ValueBase>()) {}
+
+Value::Value(std::shared_ptr<ValueBase> &&p) : tag(p->v_type), imm(0), ptr(std::move(p)) {}
+
+Value::Value(ValueType t, int n) : tag(t), imm(n) {}
+
+int Value::asInt() const {
+    assert(tag == V_INT);
+    return imm;
+}
+
+bool Value::asBool() const {
+    assert(tag == V_BOOL);
+    return imm != 0;
+}
 
 ValueBase* Value::operator->() const { 
     return ptr.get(); 
@@ -38,19 +53,34 @@ ValueBase* Value::get() const {
     return ptr.get(); 
 }
 
-void Value::show(std::ostream &os) {
-    ptr->show(os);
+void Value::show(std::ostream &os) const {
+    Printer(os).print(*this);
 }
 
 // ============================================================================
 // Environment (Association List) Implementation
 // ============================================================================
 
-AssocList::AssocList(const std::string &x, const Value &v, Assoc &next)
-    : x(x), v(v), next(next) {}
+AssocList::AssocList(Atom x, const Value &v, Assoc &next)
+    : names(1, x), slots(1, v), next(next) {}
+
+AssocList::AssocList(std::vector<Value> &&vs, const Assoc &next)
+    : slots(std::move(vs)), next(next) {}
+
+void AssocList::traverse(GcVisitor &v) {
+    for (auto &x : slots) v.visit(x);
+    v.visit(next);
+}
+
+void AssocList::clearRefs() {
+    slots.clear();
+    next = Assoc(nullptr);
+}
 
 Assoc::Assoc(AssocList *x) : ptr(x) {}
 
+Assoc::Assoc(const std::shared_ptr<AssocList> &x) : ptr(x) {}
+
 AssocList* Assoc::operator->() const { 
     return ptr.get(); 
 }
@@ -67,148 +97,139 @@ Assoc empty() {
     return Assoc(nullptr);
 }
 
-Assoc extend(const std::string &x, const Value &v, Assoc &lst) {
-    return Assoc(new AssocList(x, v, lst));
+Assoc extend(Atom x, const Value &v, Assoc &lst) {
+    return Assoc(poolNew<AssocList>(x, v, lst));
+}
+
+Assoc extendFrame(std::vector<Value> &&vs, const Assoc &lst) {
+    return Assoc(poolNew<AssocList>(std::move(vs), lst));
 }
 
-void modify(const std::string &x, const Value &v, Assoc &lst) {
+void modify(Atom x, const Value &v, Assoc &lst) {
     for (auto i = lst; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            i->v = v;
-            return;
+        for (int j = (int)i->names.size() - 1; j >= 0; j--) {
+            if (x == i->names[j]) {
+                i->slots[j] = v;
+                return;
+            }
         }
     }
 }
 
-Value find(const std::string &x, Assoc &l) {
+Value find(Atom x, Assoc &l) {
     for (auto i = l; i.get() != nullptr; i = i->next) {
-        if (x == i->x) {
-            return i->v;
+        for (int j = (int)i->names.size() - 1; j >= 0; j--) {
+            if (x == i->names[j]) {
+                return i->slots[j];
+            }
         }
     }
     return Value(nullptr);
 }
 
 // ============================================================================
-// Simple Value Types Implementation
+// Global Environment Implementation
 // ============================================================================
 
-// Void
-Void::Void() : ValueBase(V_VOID) {}
+GlobalEnv global_env;
+
+Value *GlobalEnv::cell(Atom a) {
+    if (a >= index.size()) index.resize(a + 1, nullptr);
+    if (index[a] == nullptr) {
+        cells.push_back(Value(nullptr)); // deque 只在两端插入，已有元素的地址不变
+        names.push_back(a);
+        index[a] = &cells.back();
+    }
+    return index[a];
+}
 
-void Void::show(std::ostream &os) {
-    os << "#<void>";
+Value *globalCell(Atom a) {
+    return global_env.cell(a);
 }
 
+Value *globalCell(const std::string &x) {
+    return global_env.cell(intern(x));
+}
+
+// ============================================================================
+// Simple Value Types Implementation
+// ============================================================================
+
+// Void / Integer / Boolean / Null 都是立即数，不分配堆对象
 Value VoidV() {
-    return Value(new Void());
+    return Value(V_VOID, 0);
 }
 
-// Integer
-Integer::Integer(int n) : ValueBase(V_INT), n(n) {} // 他就是一个数据
+Value IntegerV(int n) {
+    return Value(V_INT, n);
+}
 
-void Integer::show(std::ostream &os) { // 输出方法
-    os << n;
+Value BooleanV(bool b) {
+    return Value(V_BOOL, b ? 1 : 0);
 }
 
-Value IntegerV(int n) { // 相当于从一个结果（应该说是别人的数据成员）输出一个 Integer的value（保持抽象）
-    return Value(new Integer(n));
+Value NullV() {
+    return Value(V_NULL, 0);
 }
 
 // Rational
-// Helper function to calculate greatest common divisor
-static int gcd(int a, int b) {
-    if (a < 0) a = -a;
-    if (b < 0) b = -b;
-    while (b != 0) {
-        int temp = b;
-        b = a % b;
-        a = temp;
-    }
-    return a;
+Rational::Rational(const Value &num, const Value &den)
+    : ValueBase(V_RATIONAL), numerator(num), denominator(den) {}
+
+void Rational::show(std::ostream &os) {
+    std::string s;
+    appendDecimal(s, numerator);
+    s += '/';
+    appendDecimal(s, denominator);
+    os << s;
 }
 
-Rational::Rational(int num, int den) : ValueBase(V_RATIONAL) {
-    if (den == 0) {
+Value RationalV(const Value &num, const Value &den) {
+    if (intSign(den) == 0) {
         throw std::runtime_error("Division by zero");
     }
-    
-    // Simplify the fraction
-    int g = gcd(num, den);
-    numerator = num / g;
-    denominator = den / g;
-    
-    // Ensure denominator is positive
-    if (denominator < 0) {
-        numerator = -numerator;
-        denominator = -denominator;
+    Value n = num, d = den;
+    if (intSign(d) < 0) { // 分母总是正的
+        n = intNeg(n);
+        d = intNeg(d);
     }
-}
-
-void Rational::show(std::ostream &os) {
-    if (denominator == 1) {
-        os << numerator;
-    } else {
-        os << numerator << "/" << denominator;
+    Value g = intGcd(n, d);
+    if (!isOne(g)) {
+        n = intQuotient(n, g);
+        d = intQuotient(d, g);
     }
+    return ReducedRationalV(n, d);
 }
 
-Value RationalV(int num, int den) {
-    return Value(new Rational(num, den));
-}
-
-// Boolean
-Boolean::Boolean(bool b) : ValueBase(V_BOOL), b(b) {}
-
-void Boolean::show(std::ostream &os) {
-    os << (b ? "#t" : "#f");
-}
-
-Value BooleanV(bool b) {
-    return Value(new Boolean(b));
+Value ReducedRationalV(const Value &num, const Value &den) {
+    if (isOne(den)) return num;
+    return Value(poolNew<Rational>(num, den));
 }
 
 // Symbol
-Symbol::Symbol(const std::string &s) : ValueBase(V_SYM), s(s) {}
+Symbol::Symbol(Atom a) : ValueBase(V_SYM), atom(a) {}
 
 void Symbol::show(std::ostream &os) {
-    os << s;
+    os << atomName(atom);
 }
 
-Value SymbolV(const std::string &s) {
-    return Value(new Symbol(s));
+Value SymbolV(Atom a) {
+    // 每个 atom 只建一个 Symbol，quote 出来的符号都共享它，eq? 直接比指针
+    static std::vector<Value> *symbols = new std::vector<Value>();
+    if (a >= symbols->size()) symbols->resize(a + 1, Value(nullptr));
+    Value &v = (*symbols)[a];
+    if (!v.bound()) v = Value(poolNew<Symbol>(a));
+    return v;
 }
 
-// String
-String::String(const std::string &s) : ValueBase(V_STRING), s(s) {}
-
-void String::show(std::ostream &os) {
-    os << "\"" << s << "\"";
-}
-
-Value StringV(const std::string &s) {
-    return Value(new String(s));
+Value SymbolV(const std::string &s) {
+    return SymbolV(intern(s));
 }
 
 // ============================================================================
 // Special Value Types Implementation
 // ============================================================================
 
-// Null
-Null::Null() : ValueBase(V_NULL) {}
-
-void Null::show(std::ostream &os) {
-    os << "()";
-}
-
-void Null::showCdr(std::ostream &os) {
-    os << ')';
-}
-
-Value NullV() {
-    return Value(new Null());
-}
-
 // Terminate
 Terminate::Terminate() : ValueBase(V_TERMINATE) {}
 
@@ -217,7 +238,8 @@ void Terminate::show(std::ostream &os) {
 }
 
 Value TerminateV() {
-    return Value(new Terminate());
+    static const Value terminate(new Terminate()); // 不可变，全进程共用一个
+    return terminate;
 }
 
 // ============================================================================
@@ -228,37 +250,296 @@ Value TerminateV() {
 Pair::Pair(const Value &car, const Value &cdr) 
     : ValueBase(V_PAIR), car(car), cdr(cdr) {}
 
+// 只被这一处引用的 pair / promise：释放它会接着析构它的 car / cdr，要交给 releaseChain
+static bool ownedLink(const Value &v) {
+    return v.ptr && v.ptr.use_count() == 1 && (v.type() == V_PAIR || v.type() == V_PROMISE);
+}
+
+Pair::~Pair() {
+    if (ownedLink(car)) releaseChain(car);
+    if (ownedLink(cdr)) releaseChain(cdr);
+}
+
 void Pair::show(std::ostream &os) {
-    os << '(' << car;
-    cdr->showCdr(os);
+    Printer(os).list(this);
+}
+
+GcObject *Pair::gcObject() {
+    return this;
+}
+
+void Pair::traverse(GcVisitor &v) {
+    v.visit(car);
+    v.visit(cdr);
 }
 
-void Pair::showCdr(std::ostream &os) {
-    os << ' ' << car;
-    cdr->showCdr(os);
+void Pair::clearRefs() {
+    car = NullV();
+    cdr = NullV();
 }
 
 Value PairV(const Value &car, const Value &cdr) {
-    return Value(new Pair(car, cdr));
+    return Value(poolNew<Pair>(car, cdr));
+}
+
+// 只有这一个引用的下一格先摘下它自己的尾巴（pair 还有 car）再释放，所以每次析构最多再析构一层。
+// 沿 cdr 走的就地循环；car 里嵌着的表先放进 todo，这条链走完再一个个接着走
+void releaseChain(Value &tail) {
+    std::vector<Value> todo; // 平的表用不上，不会分配
+    Value rest = std::move(tail);
+    tail = NullV();
+    for (;;) {
+        while (ownedLink(rest)) {
+            Value *next;
+            if (rest.type() == V_PAIR) {
+                Pair *p = rest.as<Pair>();
+                if (ownedLink(p->car)) {
+                    todo.push_back(std::move(p->car));
+                    p->car = NullV();
+                }
+                next = &p->cdr;
+            } else {
+                next = &rest.as<Promise>()->value;
+            }
+            Value after = std::move(*next);
+            *next = NullV();
+            rest = std::move(after);
+        }
+        if (todo.empty()) break;
+        rest = std::move(todo.back());
+        todo.pop_back();
+    }
+}
+
+// Vector
+Vector::Vector(HeapVector<Value> &&items) : ValueBase(V_VECTOR), items(std::move(items)) {}
+
+void Vector::show(std::ostream &os) {
+    Printer(os).vector(this);
+}
+
+GcObject *Vector::gcObject() {
+    return this;
+}
+
+void Vector::traverse(GcVisitor &v) {
+    for (auto &item : items) v.visit(item);
+}
+
+void Vector::clearRefs() {
+    items.clear();
+}
+
+Value VectorV(HeapVector<Value> &&items) {
+    return Value(poolNew<Vector>(std::move(items)));
 }
 
 // Procedure
-Procedure::Procedure(const std::vector<std::string> &xs, const Expr &e, const Assoc &env)
-    : ValueBase(V_PROC), parameters(xs), e(e), env(env) {}
+Procedure::Procedure(const std::vector<Atom> &xs, const Expr &e, const Assoc &env, const std::shared_ptr<Code> &code, Atom name)
+    : ValueBase(V_PROC), parameters(xs), e(e), env(env), code(code), name(name) {}
 
 void Procedure::show(std::ostream &os) {
     os << "#<procedure>";
 }
 
-Value ProcedureV(const std::vector<std::string> &xs, const Expr &e, const Assoc &env) {
-    return Value(new Procedure(xs, e, env));
+GcObject *Procedure::gcObject() {
+    return this;
+}
+
+void Procedure::traverse(GcVisitor &v) {
+    v.visit(env);
+}
+
+void Procedure::clearRefs() {
+    env = Assoc(nullptr);
+}
+
+Value ProcedureV(const std::vector<Atom> &xs, const Expr &e, const Assoc &env, const std::shared_ptr<Code> &code, Atom name) {
+    return Value(poolNew<Procedure>(xs, e, env, code, name));
+}
+
+// Primitive
+Primitive::Primitive(PrimFn fn, int arity) : ValueBase(V_PRIM), fn(fn), arity(arity) {}
+
+void Primitive::show(std::ostream &os) {
+    os << "#<procedure>";
+}
+
+Value PrimitiveV(PrimFn fn, int arity) {
+    return Value(poolNew<Primitive>(fn, arity));
 }
 
 // ============================================================================
 // Utility Functions Implementation
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &os, Value &v) {
-    v->show(os);
+std::ostream &operator<<(std::ostream &os, const Value &v) {
+    v.show(os);
     return os;
 }
+
+// ============================================================================
+// Printer Implementation
+// ============================================================================
+
+static const size_t PRINT_BLOCK = 1 << 16;
+
+Printer::Printer(std::ostream &os) : os(os) {}
+
+Printer::~Printer() {
+    flush();
+}
+
+void Printer::flush() {
+    if (!buf.empty()) os.write(buf.data(), buf.size());
+    buf.clear();
+}
+
+void Printer::integer(int n) {
+    char digits[12];
+    char *p = digits + sizeof(digits);
+    unsigned u = n < 0 ? 0u - (unsigned)n : (unsigned)n; // INT_MIN 取负会溢出，转成 unsigned 再算
+    do {
+        *--p = char('0' + u % 10);
+        u /= 10;
+    } while (u != 0);
+    if (n < 0) *--p = '-';
+    buf.append(p, digits + sizeof(digits) - p);
+}
+
+void Printer::number(const Value &v) {
+    if (v.type() == V_INT) integer(v.asInt());
+    else appendDecimal(buf, v);
+}
+
+void Printer::atom(const Value &v) {
+    switch (v.type()) {
+        case V_INT: integer(v.asInt()); break;
+        case V_BOOL: buf += v.asBool() ? "#t" : "#f"; break;
+        case V_NULL: buf += "()"; break;
+        case V_VOID: buf += "#<void>"; break;
+        case V_SYM: buf += atomName(v.as<Symbol>()->atom); break;
+        case V_STRING:
+            buf += '"';
+            buf.append(v.as<String>()->data(), v.as<String>()->length);
+            buf += '"';
+            break;
+        case V_BIGINT: appendDecimal(buf, v); break;
+        case V_RATIONAL: {
+            Rational *r = v.as<Rational>();
+            number(r->numerator);
+            buf += '/';
+            number(r->denominator);
+            break;
+        }
+        default: // 不常见的类型走它自己的 show
+            flush();
+            v->show(os);
+    }
+    if (buf.size() >= PRINT_BLOCK) flush();
+}
+
+void Printer::print(const Value &v) {
+    if (v.type() == V_PAIR) list(v.as<Pair>());
+    else if (v.type() == V_VECTOR) vector(v.as<Vector>());
+    else atom(v);
+}
+
+void Printer::list(const Pair *head) {
+    nested(head, nullptr);
+}
+
+void Printer::vector(const Vector *vec) {
+    nested(nullptr, vec);
+}
+
+void Printer::nested(const Pair *head, const Vector *vec) {
+    // 每一层还没打完的表：当前走到的 pair，以及 Floyd 判圈用的慢指针；
+    // 向量那一层 at 为空，steps 是打到的下标。at 和 vec 都空的一层只等着补一个 ')'，
+    // 是 (a . #(...)) 这种尾巴是向量的表
+    struct Open {
+        const Pair *at;
+        const Pair *slow;
+        size_t steps;
+        const Vector *vec;
+    };
+    std::vector<Open> open;
+    // 开一层，返回它的第一个元素；空向量没有元素
+    auto enter = [&](const Pair *p, const Vector *v) -> const Value * {
+        if (p != nullptr) {
+            buf += '(';
+            open.push_back(Open{p, p, 0, nullptr});
+            return &p->car;
+        }
+        buf += "#(";
+        open.push_back(Open{nullptr, nullptr, 0, v});
+        return v->items.empty() ? nullptr : &v->items[0];
+    };
+    auto isOpen = [&](const Vector *v) {
+        for (const Open &o : open) {
+            if (o.vec == v) return true;
+        }
+        return false;
+    };
+    const Value *elem = enter(head, vec);
+    while (true) {
+        if (elem != nullptr) {
+            bool compound = elem->type() == V_PAIR || elem->type() == V_VECTOR;
+            // 嵌套太深（多半是 car 方向成环），或者向量里装着还没打完的外层向量：截断
+            bool cut = compound && (open.size() >= MAX_DEPTH || (elem->type() == V_VECTOR && isOpen(elem->as<Vector>())));
+            if (compound && !cut) { // 元素本身是表或向量：开一层，先打它的第一个元素
+                elem = elem->type() == V_PAIR ? enter(elem->as<Pair>(), nullptr) : enter(nullptr, elem->as<Vector>());
+                continue;
+            }
+            if (cut) buf += "...";
+            else atom(*elem);
+        }
+
+        // 在最内层往后走一个；走完就关括号，回到外一层继续
+        elem = nullptr;
+        while (elem == nullptr && !open.empty()) {
+            Open &o = open.back();
+            if (o.at == nullptr && o.vec == nullptr) {
+                buf += ')';
+                open.pop_back();
+                continue;
+            }
+            if (o.vec != nullptr) {
+                if (++o.steps < o.vec->items.size()) {
+                    buf += ' ';
+                    elem = &o.vec->items[o.steps];
+                    break;
+                }
+                buf += ')';
+                open.pop_back();
+                continue;
+            }
+            const Value &rest = o.at->cdr;
+            if (rest.type() == V_PAIR) {
+                o.at = rest.as<Pair>();
+                if (++o.steps % 2 == 0) o.slow = o.slow->cdr.as<Pair>();
+                if (o.at != o.slow) {
+                    buf += ' ';
+                    elem = &o.at->car;
+                    break;
+                }
+                buf += " ...)"; // cdr 方向成环
+            } else if (rest.type() == V_VECTOR && open.size() < MAX_DEPTH && !isOpen(rest.as<Vector>())) {
+                buf += " . ";
+                o.at = nullptr; // enter 之后 o 可能已经失效
+                elem = enter(nullptr, rest.as<Vector>());
+                continue;
+            } else {
+                if (rest.type() == V_VECTOR) {
+                    buf += " . ...";
+                } else if (rest.type() != V_NULL) {
+                    buf += " . ";
+                    atom(rest);
+                }
+                buf += ')';
+            }
+            open.pop_back();
+        }
+        if (elem == nullptr) return;
+    }
+}
@@ -11,8 +11,15 @@
 
 #include "Def.hpp"
 #include "expr.hpp"
+#include "gc.hpp"
+#include "pool.hpp"
 #include <memory>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
 #include <cstring>
+#include <deque>
+#include <string>
 #include <vector>
 #include <map>
 
@@ -20,8 +27,6 @@
 // Base classes and smart pointer wrappers
 // ============================================================================
 
-static std::map<std::string, Value> global_env;
-
 /**
  * @brief Base class for all values in the Scheme interpreter
  */
@@ -29,20 +34,38 @@ struct ValueBase {
     ValueType v_type;
     ValueBase(ValueType);
     virtual void show(std::ostream &) = 0;
-    virtual void showCdr(std::ostream &);
+    virtual GcObject *gcObject();   ///< Collector header, nullptr for values that cannot form cycles
     virtual ~ValueBase() = default;
 };
 
 /**
- * @brief Smart pointer wrapper for ValueBase objects
+ * @brief Tagged value: immediates inline, heap types behind a shared_ptr
+ *
+ * Fixnums, booleans, '() and #<void> live entirely in the Value and never
+ * allocate; ptr is only set for heap types such as Pair, Procedure and
+ * String, which keep their ValueBase layout. Immediates have no ValueBase,
+ * so ask type() instead of going through ->v_type.
  */
 struct Value {
-    std::shared_ptr<ValueBase> ptr;
+    ValueType tag;                   ///< Type of the value, for immediates and heap objects alike
+    int imm;                         ///< Payload of an immediate: fixnum value, or 0/1 for booleans
+    std::shared_ptr<ValueBase> ptr;  ///< Heap object, empty for immediates
     Value(ValueBase *);
-    void show(std::ostream &);
+    Value(std::shared_ptr<ValueBase> &&); ///< Heap object from poolNew()
+    Value(ValueType, int);           ///< Immediate value
+    ValueType type() const { return tag; }
+    bool bound() const { return tag != V_UNBOUND; }
+    bool isImmediate() const { return tag == V_INT || tag == V_BOOL || tag == V_NULL || tag == V_VOID; }
+    bool isFalse() const { return tag == V_BOOL && imm == 0; } // Scheme 里只有 #f 为假
+    /// Identity (eq?): immediates compare tag and payload, heap objects compare pointers
+    bool same(const Value &o) const { return tag == o.tag && imm == o.imm && ptr == o.ptr; }
+    int asInt() const;
+    bool asBool() const;
+    void show(std::ostream &) const;     ///< Through a Printer, see below
     ValueBase* operator->() const;
     ValueBase& operator*();
     ValueBase* get() const;
+    template <typename T> T *as() const; ///< Checked static downcast to a heap type
 };
 
 // ============================================================================
@@ -55,88 +78,161 @@ struct Value {
 struct Assoc {
     std::shared_ptr<AssocList> ptr;
     Assoc(AssocList *);
+    Assoc(const std::shared_ptr<AssocList> &);
     AssocList* operator->() const;
     AssocList& operator*();
     AssocList* get() const;
 };
 
 /**
- * @brief Association list node for variable bindings
+ * @brief Environment frame holding the bindings of one scope
+ *
+ * Apply, Let and Letrec build one frame per scope whose slots are indexed
+ * by the lexical address computed in the resolution pass, so runtime frames
+ * carry no names. Frames made by extend() also record the name, which is
+ * what the parser uses to tell whether an identifier is shadowed.
  */
-struct AssocList {
-    std::string x;      ///< Variable name
-    Value v;            ///< Variable value
-    Assoc next;         ///< Next binding in the chain
-    AssocList(const std::string &, const Value &, Assoc &);
+struct AssocList : GcObject {
+    std::vector<Atom> names;         ///< Binding names (parse-time frames only)
+    std::vector<Value> slots;        ///< Binding values, indexed by slot
+    Assoc next;                      ///< Enclosing frame
+    AssocList(Atom, const Value &, Assoc &);
+    AssocList(std::vector<Value> &&, const Assoc &);
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
 };
 
 // Environment operations
 Assoc empty();
-Assoc extend(const std::string&, const Value &, Assoc &); // 在旧环境 extend 建立一个新环境
-void modify(const std::string&, const Value &, Assoc &); // （基于 Set!）在当前环境中找到变量并修改，相应的 set-car!，set-cdr!会修改一个pair的这些部分
-Value find(const std::string &, Assoc &); // 不断往回找变量
-
-// ============================================================================
-// Simple Value Types
-// ============================================================================
+Assoc extend(Atom, const Value &, Assoc &); // 在旧环境 extend 建立一个新环境
+Assoc extendFrame(std::vector<Value> &&, const Assoc &); // 整个作用域一次性建成一个 frame
+void modify(Atom, const Value &, Assoc &); // （基于 Set!）在当前环境中找到变量并修改，相应的 set-car!，set-cdr!会修改一个pair的这些部分
+Value find(Atom, Assoc &); // 不断往回找变量
 
 /**
- * @brief Void value (represents no meaningful return value)
+ * @brief A pending "continue with this expr in this env" record
+ *
+ * ExprBase::evalTail either returns a value, or fills one of these in
+ * instead of recursing into a tail position; trampoline() then keeps running
+ * the pending expressions in a loop, so tail calls use no C++ stack.
  */
-struct Void : ValueBase {
-    Void();
-    virtual void show(std::ostream &) override;
+struct TailCall {
+    Expr expr;  ///< Expression left to evaluate, nullptr when the value is final
+    Assoc env;  ///< Environment to evaluate it in
+    Atom name;  ///< Procedure whose body expr is, for --profile
+    TailCall();
 };
-Value VoidV();
+
+Value trampoline(Value, TailCall &); // 跑完所有挂起的尾调用，返回最终的值
 
 /**
- * @brief Integer value
+ * @brief Top-level bindings: one stable cell per name
+ *
+ * Cells live in a deque, so their addresses never change once handed out;
+ * the resolver stores them in Var / Set / Define nodes and the VM in
+ * Code::cells, and define / set! write straight into the cell. The index
+ * is a flat vector keyed by atom ID, so finding a name's cell is a single
+ * array access rather than a string-keyed tree lookup.
  */
-struct Integer : ValueBase {
-    int n;
-    Integer(int);
-    virtual void show(std::ostream &) override;
+struct GlobalEnv {
+    Value *cell(Atom);                     ///< Binding cell of the name, created unbound on first use
+    size_t size() const { return cells.size(); }
+    Atom name(size_t i) const { return names[i]; } ///< i-th cell in creation order
+    Value &at(size_t i) { return cells[i]; }
+private:
+    std::vector<Value *> index;            ///< By atom ID, nullptr if the name has no cell
+    std::deque<Value> cells;
+    std::vector<Atom> names;
 };
+
+// Global bindings (top-level define)
+extern GlobalEnv global_env;
+Value *globalCell(Atom); // 返回全局变量的绑定位置，未定义时先建一个空位
+Value *globalCell(const std::string &);
+
+// ============================================================================
+// Simple Value Types
+// ============================================================================
+
+// Immediates: only the factory functions remain, see Value
+
+Value VoidV();      ///< #<void> (represents no meaningful return value)
 Value IntegerV(int);
+Value BooleanV(bool);
+Value NullV();      ///< '() (empty list)
 
 /**
- * @brief Rational number value
+ * @brief Integer outside the fixnum range
+ *
+ * Sign and magnitude in base 2^32, least significant limb first, with no
+ * leading zero limbs. Only created for values that do not fit in an int;
+ * the arithmetic lives in bigint.hpp.
  */
-struct Rational : ValueBase {
-    int numerator;
-    int denominator;
-    Rational(int, int);
+struct BigInt : ValueBase {
+    static const ValueType TAG = V_BIGINT; ///< Tag checked by Value::as<BigInt>()
+    bool negative;
+    std::vector<uint32_t> limbs; ///< Charged to live_bytes while the BigInt lives
+    BigInt(bool, std::vector<uint32_t> &&);
+    ~BigInt();
     virtual void show(std::ostream &) override;
 };
-Value RationalV(int, int);
 
 /**
- * @brief Boolean value
+ * @brief Rational number value
+ *
+ * Always in lowest terms with a denominator greater than 1; both parts are
+ * integers (fixnum or bignum).
  */
-struct Boolean : ValueBase {
-    bool b;
-    Boolean(bool);
+struct Rational : ValueBase {
+    static const ValueType TAG = V_RATIONAL; ///< Tag checked by Value::as<Rational>()
+    Value numerator;
+    Value denominator;
+    Rational(const Value &, const Value &); ///< Parts already reduced, see ReducedRationalV
     virtual void show(std::ostream &) override;
 };
-Value BooleanV(bool);
+Value RationalV(const Value &, const Value &); ///< n/d reduced; an integer when d divides n
+Value ReducedRationalV(const Value &, const Value &); ///< n/d already in lowest terms with d > 0; an integer when d is 1
 
 /**
  * @brief Symbol value
  */
 struct Symbol : ValueBase {
-    std::string s;
-    Symbol(const std::string &);
+    static const ValueType TAG = V_SYM; ///< Tag checked by Value::as<Symbol>()
+    Atom atom;  ///< Interned name; each atom has exactly one Symbol object
+    Symbol(Atom);
     virtual void show(std::ostream &) override;
 };
+Value SymbolV(Atom);                ///< The unique symbol for the atom
 Value SymbolV(const std::string &);
 
 /**
- * @brief String value
+ * @brief Immutable string value: a slice of shared text, or a rope (strings.cpp)
+ *
+ * Flat strings point into a shared, never modified buffer, so literals
+ * and substrings share their characters instead of copying them. A
+ * string-append result only records its two halves; the first read of its
+ * characters (display, equal?, substring ...) flattens it into one buffer,
+ * under a lock so that futures may read the same string, and drops the
+ * halves. length is known either way.
  */
 struct String : ValueBase {
-    std::string s;
-    String(const std::string &);
+    static const ValueType TAG = V_STRING; ///< Tag checked by Value::as<String>()
+    size_t length;                                            ///< Number of characters
+    String(const std::string &);                              ///< Copy of the text
+    String(const std::shared_ptr<const std::string> &, size_t, size_t); ///< Characters [start, start + length) of shared text
+    String(const Value &, const Value &);                     ///< Concatenation of two strings
+    ~String();                                                ///< Frees a long rope in a loop
+    const char *data() const;                                 ///< length characters, flattening first
+    std::string str() const;
+    std::shared_ptr<const std::string> text() const;          ///< Buffer data() points into, for slicing
+    size_t start() const;                                     ///< Offset of data() in text()
     virtual void show(std::ostream &) override;
+private:
+    mutable std::shared_ptr<const std::string> buf;           ///< nullptr until a rope is flattened
+    mutable size_t offset;
+    mutable Value left, right;                                ///< Halves of an unflattened rope
+    mutable std::atomic<bool> flat;
+    void flatten() const;
 };
 Value StringV(const std::string &);
 
@@ -144,24 +240,15 @@ Value StringV(const std::string &);
 // Special Value Types
 // ============================================================================
 
-/**
- * @brief Null value (empty list)
- */
-struct Null : ValueBase {
-    Null();
-    virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
-};
-Value NullV();
-
 /**
  * @brief Termination signal value
  */
 struct Terminate : ValueBase {
+    static const ValueType TAG = V_TERMINATE; ///< Tag checked by Value::as<Terminate>()
     Terminate();
     virtual void show(std::ostream &) override;
 };
-Value TerminateV();
+Value TerminateV(); ///< Shared process-lifetime instance
 
 // ============================================================================
 // Composite Value Types
@@ -170,31 +257,226 @@ Value TerminateV();
 /**
  * @brief Pair value (cons cell)
  */
-struct Pair : ValueBase {
+struct Pair : ValueBase, GcObject {
+    static const ValueType TAG = V_PAIR; ///< Tag checked by Value::as<Pair>()
     Value car;  ///< First element
     Value cdr;  ///< Second element
     Pair(const Value &, const Value &);
+    ~Pair();    ///< Frees long cdr chains and deep car nesting in a loop, see releaseChain
     virtual void show(std::ostream &) override;
-    virtual void showCdr(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
 };
 Value PairV(const Value &, const Value &);
 
+/**
+ * @brief Drop a reference to the head of a cdr or promise chain without recursing
+ *
+ * Plain shared_ptr release would free a million-element list or forced
+ * stream one nested destructor per cell; this unhooks each uniquely owned
+ * cell's tail before freeing it instead. Lists nested through the car,
+ * e.g. ((((...)))), are kept on an explicit worklist and freed the same way.
+ */
+void releaseChain(Value &);
+
+/**
+ * @brief Vector value: elements in one contiguous block
+ *
+ * O(1) vector-ref / vector-set! and a single allocation for the storage,
+ * unlike a list.
+ */
+struct Vector : ValueBase, GcObject {
+    static const ValueType TAG = V_VECTOR; ///< Tag checked by Value::as<Vector>()
+    HeapVector<Value> items;   ///< Charged to live_bytes, see HeapAllocator
+    Vector(HeapVector<Value> &&);
+    virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
+};
+Value VectorV(HeapVector<Value> &&);
+
+/**
+ * @brief Hash table value: open addressing with linear probing
+ *
+ * Keys compare with eq? or equal? (fixed when the table is made) and are
+ * hashed consistently with that predicate, see hashtable.hpp. The slot
+ * array has a power-of-two size and is kept at most 3/4 full, deleted
+ * slots included, so probing always reaches an empty slot.
+ */
+struct HashTable : ValueBase, GcObject {
+    static const ValueType TAG = V_HASHTABLE; ///< Tag checked by Value::as<HashTable>()
+    enum SlotState : uint8_t { EMPTY, FULL, DELETED };
+    struct Slot {
+        Value key;
+        Value value;
+        size_t hash;      ///< Hash of key, kept so growing never rehashes keys
+        SlotState state;
+        Slot();
+    };
+    bool by_equal;        ///< Keys compare with equal? rather than eq?
+    HeapVector<Slot> slots; ///< Charged to live_bytes, see HeapAllocator
+    size_t count;         ///< FULL slots
+    size_t used;          ///< FULL and DELETED slots
+    explicit HashTable(bool);
+    Value *find(const Value &);               ///< Value stored under the key, nullptr if none
+    void set(const Value &, const Value &);
+    bool erase(const Value &);                ///< false if the key was not there
+    virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
+private:
+    Slot *lookup(const Value &, size_t);
+    void grow();
+};
+Value HashTableV(bool by_equal);
+
 /**
  * @brief Procedure (function) value
  */
-struct Procedure : ValueBase {
-    std::vector<std::string> parameters;   ///< Parameter names
+struct Procedure : ValueBase, GcObject {
+    static const ValueType TAG = V_PROC; ///< Tag checked by Value::as<Procedure>()
+    std::vector<Atom> parameters;          ///< Parameter names
     Expr e;                                ///< Function body expression
     Assoc env;                             ///< Closure environment
-    Procedure(const std::vector<std::string> &, const Expr &, const Assoc &);
+    std::shared_ptr<Code> code;            ///< Compiled body, nullptr until the VM needs it
+    Atom name;                             ///< Name of the Lambda it came from
+    Procedure(const std::vector<Atom> &, const Expr &, const Assoc &, const std::shared_ptr<Code> &, Atom);
+    virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
+};
+Value ProcedureV(const std::vector<Atom> &, const Expr &, const Assoc &, const std::shared_ptr<Code> &, Atom name);
+
+typedef Value (*PrimFn)(const Value *args, int argc);
+
+/**
+ * @brief Built-in procedure used as a first-class value
+ *
+ * One instance per primitive, created at startup; Apply calls fn with the
+ * evaluated arguments directly, the VM with a pointer into its stack.
+ */
+struct Primitive : ValueBase {
+    static const ValueType TAG = V_PRIM; ///< Tag checked by Value::as<Primitive>()
+    PrimFn fn;   ///< Native implementation
+    int arity;   ///< Number of arguments, -1 for any number
+    Primitive(PrimFn, int);
+    virtual void show(std::ostream &) override;
+};
+Value PrimitiveV(PrimFn, int);
+Value primitiveValue(ExprType); ///< The shared Primitive for a primitive's ExprType, unbound if none (evaluation.cpp)
+
+struct Task;
+
+/**
+ * @brief Result of (future thunk), read with touch (parallel.cpp)
+ *
+ * The task holds the thunk until it has run and then its result, error
+ * and buffered output.
+ */
+struct Future : ValueBase, GcObject {
+    static const ValueType TAG = V_FUTURE; ///< Tag checked by Value::as<Future>()
+    std::shared_ptr<Task> task;
+    explicit Future(const std::shared_ptr<Task> &);
+    virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
+};
+
+struct MemoCache;
+
+/**
+ * @brief Procedure made by memoize: calls fn through a bounded LRU cache (memo.cpp)
+ */
+struct Memoized : ValueBase, GcObject {
+    static const ValueType TAG = V_MEMO; ///< Tag checked by Value::as<Memoized>()
+    Value fn;                         ///< Procedure being memoized
+    size_t capacity;                  ///< Entries kept before the least recently used is dropped
+    std::unique_ptr<MemoCache> cache;
+    Memoized(const Value &, size_t);
+    ~Memoized();
     virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
 };
-Value ProcedureV(const std::vector<std::string> &, const Expr &, const Assoc &);
+Value MemoizedV(const Value &, size_t);
+
+/**
+ * @brief Promise made by delay, cons-stream, make-promise or a stream combinator (stream.cpp)
+ *
+ * Until it is forced the promise holds what computes its value: a thunk,
+ * or the procedure and the rest of the source stream of a stream-map,
+ * stream-filter or stream-take cell. Forcing stores the value and drops
+ * all of that, so a forced cell keeps neither the thunk's environment nor
+ * the source alive.
+ */
+struct Promise : ValueBase, GcObject {
+    static const ValueType TAG = V_PROMISE; ///< Tag checked by Value::as<Promise>()
+    enum Kind : uint8_t { FORCED, THUNK, MAP, FILTER, TAKE };
+    Kind kind;
+    Value fn;       ///< Thunk, mapped procedure or predicate
+    Value source;   ///< Rest of the source stream (MAP, FILTER, TAKE)
+    int count;      ///< Elements left to take (TAKE)
+    Value value;    ///< Result, once FORCED
+    Promise(Kind, const Value &, const Value &, int);
+    ~Promise();     ///< Frees the rest of a forced stream in a loop, see releaseChain
+    virtual void show(std::ostream &) override;
+    virtual GcObject *gcObject() override;
+    virtual void traverse(GcVisitor &) override;
+    virtual void clearRefs() override;
+};
+Value PromiseV(Promise::Kind, const Value &fn, const Value &source, int count = 0);
+Value ForcedPromiseV(const Value &); ///< (make-promise v)
 
 // ============================================================================
 // Utility Functions
 // ============================================================================
 
-std::ostream &operator<<(std::ostream &, Value &);
+std::ostream &operator<<(std::ostream &, const Value &);
+
+/**
+ * @brief Buffered, non-recursive writer of external representations
+ *
+ * Lists and vectors are walked with an explicit stack instead of recursing
+ * through their elements, and fixnums, symbols and strings are formatted straight
+ * into a char buffer that is written to the stream in large blocks (and
+ * when the Printer goes away). A cdr chain that loops back on itself is
+ * cut with " ...)", and lists nested deeper than MAX_DEPTH print as
+ * "...", so circular structure built with set-car!/set-cdr! or
+ * vector-set! neither hangs nor overflows the stack.
+ */
+struct Printer {
+    static const size_t MAX_DEPTH = 10000;
+    std::ostream &os;
+    std::string buf;
+    explicit Printer(std::ostream &);
+    ~Printer();
+    void print(const Value &);
+    void list(const Pair *);
+    void vector(const Vector *);
+    void flush();
+private:
+    void nested(const Pair *, const Vector *); // 从一个表或者向量开始打印
+    void atom(const Value &);    // 任何不是 pair 的值
+    void integer(int);
+    void number(const Value &); // fixnum 或 bignum
+};
+
+/**
+ * @brief Static downcast to a heap value type, checked in debug builds
+ *
+ * Callers test type() first, so this never needs RTTI; T::TAG is the
+ * ValueType the heap struct is created with.
+ */
+template <typename T>
+T *Value::as() const {
+    assert(tag == T::TAG && ptr);
+    return static_cast<T *>(ptr.get());
+}
 
 #endif // VALUE
\ No newline at end of file
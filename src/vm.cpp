@@ -0,0 +1,456 @@
+/**
+ * @file vm.cpp
+ * @brief Stack machine that runs compiled Code
+ *
+ * Calls to procedures push a Frame on an explicit call stack instead of
+ * recursing in C++, and tail calls reuse the current one, so neither
+ * deep non-tail recursion nor long loops grow the native stack.
+ */
+
+#include "vm.hpp"
+#include "Def.hpp"
+#include "RE.hpp"
+#include "expr.hpp"
+#include "gc.hpp"
+#include "limits.hpp"
+#include "memo.hpp"
+#include "parallel.hpp"
+#include "profile.hpp"
+#include "value.hpp"
+#include <iterator>
+#include <memory>
+#include <vector>
+
+bool use_vm = true;
+
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO 1
+#endif
+
+namespace {
+
+struct Frame {
+    std::shared_ptr<Code> code;  ///< Keeps the caller's code alive even if its procedure is dropped
+    const int *pc;               ///< Return address
+    Assoc env;
+    bool at_entry;               ///< The caller is the entry code rather than a procedure (--profile)
+};
+
+// 没命中缓存的 memoize 调用：在 depth 层返回时，栈顶就是它的结果
+struct PendingMemo {
+    Value memo;
+    std::vector<Value> args;
+    size_t hash;
+    size_t depth;                ///< frames.size() while the procedure runs
+};
+
+inline Value pop(std::vector<Value> &stack) {
+    Value v = std::move(stack.back());
+    stack.pop_back();
+    return v;
+}
+
+// 栈顶 n 个值搬进一个新 vector（给 frame 或者内建过程做实参）
+inline std::vector<Value> takeArgs(std::vector<Value> &stack, int n) {
+    std::vector<Value> args(std::make_move_iterator(stack.end() - n), std::make_move_iterator(stack.end()));
+    stack.erase(stack.end() - n, stack.end());
+    return args;
+}
+
+} // namespace
+
+Value vmRun(const std::shared_ptr<Code> &entry, const Assoc &entry_env, bool body) {
+#ifdef VM_COMPUTED_GOTO
+    // 顺序必须和 OpCode 一致
+    static const void *labels[] = {
+        &&L_OP_CONST, &&L_OP_LOCAL0, &&L_OP_LOCAL, &&L_OP_GLOBAL, &&L_OP_SET_LOCAL,
+        &&L_OP_SET_GLOBAL, &&L_OP_DEFINE_BEGIN, &&L_OP_DEFINE, &&L_OP_POP, &&L_OP_JUMP,
+        &&L_OP_JUMP_IF_FALSE, &&L_OP_JUMP_IF_FALSE_KEEP, &&L_OP_JUMP_IF_TRUE_KEEP,
+        &&L_OP_MAKE_FRAME, &&L_OP_EMPTY_FRAME, &&L_OP_STORE_LOCAL0, &&L_OP_POP_FRAME,
+        &&L_OP_CLOSURE, &&L_OP_CHECK_PROC, &&L_OP_CALL, &&L_OP_TAIL_CALL, &&L_OP_RETURN,
+        &&L_OP_UNARY, &&L_OP_BINARY, &&L_OP_VARIADIC, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL,
+        &&L_OP_LT, &&L_OP_LE, &&L_OP_NUM_EQ, &&L_OP_GE, &&L_OP_GT, &&L_OP_CAR, &&L_OP_CDR,
+        &&L_OP_CONS, &&L_OP_NOT, &&L_OP_NULLQ, &&L_OP_PAIRQ, &&L_OP_STREAM_FILTER, &&L_OP_EVAL,
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == OP_COUNT, "dispatch table out of sync with OpCode");
+// 计算 goto 跳出块时 GCC 不会析构块里的局部对象：handler 里不要留下
+// 仍持有引用的 Value / Assoc 局部变量，要么直接在栈上改，要么先 move 走
+#define TARGET(op) L_##op:
+#define DISPATCH() goto *labels[*pc++]
+#else
+#define TARGET(op) case op:
+#define DISPATCH() continue
+#endif
+
+    CallScope scope; // 出错时 frames 直接丢掉，深度在这里一起退回去
+    if (body) enterCall(); // 从 applyValue 之类重入时 C++ 栈才会变深
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<PendingMemo> memos;
+    stack.reserve(64);
+    std::shared_ptr<Code> code = entry;
+    const int *pc = code->ops.data();
+    Assoc env = entry_env;
+    bool tail = false;
+    int argc = 0;
+    bool at_entry = true; // 正在跑的是 entry 本身，不是哪个过程的调用；--profile 靠它配对进出
+    bool entry_counted = body; // 顶层代码不算一层深度，和 tree-walker 一样只数过程体
+    Value memo_result(nullptr);
+    size_t memo_hash = 0;
+
+#define JUMP_TO(t) (pc = code->ops.data() + (t))
+#define NODE(i) (code->nodes[i].get())
+
+#ifdef VM_COMPUTED_GOTO
+    DISPATCH();
+#else
+    for (;;) switch (*pc++) {
+#endif
+
+    TARGET(OP_CONST) {
+        stack.push_back(code->consts[*pc++]);
+        DISPATCH();
+    }
+    TARGET(OP_LOCAL0) {
+        const Value &v = env->slots[*pc++];
+        if (!v.bound()) throw RuntimeError("The variable is used before its definition"); // letrec 的占位
+        stack.push_back(v);
+        DISPATCH();
+    }
+    TARGET(OP_LOCAL) {
+        AssocList *frame = env.get();
+        for (int i = pc[0]; i > 0; i--) frame = frame->next.get();
+        const Value &v = frame->slots[pc[1]];
+        pc += 2;
+        if (!v.bound()) throw RuntimeError("The variable is used before its definition");
+        stack.push_back(v);
+        DISPATCH();
+    }
+    TARGET(OP_GLOBAL) {
+        Value *cell = code->cells[*pc++];
+        if (!cell->bound()) throw RuntimeError("The variable is not define in the scope");
+        stack.push_back(*cell);
+        DISPATCH();
+    }
+    TARGET(OP_SET_LOCAL) {
+        AssocList *frame = env.get();
+        for (int i = pc[0]; i > 0; i--) frame = frame->next.get();
+        frame->slots[pc[1]] = pop(stack);
+        pc += 2;
+        stack.push_back(VoidV());
+        DISPATCH();
+    }
+    TARGET(OP_SET_GLOBAL) {
+        checkGlobalWrite();
+        Value *cell = code->cells[pc[0]];
+        if (!cell->bound()) throw RuntimeError("DEBUG: try to set a undefined var: " + static_cast<Set *>(NODE(pc[1]))->var);
+        pc += 2;
+        *cell = pop(stack);
+        stack.push_back(VoidV());
+        DISPATCH();
+    }
+    TARGET(OP_DEFINE_BEGIN) {
+        checkGlobalWrite();
+        *code->cells[*pc++] = Value(nullptr); // 先放一个占位，和 Define::eval 一致
+        DISPATCH();
+    }
+    TARGET(OP_DEFINE) {
+        *code->cells[*pc++] = pop(stack);
+        stack.push_back(VoidV());
+        DISPATCH();
+    }
+    TARGET(OP_POP) {
+        stack.pop_back();
+        DISPATCH();
+    }
+    TARGET(OP_JUMP) {
+        JUMP_TO(*pc);
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_FALSE) {
+        if (stack.back().isFalse()) JUMP_TO(*pc);
+        else pc++;
+        stack.pop_back();
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_FALSE_KEEP) {
+        if (stack.back().isFalse()) {
+            JUMP_TO(*pc);
+        } else {
+            pc++;
+            stack.pop_back();
+        }
+        DISPATCH();
+    }
+    TARGET(OP_JUMP_IF_TRUE_KEEP) {
+        if (!stack.back().isFalse()) {
+            JUMP_TO(*pc);
+        } else {
+            pc++;
+            stack.pop_back();
+        }
+        DISPATCH();
+    }
+    TARGET(OP_MAKE_FRAME) {
+        env = extendFrame(takeArgs(stack, *pc++), env);
+        DISPATCH();
+    }
+    TARGET(OP_EMPTY_FRAME) {
+        env = extendFrame(std::vector<Value>(*pc++, Value(nullptr)), env);
+        DISPATCH();
+    }
+    TARGET(OP_STORE_LOCAL0) {
+        env->slots[*pc++] = pop(stack);
+        DISPATCH();
+    }
+    TARGET(OP_POP_FRAME) {
+        Assoc outer = env->next;
+        env = std::move(outer);
+        DISPATCH();
+    }
+    TARGET(OP_CLOSURE) {
+        Lambda *lambda = static_cast<Lambda *>(NODE(*pc++));
+        stack.push_back(ProcedureV(lambda->x, lambda->e, env, lambda->code, lambda->name)); // 编译外层代码时已经编好
+        DISPATCH();
+    }
+    TARGET(OP_CHECK_PROC) {
+        ValueType t = stack.back().type();
+        if (t != V_PROC && t != V_PRIM && t != V_MEMO) throw RuntimeError("Attempt to apply a non-procedure");
+        DISPATCH();
+    }
+    TARGET(OP_CALL) {
+        tail = false;
+        argc = *pc++;
+        goto do_call;
+    }
+    TARGET(OP_TAIL_CALL) {
+        tail = true;
+        argc = *pc++;
+        goto do_call;
+    }
+    do_call: {
+        gcSafepoint(); // 所有活对象都在 stack / frames / env 里
+        countStep();
+        Value &f = stack[stack.size() - argc - 1];
+        if (f.type() == V_PRIM) {
+            Primitive *prim = f.as<Primitive>();
+            if (prim->arity >= 0 && argc != prim->arity) throw RuntimeError("Wrong number of arguments");
+            f = prim->fn(stack.data() + stack.size() - argc, argc); // 实参就在栈上，结果覆盖掉过程本身
+            stack.erase(stack.end() - argc, stack.end());
+            if (tail) goto do_return;
+            DISPATCH();
+        }
+        if (f.type() == V_MEMO) {
+            const Value *args = stack.data() + stack.size() - argc;
+            if (memoLookup(f, args, argc, memo_hash, memo_result)) {
+                f = std::move(memo_result);
+                stack.erase(stack.end() - argc, stack.end());
+                if (tail) goto do_return;
+                DISPATCH();
+            }
+            if (f.as<Memoized>()->fn.type() != V_PROC) { // 内建过程或者套了两层：直接算
+                f = memoCall(f, args, argc);
+                stack.erase(stack.end() - argc, stack.end());
+                if (tail) goto do_return;
+                DISPATCH();
+            }
+            // 没命中：照常调用过程，不占 C++ 栈；它返回到调用者那一层时在 do_return 里存结果。
+            // 尾调用不压 frame，过程的返回就是调用者的返回，所以记的还是当前这一层
+            memos.push_back(PendingMemo{f, std::vector<Value>(args, args + argc), memo_hash, frames.size() + (tail ? 0 : 1)});
+            f = f.as<Memoized>()->fn;
+        }
+        Procedure *proc = f.as<Procedure>();
+        if (argc != (int)proc->parameters.size()) throw RuntimeError("Wrong number of arguments");
+        if (profiling) {
+            if (tail && !at_entry) profileTail(proc->name);
+            else profileEnter(proc->name);
+        }
+        // tree-walker 建的闭包没有 code；和 applyValue 一样编进局部变量，不回写 proc->code
+        std::shared_ptr<Code> callee = proc->code ? proc->code : compileCode(proc->e);
+        Assoc callee_env = extendFrame(takeArgs(stack, argc), proc->env);
+        stack.pop_back(); // 过程本身，callee / callee_env 已经各持有一份
+        if (!tail) {
+            enterCall();
+            frames.push_back(Frame{std::move(code), pc, std::move(env), at_entry});
+        } else if (!entry_counted && at_entry) { // 顶层代码尾调用过程：从这里起跑的是过程体
+            enterCall();
+            entry_counted = true;
+        }
+        at_entry = false;
+        code = std::move(callee);
+        env = std::move(callee_env);
+        pc = code->ops.data();
+        DISPATCH();
+    }
+    TARGET(OP_RETURN) {
+        goto do_return;
+    }
+    do_return: {
+        if (profiling && !at_entry) profileExit();
+        while (!memos.empty() && memos.back().depth == frames.size()) { // 连着尾调用的几个 memoize 得到同一个值
+            memoStore(memos.back().memo, std::move(memos.back().args), memos.back().hash, stack.back());
+            memos.pop_back();
+        }
+        if (frames.empty()) return pop(stack);
+        Frame &caller = frames.back();
+        code = std::move(caller.code);
+        env = std::move(caller.env);
+        pc = caller.pc;
+        at_entry = caller.at_entry;
+        frames.pop_back();
+        leaveCall();
+        DISPATCH(); // 返回值留在栈顶，正好是调用者要的
+    }
+    TARGET(OP_UNARY) {
+        Unary *node = static_cast<Unary *>(NODE(*pc++));
+        stack.back() = node->evalRator(stack.back());
+        DISPATCH();
+    }
+    TARGET(OP_BINARY) {
+        Binary *node = static_cast<Binary *>(NODE(*pc++));
+        Value &a = stack[stack.size() - 2];
+        a = node->evalRator(a, stack.back());
+        stack.pop_back();
+        DISPATCH();
+    }
+    TARGET(OP_VARIADIC) {
+        Variadic *node = static_cast<Variadic *>(NODE(pc[0]));
+        int n = pc[1];
+        pc += 2;
+        if (n == 0) {
+            stack.push_back(node->evalRator(nullptr, 0));
+        } else { // 直接在栈上的 n 个实参上算，结果放进第一个实参的槽
+            Value *args = stack.data() + stack.size() - n;
+            args[0] = node->evalRator(args, n);
+            stack.erase(stack.end() - (n - 1), stack.end());
+        }
+        DISPATCH();
+    }
+
+    // 两个 fixnum 时就地算，其余情况交给节点自己的 evalRator（有理数、报错）
+#define FIXNUM_OP(op, expr)                                                       \
+    TARGET(op) {                                                                  \
+        Value &a = stack[stack.size() - 2];                                       \
+        const Value &b = stack.back();                                            \
+        if (a.type() == V_INT && b.type() == V_INT) {                             \
+            int x = a.asInt(), y = b.asInt();                                     \
+            a = (expr);                                                           \
+        } else {                                                                  \
+            a = static_cast<Binary *>(NODE(*pc))->evalRator(a, b);                \
+        }                                                                         \
+        pc++;                                                                     \
+        stack.pop_back();                                                         \
+        DISPATCH();                                                               \
+    }
+    FIXNUM_OP(OP_LT, BooleanV(x < y))
+    FIXNUM_OP(OP_LE, BooleanV(x <= y))
+    FIXNUM_OP(OP_NUM_EQ, BooleanV(x == y))
+    FIXNUM_OP(OP_GE, BooleanV(x >= y))
+    FIXNUM_OP(OP_GT, BooleanV(x > y))
+#undef FIXNUM_OP
+
+    // 加减乘：fixnum 运算带溢出检查，溢出时同样交给 evalRator，由它升成 bignum
+#define CHECKED_OP(op, builtin)                                                   \
+    TARGET(op) {                                                                  \
+        Value &a = stack[stack.size() - 2];                                       \
+        const Value &b = stack.back();                                            \
+        int r;                                                                    \
+        if (a.type() == V_INT && b.type() == V_INT && !builtin(a.asInt(), b.asInt(), &r)) { \
+            a = IntegerV(r);                                                      \
+        } else {                                                                  \
+            a = static_cast<Binary *>(NODE(*pc))->evalRator(a, b);                \
+        }                                                                         \
+        pc++;                                                                     \
+        stack.pop_back();                                                         \
+        DISPATCH();                                                               \
+    }
+    CHECKED_OP(OP_ADD, __builtin_add_overflow)
+    CHECKED_OP(OP_SUB, __builtin_sub_overflow)
+    CHECKED_OP(OP_MUL, __builtin_mul_overflow)
+#undef CHECKED_OP
+
+    TARGET(OP_CAR) {
+        Value &v = stack.back();
+        if (v.type() == V_PAIR) v = Value(v.as<Pair>()->car);
+        else v = static_cast<Unary *>(NODE(*pc))->evalRator(v);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(OP_CDR) {
+        Value &v = stack.back();
+        if (v.type() == V_PAIR) v = Value(v.as<Pair>()->cdr);
+        else v = static_cast<Unary *>(NODE(*pc))->evalRator(v);
+        pc++;
+        DISPATCH();
+    }
+    TARGET(OP_CONS) {
+        Value &a = stack[stack.size() - 2];
+        a = PairV(a, stack.back());
+        stack.pop_back();
+        DISPATCH();
+    }
+    TARGET(OP_NOT) {
+        stack.back() = BooleanV(stack.back().isFalse());
+        DISPATCH();
+    }
+    TARGET(OP_NULLQ) {
+        stack.back() = BooleanV(stack.back().type() == V_NULL);
+        DISPATCH();
+    }
+    TARGET(OP_PAIRQ) {
+        stack.back() = BooleanV(stack.back().type() == V_PAIR);
+        DISPATCH();
+    }
+    TARGET(OP_STREAM_FILTER) { // 源流从栈上拿走：跳过的格子不再被这个槽留着
+        StreamFilter *node = static_cast<StreamFilter *>(NODE(*pc++));
+        Value s = std::move(stack.back());
+        stack.pop_back();
+        stack.back() = node->filter(stack.back(), std::move(s));
+        DISPATCH();
+    }
+    TARGET(OP_EVAL) {
+        stack.push_back(NODE(*pc++)->eval(env));
+        DISPATCH();
+    }
+
+#ifndef VM_COMPUTED_GOTO
+    default:
+        throw RuntimeError("Bad opcode");
+    }
+#endif
+
+#undef TARGET
+#undef DISPATCH
+#undef JUMP_TO
+#undef NODE
+}
+
+Value evalTopLevel(const Expr &expr, Assoc &env) {
+    if (!use_vm) return expr->eval(env);
+    return vmRun(compileCode(expr), env, false);
+}
+
+Value applyValue(const Value &f, std::vector<Value> &&args) {
+    countStep();
+    if (f.type() == V_PRIM) {
+        Primitive *prim = f.as<Primitive>();
+        if (prim->arity >= 0 && (int)args.size() != prim->arity) throw RuntimeError("Wrong number of arguments");
+        return prim->fn(args.data(), args.size());
+    }
+    if (f.type() == V_MEMO) return memoCall(f, args.data(), args.size());
+    if (f.type() != V_PROC) throw RuntimeError("Attempt to apply a non-procedure");
+    Procedure *proc = f.as<Procedure>();
+    if (args.size() != proc->parameters.size()) throw RuntimeError("Wrong number of arguments");
+    Assoc env = extendFrame(std::move(args), proc->env);
+    if (!use_vm) {
+        TailCall tc;
+        tc.expr = proc->e;
+        tc.env = env;
+        tc.name = proc->name;
+        return trampoline(Value(nullptr), tc);
+    }
+    if (profiling) profileEnter(proc->name); // 和 trampoline 一样把这次调用记上；出错时由 profileUnwind 收尾
+    Value v = vmRun(proc->code ? proc->code : compileCode(proc->e), env, true); // 不回写 proc->code，别的线程可能正在读
+    if (profiling) profileExit();
+    return v;
+}
@@ -0,0 +1,100 @@
+#ifndef VM_HPP
+#define VM_HPP
+
+/**
+ * @file vm.hpp
+ * @brief Bytecode compiler and stack VM
+ *
+ * After resolution a top-level Expr can be lowered into a linear Code
+ * (compile.cpp) and run by a stack machine with computed-goto dispatch
+ * (vm.cpp). Environment frames stay AssocList chains with the same
+ * (depth, slot) layout the resolver assigned, so closures, globals and
+ * primitives are shared with the tree-walker, which remains available as
+ * the reference engine (--tree).
+ *
+ * Each lambda body is compiled once, together with the code that contains
+ * it, and cached on its Lambda node; procedures carry a pointer to it.
+ * Nothing is compiled or cached while code runs, so several threads can
+ * run the same Code at once (see parallel.hpp).
+ */
+
+#include "expr.hpp"
+#include "value.hpp"
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Instructions; operands follow the opcode in Code::ops
+ */
+enum OpCode {
+    OP_CONST,        ///< k          push consts[k]
+    OP_LOCAL0,       ///< s          push slot s of the current frame
+    OP_LOCAL,        ///< d s        push slot s of the frame d levels up
+    OP_GLOBAL,       ///< k          push *cells[k]
+    OP_SET_LOCAL,    ///< d s        pop into a slot, push #<void>
+    OP_SET_GLOBAL,   ///< k n        pop into a bound global cell, push #<void>
+    OP_DEFINE_BEGIN, ///< k          unbind cells[k] while its value is computed
+    OP_DEFINE,       ///< k          pop into cells[k], push #<void>
+    OP_POP,          ///<            drop the top of stack
+    OP_JUMP,         ///< t          jump to t
+    OP_JUMP_IF_FALSE,      ///< t    pop, jump if #f
+    OP_JUMP_IF_FALSE_KEEP, ///< t    jump keeping the value if #f, else pop
+    OP_JUMP_IF_TRUE_KEEP,  ///< t    jump keeping the value unless #f, else pop
+    OP_MAKE_FRAME,   ///< n          pop n values into a new frame (let)
+    OP_EMPTY_FRAME,  ///< n          push a frame of n unbound slots (letrec)
+    OP_STORE_LOCAL0, ///< s          pop into slot s of the current frame
+    OP_POP_FRAME,    ///<            return to the enclosing frame
+    OP_CLOSURE,      ///< i          push a procedure for the Lambda nodes[i]
+    OP_CHECK_PROC,   ///<            fail unless the top of stack is applicable
+    OP_CALL,         ///< n          call with n arguments
+    OP_TAIL_CALL,    ///< n          call with n arguments, replacing this frame
+    OP_RETURN,       ///<            return the top of stack
+    OP_UNARY,        ///< i          apply Unary nodes[i]'s evalRator
+    OP_BINARY,       ///< i          apply Binary nodes[i]'s evalRator
+    OP_VARIADIC,     ///< i n        apply Variadic nodes[i]'s evalRator to n values
+    OP_ADD,          ///< i          fixnum fast paths, falling back to nodes[i]
+    OP_SUB,          ///< i
+    OP_MUL,          ///< i
+    OP_LT,           ///< i
+    OP_LE,           ///< i
+    OP_NUM_EQ,       ///< i
+    OP_GE,           ///< i
+    OP_GT,           ///< i
+    OP_CAR,          ///< i
+    OP_CDR,          ///< i
+    OP_CONS,         ///<
+    OP_NOT,          ///<
+    OP_NULLQ,        ///<
+    OP_PAIRQ,        ///<
+    OP_STREAM_FILTER, ///< i        StreamFilter nodes[i], taking the stream off the stack
+    OP_EVAL,         ///< i          tree-walk nodes[i] in the current frame
+    OP_COUNT
+};
+
+/**
+ * @brief Compiled form of one top-level expression or lambda body
+ */
+struct Code {
+    std::vector<int> ops;        ///< Opcodes and their operands
+    std::vector<Value> consts;   ///< Constant pool
+    std::vector<Value *> cells;  ///< Global binding cells
+    std::vector<Expr> nodes;     ///< Expression nodes referenced by operands
+};
+
+extern bool use_vm; ///< false selects the tree-walker (--tree)
+
+std::shared_ptr<Code> compileCode(const Expr &);         // compile.cpp, for a top-level form or a body
+std::shared_ptr<Code> compileLambda(Lambda *);           // compile.cpp, cached on the node
+Value vmRun(const std::shared_ptr<Code> &, const Assoc &, bool body); // vm.cpp; body: the code is a procedure's, counted as a call
+
+/**
+ * @brief Evaluate a resolved top-level expression with the selected engine
+ */
+Value evalTopLevel(const Expr &, Assoc &);
+
+/**
+ * @brief Call a procedure or primitive with the selected engine (tasks in parallel.cpp, cache misses in memo.cpp)
+ */
+Value applyValue(const Value &, std::vector<Value> &&);
+
+#endif // VM_HPP